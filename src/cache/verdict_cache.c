@@ -0,0 +1,268 @@
+#include "verdict_cache.h"
+#include "../judge/checker.h"
+#include "../judge/bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define MAX_TEST_FILES 4096
+
+static char problem[256];                             // test case directory
+static char cache_dir[300];                           // files/cache/<problem hash>
+static unsigned char fingerprint[SHA256_DIGEST_SIZE]; // names, sizes and mtimes of the test files
+static char testset[SHA256_HEX_SIZE];                 // checksum of the test file contents
+static int cache_ready = 0;                           // 1 once the test set has been hashed
+static long long checked_at = 0;                      // when the test files were last listed
+
+/**
+ * @brief current monotonic time in milliseconds
+ */
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief compare two file names for qsort
+ */
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief list the test files (*.in, *.out) of the problem in name order
+ * @param names heap-allocated names (output), freed by the caller
+ * @return number of names, or -1 on error
+ */
+static int list_test_files(char ***names)
+{
+    DIR *dir = opendir(problem);
+    if (!dir)
+    {
+        perror("opendir failed");
+        return -1;
+    }
+    char **list = malloc(MAX_TEST_FILES * sizeof(char *));
+    if (!list)
+    {
+        closedir(dir);
+        return -1;
+    }
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < MAX_TEST_FILES)
+    {
+        const char *ext = strrchr(entry->d_name, '.');
+        // a new checker may judge the same output differently, new bench settings time it differently
+        if (entry->d_type == DT_REG && ((ext && (strcmp(ext, ".in") == 0 || strcmp(ext, ".out") == 0)) ||
+                                        strcmp(entry->d_name, CHECKER_FILE) == 0 || strcmp(entry->d_name, BENCH_FILE) == 0))
+            list[count++] = strdup(entry->d_name);
+    }
+    closedir(dir);
+    qsort(list, count, sizeof(char *), compare_names);
+    *names = list;
+    return count;
+}
+
+/**
+ * @brief remove every cached verdict of the problem
+ */
+static void purge_entries(void)
+{
+    DIR *dir = opendir(cache_dir);
+    if (!dir)
+        return;
+    struct dirent *entry;
+    char path[600];
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.' || strcmp(entry->d_name, CACHE_TESTSET_FILE) == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(dir);
+}
+
+/**
+ * @brief write a file atomically through a temporary file and rename
+ * @param path destination path
+ * @param data file contents
+ * @param len byte size of the contents
+ */
+static void write_atomic(const char *path, const char *data, size_t len)
+{
+    char tmp[700];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+    {
+        perror("fopen failed");
+        return;
+    }
+    size_t written = fwrite(data, 1, len, fp);
+    if (fclose(fp) != 0 || written != len || rename(tmp, path) != 0)
+    {
+        perror("write cache entry failed");
+        unlink(tmp);
+    }
+}
+
+/**
+ * @brief rehash the test set if any test file changed, invalidating stale entries
+ *      the directory is listed at most once per CACHE_RECHECK_MS, lookups in between
+ *      use the last checksum
+ * @return 0 on success, -1 on error
+ */
+static int refresh_testset(void)
+{
+    long long now = now_ms();
+    if (cache_ready && now - checked_at < CACHE_RECHECK_MS)
+        return 0;
+    checked_at = now;
+
+    char **names;
+    int count = list_test_files(&names);
+    if (count < 0)
+        return -1;
+
+    // cheap fingerprint first, contents are only hashed when it changes
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    char path[600];
+    struct stat st;
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", problem, names[i]);
+        if (stat(path, &st) < 0)
+            continue;
+        sha256_update(&ctx, names[i], strlen(names[i]) + 1);
+        sha256_update(&ctx, &st.st_size, sizeof(st.st_size));
+        sha256_update(&ctx, &st.st_mtim, sizeof(st.st_mtim));
+    }
+    unsigned char current[SHA256_DIGEST_SIZE];
+    sha256_final(&ctx, current);
+    if (cache_ready && memcmp(current, fingerprint, sizeof(current)) == 0)
+    {
+        for (int i = 0; i < count; i++)
+            free(names[i]);
+        free(names);
+        return 0;
+    }
+
+    sha256_init(&ctx);
+    char buf[4096];
+    for (int i = 0; i < count; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", problem, names[i]);
+        sha256_update(&ctx, names[i], strlen(names[i]) + 1);
+        FILE *fp = fopen(path, "rb");
+        if (fp)
+        {
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+                sha256_update(&ctx, buf, n);
+            fclose(fp);
+        }
+        sha256_update(&ctx, "", 1);
+        free(names[i]);
+    }
+    free(names);
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, testset);
+    memcpy(fingerprint, current, sizeof(current));
+    cache_ready = 1;
+
+    // verdicts judged against another test set are invalid
+    char stored[SHA256_HEX_SIZE] = {0};
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, CACHE_TESTSET_FILE);
+    FILE *fp = fopen(path, "r");
+    if (fp)
+    {
+        if (fread(stored, 1, SHA256_HEX_SIZE - 1, fp) != SHA256_HEX_SIZE - 1)
+            stored[0] = '\0';
+        fclose(fp);
+    }
+    if (strcmp(stored, testset) != 0)
+    {
+        purge_entries();
+        write_atomic(path, testset, SHA256_HEX_SIZE - 1);
+        printf("Verdict cache for %s reset (test set %.16s)\n", problem, testset);
+    }
+    return 0;
+}
+
+int verdict_cache_init(const char *problem_dir)
+{
+    strncpy(problem, problem_dir, sizeof(problem) - 1);
+    problem[sizeof(problem) - 1] = '\0';
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, problem, strlen(problem));
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+    snprintf(cache_dir, sizeof(cache_dir), "%s/%.16s", CACHE_DIR, hex);
+
+    if ((mkdir(CACHE_DIR, 0755) < 0 && errno != EEXIST) || (mkdir(cache_dir, 0755) < 0 && errno != EEXIST))
+    {
+        perror("mkdir cache failed");
+        return -1;
+    }
+    cache_ready = 0;
+    return refresh_testset();
+}
+
+int verdict_cache_lookup(cache_key *key, char *result, size_t size, size_t *len)
+{
+    key->testset[0] = '\0';
+    if (refresh_testset() < 0)
+        return -1;
+    memcpy(key->testset, testset, sizeof(testset));
+
+    char hex[SHA256_HEX_SIZE];
+    char path[400];
+    sha256_hex(key->source, hex);
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, hex);
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+    size_t n = fread(result, 1, size - 1, fp);
+    fclose(fp);
+    if (n == 0)
+        return -1;
+    result[n] = '\0';
+    *len = n;
+    return 0;
+}
+
+int verdict_cache_final(const char *result)
+{
+    while (*result == '\n')
+        result++;
+    return strncmp(result, "Accepted", 8) == 0 || strncmp(result, "Wrong Answer", 12) == 0 ||
+           strncmp(result, "Compile Error", 13) == 0 || strncmp(result, "Runtime Error", 13) == 0;
+}
+
+void verdict_cache_store(const cache_key *key, const char *result, size_t len)
+{
+    if (!key->testset[0] || refresh_testset() < 0 || strcmp(key->testset, testset) != 0)
+        return;
+
+    char hex[SHA256_HEX_SIZE];
+    char path[400];
+    sha256_hex(key->source, hex);
+    snprintf(path, sizeof(path), "%s/%s", cache_dir, hex);
+    write_atomic(path, result, len);
+}
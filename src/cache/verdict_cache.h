@@ -0,0 +1,54 @@
+#ifndef VERDICT_CACHE_H
+#define VERDICT_CACHE_H
+
+#include "../defineshit.h"
+#include "../util/sha256.h"
+#include <stddef.h>
+
+#define CACHE_DIR "files/cache"
+#define CACHE_TESTSET_FILE "testset"
+#define CACHED_FLAG "(cached)\n"
+#define CACHE_RECHECK_MS 1000 // the test files are checked for changes at most this often
+
+/**
+ * @brief cache key: source hash and the test set it was judged against
+ */
+typedef struct cache_key
+{
+    unsigned char source[SHA256_DIGEST_SIZE]; // SHA-256 of the submitted source
+    char testset[SHA256_HEX_SIZE];            // checksum of the test set, set by lookup
+} cache_key;
+
+/**
+ * @brief Open the verdict cache of a problem, dropping entries of an older test set
+ * @param problem_dir test case directory, also the problem ID
+ * @return 0 on success, -1 if the cache is unavailable
+ */
+int verdict_cache_init(const char *problem_dir);
+
+/**
+ * @brief Look up the verdict of a source against the current test set
+ * @param key cache key, key->testset is filled in on return
+ * @param result verdict buffer (output)
+ * @param size size of the verdict buffer
+ * @param len byte size of the verdict (output)
+ * @return 0 on hit, -1 on miss
+ */
+int verdict_cache_lookup(cache_key *key, char *result, size_t size, size_t *len);
+
+/**
+ * @brief Check whether a verdict is final and may be cached
+ * @param result verdict text
+ * @return 1 if the verdict can be cached, 0 otherwise
+ */
+int verdict_cache_final(const char *result);
+
+/**
+ * @brief Store a verdict, unless the test set changed since the lookup
+ * @param key cache key filled in by verdict_cache_lookup
+ * @param result verdict text
+ * @param len byte size of the verdict
+ */
+void verdict_cache_store(const cache_key *key, const char *result, size_t len);
+
+#endif // VERDICT_CACHE_H
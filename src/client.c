@@ -1,28 +1,177 @@
 #include "tcp/tcp_client.h"
+#include "tcp/batch.h"
 #include "defineshit.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PROFILE_WAIT_SECONDS 300 // how long -P waits for the profile after the verdict
+
+/**
+ * @brief print the usage of the client
+ * @param prog program name
+ */
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-d | -P] <server_ip> <port> <filename>\n", prog);
+    fprintf(stderr, "       %s -q <ticket> [-w wait_seconds] <server_ip> <port>\n", prog);
+    fprintf(stderr, "       %s -b <dir|manifest> [-j connections] [-o json|csv] [-d | -P] <server_ip> <port>\n", prog);
+}
+
+/**
+ * @brief upload a source for profiling: print the verdict, then wait for the profile
+ *      the server sends to the result store under the ticket the verdict ends with
+ * @param sockfd connected socket, closed on return
+ * @param filename source file
+ * @param server_ip server IP address
+ * @param port server port number
+ * @return 0 on success, -1 on error
+ */
+static int profile_file(int sockfd, const char *filename, const char *server_ip, int port)
+{
+    char reply[REPLY_SIZE];
+    int ret = send_file_data(sockfd, filename, UPLOAD_PROFILE);
+    if (ret == 0)
+        ret = receive_reply(sockfd, reply, sizeof(reply));
+    close_connection(sockfd);
+    if (ret < 0)
+        return -1;
+    printf("Judge result received:\n%s\n", reply);
+    // only accepted submissions are profiled
+    uint64_t ticket = follow_up_ticket(reply);
+    if (!ticket)
+        return 0;
+    sockfd = connect_to_server(server_ip, port);
+    if (sockfd < 0)
+        return -1;
+    ret = send_query(sockfd, ticket, PROFILE_WAIT_SECONDS * 1000ULL);
+    if (ret == 0)
+        ret = receive_judge_result(sockfd);
+    close_connection(sockfd);
+    return ret;
+}
+
+/**
+ * @brief upload a batch of submissions and write their results to stdout
+ * @param source directory or manifest
+ * @param server_ip server IP address
+ * @param port server port number
+ * @param conns connections open at once
+ * @param csv write CSV instead of JSON
+ * @param mode UPLOAD_WAIT, UPLOAD_DETACHED or UPLOAD_PROFILE
+ * @return exit status: 0 if every submission got a reply, 1 otherwise
+ */
+static int run_batch(const char *source, const char *server_ip, int port, int conns, int csv, int mode)
+{
+    batch b = {0};
+    int ret = batch_load(&b, source);
+    if (ret == 0)
+        fprintf(stderr, "%s: no submissions\n", source);
+    if (ret > 0)
+        ret = batch_run(&b, server_ip, port, conns, mode);
+    else
+        ret = -1;
+    if (ret >= 0)
+    {
+        if (csv)
+            batch_write_csv(&b, stdout);
+        else
+            batch_write_json(&b, stdout);
+        batch_report(&b, stderr);
+    }
+    batch_free(&b);
+    return ret == 0 ? 0 : 1;
+}
 
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
+    int mode = UPLOAD_WAIT;
+    int query = 0;
+    uint64_t ticket = 0;
+    uint64_t wait_ms = 0;
+    const char *batch_source = NULL;
+    int conns = BATCH_DEFAULT_CONNS;
+    int csv = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "dPq:w:b:j:o:")) != -1)
     {
-        fprintf(stderr, "Usage: %s <server_ip> <port> <filename>\n", argv[0]);
+        switch (opt)
+        {
+        case 'd':
+            mode = UPLOAD_DETACHED;
+            break;
+        case 'P':
+            // the verdict comes with a profile of the slowest test once accepted
+            mode = UPLOAD_PROFILE;
+            break;
+        case 'q':
+            query = 1;
+            ticket = strtoull(optarg, NULL, 10);
+            break;
+        case 'w':
+            wait_ms = strtoull(optarg, NULL, 10) * 1000;
+            break;
+        case 'b':
+            batch_source = optarg;
+            break;
+        case 'j':
+            conns = atoi(optarg);
+            if (conns < 1 || conns > BATCH_MAX_CONNS)
+            {
+                fprintf(stderr, "connections must be 1 to %d\n", BATCH_MAX_CONNS);
+                return 1;
+            }
+            break;
+        case 'o':
+            if (strcmp(optarg, "csv") == 0)
+                csv = 1;
+            else if (strcmp(optarg, "json") == 0)
+                csv = 0;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((query && batch_source) || argc - optind != (query || batch_source ? 2 : 3))
+    {
+        usage(argv[0]);
         return 1;
     }
-    const char *server_ip = argv[1];
-    int port = atoi(argv[2]);
-    const char *filename = argv[3];
+    const char *server_ip = argv[optind];
+    int port = atoi(argv[optind + 1]);
+    if (batch_source)
+        return run_batch(batch_source, server_ip, port, conns, csv, mode);
     int sockfd = connect_to_server(server_ip, port);
     if (sockfd < 0)
     {
         return 1;
     }
-    int ret = send_file(sockfd, filename);
+    int ret;
+    if (query)
+    {
+        ret = send_query(sockfd, ticket, wait_ms);
+        if (ret == 0)
+            ret = receive_judge_result(sockfd);
+    }
+    else if (mode == UPLOAD_PROFILE)
+    {
+        return profile_file(sockfd, argv[optind + 2], server_ip, port) < 0;
+    }
+    else
+    {
+        ret = send_file(sockfd, argv[optind + 2], mode);
+    }
     if (ret < 0)
     {
         return 1;
     }
     close_connection(sockfd);
     return 0;
-}
\ No newline at end of file
+}
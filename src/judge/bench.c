@@ -0,0 +1,41 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int bench_load(const char *problem_dir, bench_config *cfg)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", problem_dir, BENCH_FILE);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+    int n = fscanf(fp, "%d %d %lf", &cfg->runs, &cfg->warmup, &cfg->max_spread);
+    fclose(fp);
+    if (n != 3 || cfg->runs < 1 || cfg->runs > BENCH_MAX_RUNS || cfg->warmup < 0 || cfg->warmup > BENCH_MAX_RUNS ||
+        cfg->max_spread <= 0)
+    {
+        fprintf(stderr, "%s: expected \"<runs 1-%d> <warmup runs> <max spread %%>\"\n", path, BENCH_MAX_RUNS);
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief qsort comparator for run times
+ */
+static int compare_samples(const void *a, const void *b)
+{
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+void bench_summarize(long *samples_us, int n, bench_result *r)
+{
+    qsort(samples_us, n, sizeof(long), compare_samples);
+    double median = (n % 2) ? samples_us[n / 2] : (samples_us[n / 2 - 1] + samples_us[n / 2]) / 2.0;
+    r->min_ms = samples_us[0] / 1000.0;
+    r->median_ms = median / 1000.0;
+    // a run shorter than the clock tick can measure 0, report it as steady
+    r->spread = median > 0 ? (samples_us[n - 1] - samples_us[0]) * 100.0 / median : 0.0;
+}
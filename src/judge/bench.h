@@ -0,0 +1,45 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "../defineshit.h"
+
+#define BENCH_FILE "bench" // in the test case directory: "<runs> <warmup runs> <max spread %>"
+#define BENCH_MAX_RUNS 101
+
+/**
+ * @brief repeated-run timing of a problem
+ */
+typedef struct bench_config
+{
+    int runs;          // timed runs per test
+    int warmup;        // untimed runs per test before them
+    double max_spread; // spread in % above which a test is reported as noisy
+} bench_config;
+
+/**
+ * @brief timing of one test over the timed runs
+ */
+typedef struct bench_result
+{
+    double min_ms;    // fastest run
+    double median_ms; // median run
+    double spread;    // (slowest - fastest) / median in %
+} bench_result;
+
+/**
+ * @brief Read the repeated-run settings of a problem
+ * @param problem_dir test case directory
+ * @param cfg settings (output)
+ * @return 1 if the problem is timed over repeated runs, 0 if not, -1 if the file is invalid
+ */
+int bench_load(const char *problem_dir, bench_config *cfg);
+
+/**
+ * @brief Summarize the timed runs of a test
+ * @param samples_us CPU time of each run in microseconds, sorted in place
+ * @param n number of runs, at least 1
+ * @param r summary (output)
+ */
+void bench_summarize(long *samples_us, int n, bench_result *r);
+
+#endif // BENCH_H
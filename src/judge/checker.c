@@ -0,0 +1,317 @@
+#include "checker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/sendfile.h>
+
+/**
+ * @brief start the checker of the problem with its stdin and stdout on pipes
+ * @param path checker executable
+ * @param c checker (output)
+ * @return 0 on success, -1 on error
+ */
+static int start_checker(const char *path, checker *c)
+{
+    int request[2], reply[2];
+    // close-on-exec keeps the solutions from writing to the checker
+    if (pipe2(request, O_CLOEXEC) < 0)
+    {
+        perror("pipe failed");
+        return -1;
+    }
+    if (pipe2(reply, O_CLOEXEC) < 0)
+    {
+        perror("pipe failed");
+        close(request[0]);
+        close(request[1]);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        close(request[0]);
+        close(request[1]);
+        close(reply[0]);
+        close(reply[1]);
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        if (dup2(request[0], STDIN_FILENO) < 0 || dup2(reply[1], STDOUT_FILENO) < 0)
+        {
+            perror("dup2 failed");
+            _exit(1);
+        }
+        execl(path, CHECKER_FILE, (char *)NULL);
+        perror("execl checker failed");
+        _exit(1);
+    }
+    close(request[0]);
+    close(reply[1]);
+    c->pid = pid;
+    c->request_fd = request[1];
+    c->reply_fd = reply[0];
+    return 0;
+}
+
+int checker_open(const char *spec, const char *problem_dir, checker *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->pid = -1;
+    c->request_fd = -1;
+    c->reply_fd = -1;
+    c->next_tag = (unsigned long long)getpid() << 32;
+    // a checker that went away must fail the check, not kill the judge
+    signal(SIGPIPE, SIG_IGN);
+    if (spec)
+    {
+        if (sscanf(spec, "%d:%d", &c->request_fd, &c->reply_fd) != 2 || c->request_fd < 0 || c->reply_fd < 0)
+        {
+            fprintf(stderr, "invalid checker descriptors: %s\n", spec);
+            return -1;
+        }
+        // resident checkers belong to the server, solutions must not inherit them
+        fcntl(c->request_fd, F_SETFD, FD_CLOEXEC);
+        fcntl(c->reply_fd, F_SETFD, FD_CLOEXEC);
+    }
+    else
+    {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", problem_dir, CHECKER_FILE);
+        if (access(path, X_OK) < 0)
+            return 0;
+        if (start_checker(path, c) < 0)
+            return -1;
+    }
+    // a checker that stops reading must not block the judge past the deadline
+    fcntl(c->request_fd, F_SETFL, fcntl(c->request_fd, F_GETFL, 0) | O_NONBLOCK);
+    return 1;
+}
+
+/**
+ * @brief current time of the check deadlines
+ * @return CLOCK_MONOTONIC time in ms
+ */
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief wait until a checker pipe is ready
+ * @param fd request or reply pipe
+ * @param events POLLOUT or POLLIN
+ * @param deadline CLOCK_MONOTONIC ms of the check's deadline
+ * @return 0 once ready, -1 on timeout or error
+ */
+static int wait_ready(int fd, short events, long long deadline)
+{
+    struct pollfd pfd = {.fd = fd, .events = events};
+    for (;;)
+    {
+        long long left = deadline - now_ms();
+        if (left <= 0)
+        {
+            fprintf(stderr, "checker timed out\n");
+            return -1;
+        }
+        // a timeout goes around once more and ends at the deadline check
+        int n = poll(&pfd, 1, (int)left);
+        if (n > 0)
+            return 0;
+        if (n < 0 && errno != EINTR)
+        {
+            perror("poll checker failed");
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief write a whole file to the checker
+ * @param fd request pipe, non-blocking
+ * @param file open file
+ * @param size byte size of the file
+ * @param deadline CLOCK_MONOTONIC ms of the check's deadline
+ * @return 0 on success, -1 on error or timeout
+ */
+static int send_file(int fd, int file, off_t size, long long deadline)
+{
+    off_t off = 0;
+    while (off < size)
+    {
+        ssize_t n = sendfile(fd, file, &off, size - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+        {
+            if (wait_ready(fd, POLLOUT, deadline) < 0)
+                return -1;
+            continue;
+        }
+        if (n <= 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief write a request header to the checker
+ * @param fd request pipe, non-blocking
+ * @param buf header
+ * @param len byte size of the header
+ * @param deadline CLOCK_MONOTONIC ms of the check's deadline
+ * @return 0 on success, -1 on error or timeout
+ */
+static int send_header(int fd, const char *buf, size_t len, long long deadline)
+{
+    size_t off = 0;
+    while (off < len)
+    {
+        ssize_t n = write(fd, buf + off, len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+        {
+            if (wait_ready(fd, POLLOUT, deadline) < 0)
+                return -1;
+            continue;
+        }
+        if (n <= 0)
+            return -1;
+        off += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief read the next reply line
+ * @param c checker
+ * @param line reply line without the newline (output)
+ * @param size byte size of line
+ * @param deadline CLOCK_MONOTONIC ms of the check's deadline
+ * @return 0 on success, -1 on EOF, error or timeout
+ */
+static int read_line(checker *c, char *line, size_t size, long long deadline)
+{
+    for (;;)
+    {
+        char *nl = memchr(c->line, '\n', c->line_len);
+        if (nl)
+        {
+            size_t len = nl - c->line;
+            size_t copy = len < size - 1 ? len : size - 1;
+            memcpy(line, c->line, copy);
+            line[copy] = '\0';
+            c->line_len -= len + 1;
+            memmove(c->line, nl + 1, c->line_len);
+            return 0;
+        }
+        // an overlong line is cut, only its start carries the tag and the verdict
+        if (c->line_len == sizeof(c->line))
+            c->line_len = 0;
+        if (wait_ready(c->reply_fd, POLLIN, deadline) < 0)
+            return -1;
+        ssize_t n = read(c->reply_fd, c->line + c->line_len, sizeof(c->line) - c->line_len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        c->line_len += n;
+    }
+}
+
+int checker_check(checker *c, const char *in_path, const char *expected_path, const char *output_path)
+{
+    const char *paths[3] = {in_path, expected_path, output_path};
+    int files[3] = {-1, -1, -1};
+    off_t sizes[3];
+    int result = -1;
+    for (int i = 0; i < 3; i++)
+    {
+        struct stat st;
+        files[i] = open(paths[i], O_RDONLY | O_CLOEXEC);
+        if (files[i] < 0 || fstat(files[i], &st) < 0)
+        {
+            perror("open test file failed");
+            goto out;
+        }
+        sizes[i] = st.st_size;
+    }
+
+    unsigned long long tag = c->next_tag++;
+    long long deadline = now_ms() + CHECKER_TIMEOUT_MS;
+    char header[96];
+    int len = snprintf(header, sizeof(header), "%llu %lld %lld %lld\n", tag, (long long)sizes[0],
+                       (long long)sizes[1], (long long)sizes[2]);
+    if (send_header(c->request_fd, header, len, deadline) < 0)
+    {
+        perror("write checker request failed");
+        goto out;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        if (send_file(c->request_fd, files[i], sizes[i], deadline) < 0)
+        {
+            perror("write checker request failed");
+            goto out;
+        }
+    }
+
+    char line[CHECKER_LINE_SIZE];
+    while (read_line(c, line, sizeof(line), deadline) == 0)
+    {
+        char *verdict;
+        if (strtoull(line, &verdict, 10) != tag)
+            continue;
+        while (*verdict == ' ')
+            verdict++;
+        if (strncmp(verdict, "AC", 2) == 0)
+            result = 2;
+        else if (strncmp(verdict, "WA", 2) == 0)
+            result = 1;
+        else
+            fprintf(stderr, "checker replied: %s\n", line);
+        goto out;
+    }
+    fprintf(stderr, "checker closed its output or did not reply\n");
+out:
+    for (int i = 0; i < 3; i++)
+    {
+        if (files[i] >= 0)
+            close(files[i]);
+    }
+    if (result < 0)
+        c->failed = 1;
+    return result;
+}
+
+void checker_close(checker *c)
+{
+    if (c->request_fd >= 0)
+        close(c->request_fd);
+    if (c->reply_fd >= 0)
+        close(c->reply_fd);
+    // EOF on its stdin ends a checker started here, unless it is stuck
+    if (c->pid > 0)
+    {
+        if (c->failed)
+            kill(c->pid, SIGKILL);
+        while (waitpid(c->pid, NULL, 0) < 0 && errno == EINTR)
+            ;
+    }
+    c->request_fd = -1;
+    c->reply_fd = -1;
+    c->pid = -1;
+}
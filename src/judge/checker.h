@@ -0,0 +1,65 @@
+#ifndef CHECKER_H
+#define CHECKER_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Checker protocol. A checker reads requests on stdin and answers each one on stdout,
+ * one request at a time, until stdin reaches EOF:
+ *
+ *   request: "<tag> <input bytes> <expected bytes> <output bytes>\n", then the test
+ *            input, the expected output and the solution output, back to back
+ *   reply:   "<tag> AC\n" or "<tag> WA\n", anything after the verdict is ignored
+ *
+ * The tag is echoed back unchanged, a reply with another tag is left over from a
+ * judge that died mid-check and is skipped. A checker that does not reply within
+ * CHECKER_TIMEOUT_MS fails the check.
+ */
+
+#define CHECKER_FILE "checker" // executable in the test case directory, exact line matching without it
+#define CHECKER_LINE_SIZE 256  // reply line buffer
+#define CHECKER_TIMEOUT_MS 10000 // time a checker gets to take a request and reply, or the check fails
+
+/**
+ * @brief connection to a checker process
+ */
+typedef struct checker
+{
+    pid_t pid;                    // checker started by this judge, -1 for a resident one
+    int request_fd;               // checker's stdin
+    int reply_fd;                 // checker's stdout
+    unsigned long long next_tag;  // tag of the next request
+    char line[CHECKER_LINE_SIZE]; // reply bytes read ahead
+    size_t line_len;              // byte size of the reply bytes read ahead
+    int failed;                   // 1 once a check failed, the checker may be stuck
+} checker;
+
+/**
+ * @brief Connect to the checker of the problem
+ * @param spec "<request fd>:<reply fd>" of a resident checker passed by the server,
+ *      NULL to start the problem's checker for this run
+ * @param problem_dir test case directory
+ * @param c checker (output)
+ * @return 1 if a checker is used, 0 if the problem has none, -1 on error
+ */
+int checker_open(const char *spec, const char *problem_dir, checker *c);
+
+/**
+ * @brief Check the output of one test
+ * @param c checker
+ * @param in_path test input
+ * @param expected_path expected output
+ * @param output_path solution output
+ * @return 2 if accepted, 1 if wrong, -1 if the checker failed or timed out
+ */
+int checker_check(checker *c, const char *in_path, const char *expected_path, const char *output_path);
+
+/**
+ * @brief Disconnect, stopping the checker if this judge started it
+ * @param c checker
+ */
+void checker_close(checker *c);
+
+#endif // CHECKER_H
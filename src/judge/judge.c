@@ -5,109 +5,195 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
+#include <poll.h>
 #include "../defineshit.h"
+#include "sanitize.h"
+#include "test_stats.h"
+#include "pch.h"
+#include "checker.h"
+#include "bench.h"
+#include "judge_record.h"
+#include "profile.h"
 
-#define TEMP_OUTPUT "temp/temp_output"
-#define COMPILE_ERROR_FILE "temp/compile_error.txt"
-#define IO_DIR "io"
+#define TEMP_OUTPUT_SUFFIX "_output"
+#define DEFAULT_PROBLEM_DIR "io"
+#define BUFFER_SIZE 1024
+#define COMPILE_ERROR_LIMIT 4096
 
 /**
- * @brief Replace all occurrences of substring 'old' in 'str' with 'new_str'.
- *      The result is heap-allocated and should be freed by the caller.
- * @param str input string.
- * @param old substring to replace.
- * @param new_str new substring.
- * @return heap-allocated string with all occurrences of 'old' replaced by 'new_str'.
+ * @brief Compile the submission. Compiler diagnostics are read from a pipe
+ *      and masked on the fly, they are never written to disk.
+ * @param tc toolchain of the submission language.
+ * @param source_path path to the source file.
+ * @param executable_path path to the compiled executable.
+ * @param pch_dir include directory holding the precompiled header, NULL for none.
+ * @param diag sanitizer receiving the compiler diagnostics.
+ * @return 0 on success, non-zero on compile error.
  */
-char *replace_substring(const char *str, const char *old, const char *new_str)
+int compile_submission(const toolchain *tc, const char *source_path, const char *executable_path, const char *pch_dir,
+                       sanitizer *diag)
 {
-    if (!str || !old || !*old)
-        return strdup(str);
-
-    size_t old_len = strlen(old);
-    size_t new_len = strlen(new_str);
-    size_t count = 0;
-    const char *p = str;
-    while ((p = strstr(p, old)) != NULL)
+    const char *argv[2 * TOOLCHAIN_MAX_FLAGS + 8];
+    int argc = 0;
+    argv[argc++] = tc->compiler;
+    for (int i = 0; tc->flags[i]; i++)
+        argv[argc++] = tc->flags[i];
+    if (pch_dir)
     {
-        count++;
-        p += old_len;
+        argv[argc++] = "-I";
+        argv[argc++] = pch_dir;
     }
-    size_t new_size = strlen(str) + count * (new_len - old_len) + 1;
-    char *result = malloc(new_size);
-    if (!result)
-        return NULL;
+    // the language comes from the toolchain, not from the path (/dev/fd/N has no extension)
+    argv[argc++] = "-x";
+    argv[argc++] = tc->language;
+    argv[argc++] = source_path;
+    argv[argc++] = "-o";
+    argv[argc++] = executable_path;
+    // libraries go after the source, the linker resolves left to right
+    for (int i = 0; tc->libs[i]; i++)
+        argv[argc++] = tc->libs[i];
+    argv[argc] = NULL;
 
-    char *r = result;
-    while (*str)
+    int pipe_fd[2];
+    if (pipe(pipe_fd) < 0)
+    {
+        perror("pipe failed");
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        return -1;
+    }
+    else if (pid == 0)
     {
-        const char *pos = strstr(str, old);
-        if (pos)
+        close(pipe_fd[0]);
+        if (dup2(pipe_fd[1], STDOUT_FILENO) == -1 || dup2(pipe_fd[1], STDERR_FILENO) == -1)
         {
-            size_t len = pos - str;
-            memcpy(r, str, len);
-            r += len;
-            memcpy(r, new_str, new_len);
-            r += new_len;
-            str = pos + old_len;
+            perror("dup2 failed");
+            exit(1);
         }
-        else
+        close(pipe_fd[1]);
+        execvp(tc->compiler, (char *const *)argv);
+        perror("execvp failed");
+        exit(1);
+    }
+    close(pipe_fd[1]);
+
+    // keep draining after the limit so that gcc never blocks on a full pipe
+    char buf[BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(pipe_fd[0], buf, sizeof(buf))) != 0)
+    {
+        if (n < 0)
         {
-            strcpy(r, str);
+            if (errno == EINTR)
+                continue;
+            perror("read compile error failed");
             break;
         }
+        sanitizer_feed(diag, buf, n);
     }
-    return result;
+    close(pipe_fd[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            perror("waitpid failed");
+            return -1;
+        }
+    }
+    if (!WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
 }
 
 /**
- * @brief Sanitize an error message by masking file paths and file names.
- * @param msg error message to sanitize.
- * @return sanitized error message (heap-allocated), or NULL on error.
+ * @brief Redirect the solution's standard streams and exec it, in the forked child.
+ *
+ * @param in_path path to the input file.
+ * @param executable_path path to the compiled executable.
+ * @param output_path path the solution output (and stderr) is captured to.
  */
-char *sanitize_error_message(const char *msg)
+void exec_solution(const char *in_path, const char *executable_path, const char *output_path)
 {
-    if (!msg)
-        return NULL;
-
-    const char *patterns[] = {
-        "build/src/",     // program build path
-        "files/receive/", // received file path
-        "temp/",          // temporary file path
-        NULL
-    };
-
-    char *sanitized = strdup(msg);
-    if (!sanitized)
-        return NULL;
+    FILE *fin = fopen(in_path, "r");
+    if (!fin)
+    {
+        perror("fopen failed");
+        exit(1);
+    }
+    int fd_in = fileno(fin);
+    if (dup2(fd_in, STDIN_FILENO) == -1)
+    {
+        perror("dup2(stdin) failed");
+        exit(1);
+    }
+    fclose(fin);
 
-    for (int i = 0; patterns[i] != NULL; i++)
+    FILE *fout = fopen(output_path, "w");
+    if (!fout)
     {
-        char *temp = replace_substring(sanitized, patterns[i], "");
-        free(sanitized);
-        if (!temp)
-            return NULL;
-        sanitized = temp;
+        perror("fopen failed");
+        exit(1);
     }
-    return sanitized;
+    int fd_out = fileno(fout);
+    if (dup2(fd_out, STDOUT_FILENO) == -1)
+    {
+        perror("dup2(stdout) failed");
+        exit(1);
+    }
+    if (dup2(fd_out, STDERR_FILENO) == -1)
+    {
+        perror("dup2(stderr) failed");
+        exit(1);
+    }
+    fclose(fout);
+    // ignored by the judge while it talks to the checker
+    signal(SIGPIPE, SIG_DFL);
+
+    execl(executable_path, "solution", (char *)NULL);
+    perror("execl failed");
+    exit(1);
 }
 
 /**
- * @brief Compile the submission.
- * @param source_path path to the source file.
+ * @brief Run the compiled submission once and wait for it.
+ *
+ * @param in_path path to the input file.
  * @param executable_path path to the compiled executable.
- * @return 0 on success, non-zero on compile error.
+ * @param output_path path the solution output (and stderr) is captured to.
+ * @param usage resources used by the solution (output).
+ * @return wait status of the solution, -1 on error.
  */
-int compile_submission(const char *source_path, const char *executable_path)
+int spawn_solution(const char *in_path, const char *executable_path, const char *output_path, struct rusage *usage)
 {
-    char command[512];
-    // stderr to COMPILE_ERROR_FILE
-    snprintf(command, sizeof(command), "gcc %s -o %s 2>%s", source_path, executable_path, COMPILE_ERROR_FILE);
-    // printf("compile command: %s\n", command);
-    int ret = system(command);
-    return ret;
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        exec_solution(in_path, executable_path, output_path);
+    }
+    int status;
+    if (wait4(pid, &status, 0, usage) == -1)
+    {
+        perror("wait4 failed");
+        return -1;
+    }
+    return status;
 }
 
 /**
@@ -118,114 +204,423 @@ int compile_submission(const char *source_path, const char *executable_path)
  * @param exec_time execution time in ms (output).
  * @param max_rss used memory (output).
  * @param executable_path path to the compiled executable.
+ * @param output_path path the solution output is captured to.
+ * @param chk checker of the problem, NULL for exact line matching.
  * @return 2 if test passed (Accepted),
  *         1 if output does not match (Wrong Answer),
- *        -1 if runtime error occurred.
+ *        -1 if runtime error occurred,
+ *        -2 if the checker failed.
  */
-int run_test(const char *in_path, const char *expected_out, int *exec_time, long *max_rss, const char *executable_path)
+int run_test(const char *in_path, const char *expected_out, int *exec_time, long *max_rss, const char *executable_path,
+             const char *output_path, checker *chk)
 {
-    pid_t pid = fork();
-    if (pid < 0)
+    struct rusage usage;
+    int status = spawn_solution(in_path, executable_path, output_path, &usage);
+    if (status == -1)
+        return -1;
+    *max_rss = usage.ru_maxrss;
+    int utime_ms = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
+    int stime_ms = usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
+    *exec_time = utime_ms + stime_ms;
+
+    // check runtime error
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
     {
-        perror("fork failed");
+        fprintf(stderr, "Child process terminated abnormally: status = %d\n", status);
         return -1;
     }
-    else if (pid == 0)
+
+    if (chk)
     {
-        FILE *fin = fopen(in_path, "r");
-        if (!fin)
-        {
-            perror("fopen failed");
-            exit(1);
-        }
-        int fd_in = fileno(fin);
-        if (dup2(fd_in, STDIN_FILENO) == -1)
+        int verdict = checker_check(chk, in_path, expected_out, output_path);
+        return (verdict < 0 ? -2 : verdict);
+    }
+    FILE *f1 = fopen(expected_out, "r");
+    FILE *f2 = fopen(output_path, "r");
+    if (!f1 || !f2)
+    {
+        perror("fopen failed");
+        return -1;
+    }
+    int result = 1; // 1: output matches, 0: does not match.
+    char buf1[1024], buf2[1024];
+    while (fgets(buf1, sizeof(buf1), f1) && fgets(buf2, sizeof(buf2), f2))
+    {
+        if (strcmp(buf1, buf2) != 0)
         {
-            perror("dup2(stdin) failed");
-            exit(1);
+            result = 0;
+            break;
         }
-        fclose(fin);
+    }
+    if (fgets(buf1, sizeof(buf1), f1) || fgets(buf2, sizeof(buf2), f2))
+    {
+        result = 0;
+    }
+    fclose(f1);
+    fclose(f2);
+    return (result ? 2 : 1);
+}
 
-        FILE *fout = fopen(TEMP_OUTPUT, "w");
-        if (!fout)
-        {
-            perror("fopen failed");
-            exit(1);
-        }
-        int fd_out = fileno(fout);
-        if (dup2(fd_out, STDOUT_FILENO) == -1)
+/**
+ * @brief Compile the submission and print the masked compile error on failure.
+ * @param tc toolchain of the submission language.
+ * @param source_path path to the source file.
+ * @param executable_path path to the compiled executable.
+ * @param source_name file name of the submission, shown as the toolchain's solution name.
+ * @param error_limit compile error limit in bytes.
+ * @param rec result record, the compile error is set on failure.
+ * @return 0 on success, non-zero on compile error.
+ */
+int compile_stage(const toolchain *tc, const char *source_path, const char *executable_path, const char *source_name,
+                  size_t error_limit, judge_record *rec)
+{
+    // the received file name carries the client address, never show it
+    const char *patterns[8];
+    const char *replacements[8];
+    int n = 0;
+    for (; sanitize_default_patterns[n] != NULL; n++)
+    {
+        patterns[n] = sanitize_default_patterns[n];
+        replacements[n] = NULL;
+    }
+    if (strlen(source_name) <= SANITIZE_MAX_PATTERN_LEN)
+    {
+        patterns[n] = source_name;
+        replacements[n++] = tc->solution_name;
+    }
+    if (strcmp(source_path, source_name) != 0 && strlen(source_path) <= SANITIZE_MAX_PATTERN_LEN)
+    {
+        patterns[n] = source_path;
+        replacements[n++] = tc->solution_name;
+    }
+    patterns[n] = NULL;
+
+    sanitizer diag;
+    if (sanitizer_init(&diag, patterns, replacements, error_limit) < 0)
+    {
+        record_verdict(rec, VERDICT_COMPILE_ERROR, "Could not capture error message", 1);
+        return 1;
+    }
+    char pch_dir[256];
+    int has_pch = (pch_prepare(tc, pch_dir, sizeof(pch_dir)) == 0);
+    int compile_ret = compile_submission(tc, source_path, executable_path, has_pch ? pch_dir : NULL, &diag);
+    char *masked_msg = sanitizer_finish(&diag);
+    sanitizer_free(&diag);
+    if (compile_ret != 0)
+    {
+        if (masked_msg)
         {
-            perror("dup2(stdout) failed");
-            exit(1);
+            record_verdict(rec, VERDICT_COMPILE_ERROR, masked_msg, 0);
+            free(masked_msg);
         }
-        if (dup2(fd_out, STDERR_FILENO) == -1)
+        else
         {
-            perror("dup2(stderr) failed");
-            exit(1);
+            record_verdict(rec, VERDICT_COMPILE_ERROR, "Could not sanitize error message", 1);
         }
-        fclose(fout);
+        return 1;
+    }
+    free(masked_msg);
+    return 0;
+}
 
-        execl(executable_path, "solution", (char *)NULL);
-        perror("execl failed");
-        exit(1);
+/**
+ * @brief Copy stdin into an anonymous in-memory file. gcc reads it through
+ *      /dev/fd/N like a regular file, so diagnostics still quote source lines.
+ * @param path path of the copy (output).
+ * @param size byte size of path.
+ * @return 0 on success, -1 on error.
+ */
+int stdin_to_memfd(char *path, size_t size)
+{
+    // inherited by gcc and cc1 on purpose, no MFD_CLOEXEC
+    int fd = memfd_create("source", 0);
+    if (fd < 0)
+    {
+        perror("memfd_create failed");
+        return -1;
     }
-    else
+    char buf[BUFFER_SIZE];
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, buf, sizeof(buf))) != 0)
     {
-        struct rusage usage;
-        int status;
-        if (wait4(pid, &status, 0, &usage) == -1)
+        if (n < 0)
         {
-            perror("wait4 failed");
+            if (errno == EINTR)
+                continue;
+            perror("read source failed");
+            close(fd);
             return -1;
         }
-
-        // check runtime error
-        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        if (write(fd, buf, n) != n)
         {
-            fprintf(stderr, "Child process terminated abnormally: status = %d\n", status);
+            perror("write source failed");
+            close(fd);
             return -1;
         }
+    }
+    snprintf(path, size, "/dev/fd/%d", fd);
+    return 0;
+}
 
-        *max_rss = usage.ru_maxrss;
-        int utime_ms = usage.ru_utime.tv_sec * 1000 + usage.ru_utime.tv_usec / 1000;
-        int stime_ms = usage.ru_stime.tv_sec * 1000 + usage.ru_stime.tv_usec / 1000;
-        *exec_time = utime_ms + stime_ms;
-
-        FILE *f1 = fopen(expected_out, "r");
-        FILE *f2 = fopen(TEMP_OUTPUT, "r");
-        if (!f1 || !f2)
+/**
+ * @brief List the input files of the test cases.
+ * @param problem_dir test case directory.
+ * @param names heap-allocated input file names (output), freed by the caller.
+ * @return number of test cases, or -1 on error.
+ */
+int list_tests(const char *problem_dir, char ***names)
+{
+    DIR *dir = opendir(problem_dir);
+    if (!dir)
+    {
+        perror("opendir failed");
+        return -1;
+    }
+    int count = 0, cap = 16;
+    char **list = malloc(cap * sizeof(char *));
+    struct dirent *entry;
+    while (list && (entry = readdir(dir)) != NULL)
+    {
+        char *ext = strrchr(entry->d_name, '.');
+        if (entry->d_type != DT_REG || !ext || strcmp(ext, ".in") != 0 || strlen(entry->d_name) >= TEST_NAME_SIZE)
+            continue;
+        if (count == cap)
         {
-            perror("fopen failed");
-            return -1;
+            cap *= 2;
+            char **grown = realloc(list, cap * sizeof(char *));
+            if (!grown)
+                break;
+            list = grown;
         }
-        int result = 1; // 1: output matches, 0: does not match.
-        char buf1[1024], buf2[1024];
-        while (fgets(buf1, sizeof(buf1), f1) && fgets(buf2, sizeof(buf2), f2))
+        list[count++] = strdup(entry->d_name);
+    }
+    closedir(dir);
+    if (!list)
+        return -1;
+    *names = list;
+    return count;
+}
+
+/**
+ * @brief Time the accepted submission over repeated runs of every test.
+ * @param cfg repeated-run settings of the problem.
+ * @param problem_dir test case directory.
+ * @param tests input file names.
+ * @param test_count number of tests.
+ * @param executable_path path to the compiled executable.
+ * @param output_path path the solution output is captured to.
+ * @param rec result record, receives the timing summary.
+ */
+void bench_tests(const bench_config *cfg, const char *problem_dir, char **tests, int test_count,
+                 const char *executable_path, const char *output_path, judge_record *rec)
+{
+    long samples_us[BENCH_MAX_RUNS];
+    double total_min = 0, total_median = 0, max_spread = 0;
+    int noisy = 0;
+    for (int i = 0; i < test_count; i++)
+    {
+        char in_path[512];
+        snprintf(in_path, sizeof(in_path), "%s/%s", problem_dir, tests[i]);
+        // warm-up runs fill the page cache and the CPU caches, only the runs after them count
+        for (int run = -cfg->warmup; run < cfg->runs; run++)
         {
-            if (strcmp(buf1, buf2) != 0)
+            struct rusage usage;
+            int status = spawn_solution(in_path, executable_path, output_path, &usage);
+            if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
             {
-                result = 0;
-                break;
+                rec->bench = BENCH_FAILED;
+                return;
             }
+            if (run >= 0)
+                samples_us[run] = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000L + usage.ru_utime.tv_usec +
+                                  usage.ru_stime.tv_usec;
         }
-        if (fgets(buf1, sizeof(buf1), f1) || fgets(buf2, sizeof(buf2), f2))
-        {
-            result = 0;
-        }
-        fclose(f1);
-        fclose(f2);
-        return (result ? 2 : 1);
+        bench_result r;
+        bench_summarize(samples_us, cfg->runs, &r);
+        total_min += r.min_ms;
+        total_median += r.median_ms;
+        if (r.spread > max_spread)
+            max_spread = r.spread;
+        if (r.spread > cfg->max_spread)
+            noisy++;
     }
+    rec->bench = BENCH_DONE;
+    rec->bench_runs = cfg->runs;
+    rec->bench_warmup = cfg->warmup;
+    rec->bench_noisy = noisy;
+    rec->bench_tests = test_count;
+    rec->bench_min_ms = total_min;
+    rec->bench_median_ms = total_median;
+    rec->bench_spread = max_spread;
+    rec->bench_max_spread = cfg->max_spread;
+}
+
+/**
+ * @brief Run the accepted executable once more on one test under the profiler.
+ *      The timed runs are never profiled, the counters only see this run.
+ * @param problem_dir test case directory.
+ * @param test input file name of the test.
+ * @param executable_path path to the compiled executable.
+ * @param output_path path the solution output is captured to.
+ * @param rec result record, receives the profile.
+ */
+void profile_test(const char *problem_dir, const char *test, const char *executable_path, const char *output_path,
+                  judge_record *rec)
+{
+    char in_path[512];
+    snprintf(in_path, sizeof(in_path), "%s/%s", problem_dir, test);
+    strncpy(rec->profile_test, test, sizeof(rec->profile_test) - 1);
+    rec->profile = PROFILE_FAILED;
+    // the child waits at the gate until the events are open on it, they start counting at its exec
+    int gate[2];
+    if (pipe(gate) < 0)
+    {
+        perror("pipe failed");
+        return;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        close(gate[0]);
+        close(gate[1]);
+        return;
+    }
+    else if (pid == 0)
+    {
+        close(gate[1]);
+        char go;
+        if (read(gate[0], &go, 1) != 1)
+            exit(1);
+        close(gate[0]);
+        exec_solution(in_path, executable_path, output_path);
+    }
+    close(gate[0]);
+    profile_session *s = profile_open(pid);
+    if (s)
+        write(gate[1], "", 1);
+    close(gate[1]);
+    int status;
+    pid_t done;
+    struct pollfd pfd = {.fd = s ? profile_fd(s) : -1, .events = POLLIN};
+    while ((done = waitpid(pid, &status, s ? WNOHANG : 0)) == 0)
+    {
+        // woken when the ring buffer is half full
+        poll(&pfd, 1, 10);
+        profile_drain(s);
+    }
+    if (!s)
+    {
+        rec->profile = PROFILE_UNAVAILABLE;
+        return;
+    }
+    profile_drain(s);
+    if (done < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        profile_abort(s);
+        return;
+    }
+    profile_close(s, rec);
+}
+
+/**
+ * @brief Hand the result to the server through its slot, or print it when run by hand.
+ * @param rec complete result record.
+ * @param slot slot lent by the server, NULL to print.
+ * @param event_fd eventfd of the server.
+ * @param status exit status of the judge.
+ * @return status.
+ */
+int report(const judge_record *rec, judge_record *slot, int event_fd, int status)
+{
+    if (slot)
+    {
+        record_publish(rec, slot, event_fd);
+        return status;
+    }
+    char text[RECORD_LOG_SIZE + 2048];
+    record_format(rec, text, sizeof(text));
+    fputs(text, stdout);
+    return status;
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    size_t error_limit = COMPILE_ERROR_LIMIT;
+    int from_stdin = 0;
+    int compile_only = 0;
+    int run_only = 0;
+    int bench_only = 0;
+    int keep_for_bench = 0;
+    int fail_fast = 0;
+    const char *problem_dir = DEFAULT_PROBLEM_DIR;
+    const char *checker_fds = NULL;
+    const char *result_slot = NULL;
+    const char *profiled = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "crbKifl:p:k:o:P:")) != -1)
     {
-        fprintf(stderr, "Usage: %s <source_file_path>\n", argv[0]);
+        switch (opt)
+        {
+        case 'f':
+            // ICPC style: stop at the first test that is not Accepted
+            fail_fast = 1;
+            break;
+        case 'c':
+            // compile stage: leave the executable in temp/, print nothing on success
+            compile_only = 1;
+            break;
+        case 'r':
+            // run stage: the executable was left in temp/ by the compile stage
+            run_only = 1;
+            break;
+        case 'b':
+            // bench stage: time the executable a run stage accepted and left in temp/
+            bench_only = 1;
+            break;
+        case 'K':
+            // leave an accepted executable in temp/ for the bench stage
+            keep_for_bench = 1;
+            break;
+        case 'i':
+            // source arrives on stdin (from the server), the path only names the submission
+            from_stdin = 1;
+            break;
+        case 'l':
+            error_limit = strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            problem_dir = optarg;
+            break;
+        case 'k':
+            // resident checker of the server, as "<request fd>:<reply fd>"
+            checker_fds = optarg;
+            break;
+        case 'o':
+            // result slot of the server, as "<memfd>:<eventfd>:<slot>"
+            result_slot = optarg;
+            break;
+        case 'P':
+            // profile one run of an accepted executable on this test input
+            profiled = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-c | -r [-K] | -b] [-i] [-f] [-l error_limit] [-p test_dir] [-P test_input] [-k request_fd:reply_fd] [-o memfd:eventfd:slot] <source_file_path>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || compile_only + run_only + bench_only > 1 || (profiled && strchr(profiled, '/')))
+    {
+        fprintf(stderr, "Usage: %s [-c | -r [-K] | -b] [-i] [-f] [-l error_limit] [-p test_dir] [-P test_input] [-k request_fd:reply_fd] [-o memfd:eventfd:slot] <source_file_path>\n", argv[0]);
         return 1;
     }
-    const char *source_path = argv[1];
+    const char *source_path = argv[optind];
+    static judge_record rec;
+    record_init(&rec);
+    judge_record *slot = NULL;
+    int event_fd = -1;
+    if (result_slot && record_attach(result_slot, &slot, &event_fd) < 0)
+        return 1;
 
     // extract base name from source file path
     const char *base = strrchr(source_path, '/');
@@ -245,125 +640,185 @@ int main(int argc, char *argv[])
     char executable_path[256];
     snprintf(executable_path, sizeof(executable_path), "temp/%s", base_name);
 
-    // compile the submission
-    if (compile_submission(source_path, executable_path) != 0)
+    char output_path[300];
+    snprintf(output_path, sizeof(output_path), "%s%s", executable_path, TEMP_OUTPUT_SUFFIX);
+
+    const toolchain *tc = toolchain_by_path(source_path);
+    if (!tc)
+        tc = toolchain_default();
+    char stdin_path[32];
+    int staged = run_only || bench_only;
+    if (!staged && from_stdin && stdin_to_memfd(stdin_path, sizeof(stdin_path)) < 0)
     {
-        FILE *err_fp = fopen(COMPILE_ERROR_FILE, "r");
-        if (err_fp)
-        {
-            char err_msg[4096] = {0};
-            size_t n = fread(err_msg, 1, sizeof(err_msg) - 1, err_fp);
-            fclose(err_fp);
-            char *masked_msg = sanitize_error_message(err_msg);
-            if (masked_msg)
-            {
-                printf("Compile Error:\n%s\n", masked_msg);
-                free(masked_msg);
-            }
-            else
-            {
-                printf("Compile Error: (Could not sanitize error message)\n");
-            }
-        }
-        else
-        {
-            printf("Compile Error: (Could not capture error message)\n");
-        }
-        return 1;
+        record_verdict(&rec, VERDICT_INTERNAL_ERROR, "Could not read source", 1);
+        return report(&rec, slot, event_fd, 1);
+    }
+    if (!staged && compile_stage(tc, from_stdin ? stdin_path : source_path, executable_path, base, error_limit, &rec) != 0)
+        return report(&rec, slot, event_fd, 1);
+    if (compile_only)
+    {
+        record_verdict(&rec, VERDICT_COMPILED, NULL, 0);
+        return report(&rec, slot, event_fd, 0);
     }
 
-    DIR *dir = opendir(IO_DIR);
-    if (!dir)
+    char **tests;
+    int test_count = list_tests(problem_dir, &tests);
+    if (test_count < 0)
     {
-        perror("opendir failed");
         remove(executable_path);
-        return 1;
+        record_verdict(&rec, VERDICT_INTERNAL_ERROR, "Could not open test cases", 1);
+        return report(&rec, slot, event_fd, 1);
+    }
+    bench_config bench;
+    int has_bench = bench_load(problem_dir, &bench);
+    if (bench_only)
+    {
+        // the server also sends accepted executables here only to profile them
+        if (has_bench > 0)
+            bench_tests(&bench, problem_dir, tests, test_count, executable_path, output_path, &rec);
+        else if (has_bench < 0 || !profiled)
+            rec.bench = BENCH_NO_CONFIG;
+        if (profiled)
+            profile_test(problem_dir, profiled, executable_path, output_path, &rec);
+        for (int i = 0; i < test_count; i++)
+            free(tests[i]);
+        free(tests);
+        remove(executable_path);
+        remove(output_path);
+        return report(&rec, slot, event_fd, 0);
     }
 
-    struct dirent *entry;
+    // tests that failed most often per ms of running time come first
+    test_stats stats;
+    if (test_stats_load(problem_dir, &stats) < 0)
+        perror("load test stats failed");
+    test_stats_order(tests, test_count, &stats);
+    test_stats_free(&stats);
+    test_stat *history = calloc(test_count ? test_count : 1, sizeof(test_stat));
+    int executed = 0;
+
+    // started once, every test of the run is checked by the same process
+    checker chk;
+    int has_checker = checker_open(checker_fds, problem_dir, &chk);
+
     int max_total_time = 0;
     long max_total_rss = 0;
-    int overall = 2; // 2: Accepted, 1: Wrong Answer, -1: Runtime Error
+    int overall = has_checker < 0 ? -2 : 2; // 2: Accepted, 1: Wrong Answer, -1: Runtime Error, -2: checker failed
     char runtime_error_msg[4096] = {0};
 
-    while ((entry = readdir(dir)) != NULL)
+    for (int i = 0; i < test_count && overall != -2; i++)
     {
-        if (entry->d_type == DT_REG)
+        char in_path[512];
+        snprintf(in_path, sizeof(in_path), "%s/%s", problem_dir, tests[i]);
+
+        char expected_output[256];
+        strncpy(expected_output, tests[i], sizeof(expected_output));
+        expected_output[sizeof(expected_output) - 1] = '\0';
+        char *dot = strrchr(expected_output, '.');
+        if (dot)
+        {
+            strcpy(dot, ".out");
+        }
+        char expected_path[512];
+        snprintf(expected_path, sizeof(expected_path), "%s/%s", problem_dir, expected_output);
+
+        int exec_time = 0;
+        long mem_usage = 0;
+        int test_result = run_test(in_path, expected_path, &exec_time, &mem_usage, executable_path, output_path,
+                                   has_checker > 0 ? &chk : NULL);
+        if (rec.test_count < RECORD_MAX_TESTS)
+        {
+            test_record *t = &rec.tests[rec.test_count];
+            strncpy(t->name, tests[i], sizeof(t->name) - 1);
+            t->result = test_result;
+            t->time_ms = exec_time;
+            t->memory_kb = mem_usage;
+        }
+        rec.test_count++;
+        if (test_result == -2)
+        {
+            overall = -2;
+            break;
+        }
+        if (history)
         {
-            char *ext = strrchr(entry->d_name, '.');
-            if (ext && strcmp(ext, ".in") == 0)
+            test_stat *run = &history[executed++];
+            strncpy(run->name, tests[i], sizeof(run->name) - 1);
+            run->runs = 1;
+            run->fails = (test_result != 2);
+            run->total_ms = exec_time;
+        }
+        if (test_result == -1)
+        {
+            overall = -1;
+            FILE *rt_fp = fopen(output_path, "r");
+            if (rt_fp)
             {
-                char in_path[256];
-                snprintf(in_path, sizeof(in_path), "%s/%s", IO_DIR, entry->d_name);
-
-                char expected_output[256];
-                strncpy(expected_output, entry->d_name, sizeof(expected_output));
-                expected_output[sizeof(expected_output) - 1] = '\0';
-                char *dot = strrchr(expected_output, '.');
-                if (dot)
-                {
-                    strcpy(dot, ".out");
-                }
-                char expected_path[256];
-                snprintf(expected_path, sizeof(expected_path), "%s/%s", IO_DIR, expected_output);
-
-                int exec_time = 0;
-                long mem_usage = 0;
-                int test_result = run_test(in_path, expected_path, &exec_time, &mem_usage, executable_path);
-                if (test_result == -1)
-                {
-                    overall = -1;
-                    FILE *rt_fp = fopen(TEMP_OUTPUT, "r");
-                    if (rt_fp)
-                    {
-                        fread(runtime_error_msg, 1, sizeof(runtime_error_msg) - 1, rt_fp);
-                        fclose(rt_fp);
-                    }
-                    break;
-                }
-                else if (test_result == 1)
-                {
-                    overall = (overall != -1 ? 1 : overall);
-                }
-                else  // test_result == 2 (Accepted)
-                {
-                    if (exec_time > max_total_time)
-                        max_total_time = exec_time;
-                    if (mem_usage > max_total_rss)
-                        max_total_rss = mem_usage;
-                }
+                fread(runtime_error_msg, 1, sizeof(runtime_error_msg) - 1, rt_fp);
+                fclose(rt_fp);
             }
+            break;
+        }
+        else if (test_result == 1)
+        {
+            overall = (overall != -1 ? 1 : overall);
+            if (fail_fast)
+                break;
+        }
+        else  // test_result == 2 (Accepted)
+        {
+            if (exec_time > max_total_time)
+                max_total_time = exec_time;
+            if (mem_usage > max_total_rss)
+                max_total_rss = mem_usage;
         }
     }
-    closedir(dir);
+    if (has_checker > 0)
+        checker_close(&chk);
+    if (history)
+        test_stats_update(problem_dir, history, executed);
+    free(history);
 
-    if (remove(executable_path) != 0)
+    if (overall == -2)
     {
-        perror("remove compiled executable failed");
+        record_verdict(&rec, VERDICT_INTERNAL_ERROR, "Checker failed", 1);
     }
-
-    if (overall == -1)
+    else if (overall == -1)
     {
         char *masked_msg = sanitize_error_message(runtime_error_msg);
         if (masked_msg)
         {
-            printf("\nRuntime Error:\n%s\n", masked_msg);
+            record_verdict(&rec, VERDICT_RUNTIME_ERROR, masked_msg, 0);
             free(masked_msg);
         }
         else
         {
-            printf("\nRuntime Error: (Could not sanitize error message)\n");
+            record_verdict(&rec, VERDICT_RUNTIME_ERROR, "Could not sanitize error message", 1);
         }
     }
     else if (overall == 1)
     {
-        printf("\nWrong Answer\n");
+        record_verdict(&rec, VERDICT_WRONG_ANSWER, NULL, 0);
     }
     else if (overall == 2)
     {
-        printf("\nAccepted\n");
-        printf("time: %d ms, memory: %ld KB\n", max_total_time, max_total_rss);
+        record_verdict(&rec, VERDICT_ACCEPTED, NULL, 0);
+        rec.time_ms = max_total_time;
+        rec.memory_kb = max_total_rss;
+        // staged judging times it in a separate bench stage the server runs when run workers are idle
+        if (!run_only && has_bench > 0)
+            bench_tests(&bench, problem_dir, tests, test_count, executable_path, output_path, &rec);
+        if (!run_only && profiled)
+            profile_test(problem_dir, profiled, executable_path, output_path, &rec);
     }
+    for (int i = 0; i < test_count; i++)
+        free(tests[i]);
+    free(tests);
 
-    return 0;
+    remove(output_path);
+    if (!(keep_for_bench && overall == 2) && remove(executable_path) != 0)
+    {
+        perror("remove compiled executable failed");
+    }
+    return report(&rec, slot, event_fd, 0);
 }
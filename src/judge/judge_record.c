@@ -0,0 +1,192 @@
+#include "judge_record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+void record_init(judge_record *r)
+{
+    memset(r, 0, sizeof(*r));
+}
+
+void record_verdict(judge_record *r, verdict_kind verdict, const char *detail, int inline_detail)
+{
+    r->verdict = verdict;
+    r->message_inline = inline_detail;
+    r->message_off = r->log_len;
+    r->message_len = 0;
+    if (!detail)
+        return;
+    size_t len = strlen(detail);
+    size_t room = RECORD_LOG_SIZE - r->log_len;
+    if (len > room)
+        len = room;
+    memcpy(r->log + r->log_len, detail, len);
+    r->log_len += len;
+    r->message_len = len;
+}
+
+/**
+ * @brief append formatted text, cutting it at the end of the buffer
+ * @param buf text buffer
+ * @param size byte size of buf
+ * @param len byte size of the text so far (in/out)
+ * @param fmt printf format
+ */
+static void append(char *buf, size_t size, size_t *len, const char *fmt, ...)
+{
+    if (*len >= size - 1)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + *len, size - *len, fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        *len += ((size_t)n < size - *len) ? (size_t)n : size - 1 - *len;
+}
+
+/**
+ * @brief append one counter of a profile, "n/a" where the CPU does not count it
+ */
+static void append_counter(char *buf, size_t size, size_t *len, const char *name, int64_t count)
+{
+    if (count < 0)
+        append(buf, size, len, "%s n/a", name);
+    else
+        append(buf, size, len, "%s %lld", name, (long long)count);
+}
+
+/**
+ * @brief append the counters and the hottest functions of a profiled run
+ * @param r record with a done profile
+ * @param buf text buffer
+ * @param size byte size of buf
+ * @param len byte size of the text so far (in/out)
+ */
+static void format_profile(const judge_record *r, char *buf, size_t size, size_t *len)
+{
+    const int64_t *c = r->profile_counters;
+    append(buf, size, len, "profile: %s, %d samples on %s", r->profile_test, r->profile_samples,
+           r->profile_clock ? "the CPU clock" : "cycles");
+    if (r->profile_lost)
+        append(buf, size, len, ", %d lost", r->profile_lost);
+    append(buf, size, len, "\nprofile: ");
+    append_counter(buf, size, len, "cycles", c[PROFILE_CYCLES]);
+    append_counter(buf, size, len, ", instructions", c[PROFILE_INSTRUCTIONS]);
+    if (c[PROFILE_CYCLES] > 0 && c[PROFILE_INSTRUCTIONS] >= 0)
+        append(buf, size, len, " (IPC %.2f)", (double)c[PROFILE_INSTRUCTIONS] / c[PROFILE_CYCLES]);
+    append_counter(buf, size, len, ", cache misses", c[PROFILE_CACHE_MISSES]);
+    append_counter(buf, size, len, ", branch misses", c[PROFILE_BRANCH_MISSES]);
+    append(buf, size, len, "\n");
+    for (int i = 0; i < r->profile_funcs; i++)
+    {
+        const profile_func *f = &r->profile_top[i];
+        append(buf, size, len, "%7.1f%%  %.*s\n", 100.0 * f->samples / r->profile_samples, RECORD_SYMBOL_SIZE,
+               f->name);
+    }
+}
+
+size_t record_format(const judge_record *r, char *buf, size_t size)
+{
+    static const char *names[] = {
+        [VERDICT_ACCEPTED] = "Accepted",
+        [VERDICT_WRONG_ANSWER] = "Wrong Answer",
+        [VERDICT_RUNTIME_ERROR] = "Runtime Error",
+        [VERDICT_COMPILE_ERROR] = "Compile Error",
+        [VERDICT_INTERNAL_ERROR] = "Internal Error",
+    };
+    size_t len = 0;
+    buf[0] = '\0';
+    int message_len = (int)r->message_len;
+    const char *message = r->log + r->message_off;
+    switch (r->verdict)
+    {
+    case VERDICT_ACCEPTED:
+        append(buf, size, &len, "Accepted\ntime: %d ms, memory: %lld KB\n", r->time_ms, (long long)r->memory_kb);
+        break;
+    case VERDICT_WRONG_ANSWER:
+    case VERDICT_RUNTIME_ERROR:
+    case VERDICT_COMPILE_ERROR:
+    case VERDICT_INTERNAL_ERROR:
+        if (message_len == 0)
+            append(buf, size, &len, "%s\n", names[r->verdict]);
+        else if (r->message_inline)
+            append(buf, size, &len, "%s: (%.*s)\n", names[r->verdict], message_len, message);
+        else
+            append(buf, size, &len, "%s:\n%.*s\n", names[r->verdict], message_len, message);
+        break;
+    default:
+        break;
+    }
+
+    switch (r->bench)
+    {
+    case BENCH_DONE:
+        append(buf, size, &len, "bench: min %.3f ms, median %.3f ms, spread %.1f%% (%d runs after %d warm-up)\n",
+               r->bench_min_ms, r->bench_median_ms, r->bench_spread, r->bench_runs, r->bench_warmup);
+        if (r->bench_noisy)
+            append(buf, size, &len, "bench: noisy, spread above %.1f%% on %d of %d tests\n", r->bench_max_spread,
+                   r->bench_noisy, r->bench_tests);
+        break;
+    case BENCH_FAILED:
+        append(buf, size, &len, "bench: failed, a repeated run did not exit cleanly\n");
+        break;
+    case BENCH_NO_CONFIG:
+        append(buf, size, &len, "bench: failed, no valid bench file\n");
+        break;
+    default:
+        break;
+    }
+
+    switch (r->profile)
+    {
+    case PROFILE_DONE:
+        format_profile(r, buf, size, &len);
+        break;
+    case PROFILE_FAILED:
+        append(buf, size, &len, "profile: failed, the profiled run did not exit cleanly\n");
+        break;
+    case PROFILE_UNAVAILABLE:
+        append(buf, size, &len, "profile: unavailable, the server may not sample processes\n");
+        break;
+    default:
+        break;
+    }
+    return len;
+}
+
+int record_attach(const char *spec, judge_record **slot, int *event_fd)
+{
+    int shm_fd, index;
+    if (sscanf(spec, "%d:%d:%d", &shm_fd, event_fd, &index) != 3 || shm_fd < 0 || *event_fd < 0 || index < 0 ||
+        index >= RECORD_SLOTS)
+    {
+        fprintf(stderr, "invalid result slot: %s\n", spec);
+        return -1;
+    }
+    judge_record *region = mmap(NULL, RECORD_SLOTS * sizeof(judge_record), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (region == MAP_FAILED)
+    {
+        perror("mmap result slots failed");
+        return -1;
+    }
+    // the solutions and the compiler must not inherit the channel
+    close(shm_fd);
+    fcntl(*event_fd, F_SETFD, FD_CLOEXEC);
+    *slot = &region[index];
+    return 0;
+}
+
+void record_publish(const judge_record *r, judge_record *slot, int event_fd)
+{
+    memcpy((char *)slot + sizeof(slot->ready), (const char *)r + sizeof(r->ready),
+           offsetof(judge_record, log) - sizeof(r->ready) + r->log_len);
+    __atomic_store_n(&slot->ready, 1, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    while (write(event_fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
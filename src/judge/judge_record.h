@@ -0,0 +1,158 @@
+#ifndef JUDGE_RECORD_H
+#define JUDGE_RECORD_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Result channel. The server maps RECORD_SLOTS records from one memfd and lends a slot
+ * to every stage it starts, passing "-o <memfd>:<eventfd>:<slot>" to the judge. The
+ * judge fills the record, sets ready last and signals the eventfd. Without -o the
+ * judge prints the formatted record on stdout instead.
+ */
+
+#define RECORD_SLOTS 256         // records in the shared region, at most one per running stage
+#define RECORD_MAX_TESTS 128     // tests with a per-test entry, later ones only count in the summary
+#define RECORD_TEST_NAME_SIZE 32 // per-test input file name, cut to fit
+#define RECORD_LOG_SIZE 8192     // message bytes: compile and runtime error output
+#define RECORD_PROFILE_FUNCS 10  // hottest functions listed in a profile
+#define RECORD_SYMBOL_SIZE 56    // function name in a profile, cut to fit
+
+// what a stage found
+typedef enum
+{
+    VERDICT_NONE,           // nothing to report (bench stage: the run stage's verdict stands)
+    VERDICT_COMPILED,       // compile stage succeeded, the executable is in temp/
+    VERDICT_ACCEPTED,
+    VERDICT_WRONG_ANSWER,
+    VERDICT_RUNTIME_ERROR,
+    VERDICT_COMPILE_ERROR,
+    VERDICT_INTERNAL_ERROR
+} verdict_kind;
+
+// outcome of the repeated-run timing
+typedef enum
+{
+    BENCH_NONE,     // not timed
+    BENCH_DONE,     // bench_* fields are set
+    BENCH_FAILED,   // a repeated run did not exit cleanly
+    BENCH_NO_CONFIG // the problem's bench file is missing or invalid
+} bench_state;
+
+// outcome of the profiled run
+typedef enum
+{
+    PROFILE_NONE,       // not profiled
+    PROFILE_DONE,       // profile_* fields are set
+    PROFILE_FAILED,     // the profiled run did not exit cleanly
+    PROFILE_UNAVAILABLE // perf_event_open refused to sample the solution
+} profile_state;
+
+// hardware counters of the profiled run
+typedef enum
+{
+    PROFILE_CYCLES,
+    PROFILE_INSTRUCTIONS,
+    PROFILE_CACHE_MISSES,
+    PROFILE_BRANCH_MISSES,
+    PROFILE_COUNTERS
+} profile_counter;
+
+/**
+ * @brief function of the solution or of a library it calls, with its share of the samples
+ */
+typedef struct profile_func
+{
+    char name[RECORD_SYMBOL_SIZE]; // demangled symbol, "[object]" for an address without one
+    int32_t samples;               // samples whose address is in the function
+} profile_func;
+
+/**
+ * @brief one executed test
+ */
+typedef struct test_record
+{
+    char name[RECORD_TEST_NAME_SIZE]; // input file name
+    int32_t result;                   // 2: Accepted, 1: Wrong Answer, -1: Runtime Error, -2: checker failed
+    int32_t time_ms;                  // CPU time
+    int64_t memory_kb;                // peak resident set
+} test_record;
+
+/**
+ * @brief result of one judge stage, fixed layout shared between the judge and the server
+ */
+typedef struct judge_record
+{
+    uint32_t ready;    // set last by the judge, the rest is complete once it reads 1
+    int32_t verdict;   // verdict_kind
+    int32_t time_ms;   // slowest accepted test
+    int64_t memory_kb; // largest accepted test
+    int32_t test_count;                  // tests executed, the first RECORD_MAX_TESTS are in tests
+    test_record tests[RECORD_MAX_TESTS]; // in the order they ran
+    int32_t bench;            // bench_state
+    int32_t bench_runs;       // timed runs per test
+    int32_t bench_warmup;     // untimed runs per test before them
+    int32_t bench_noisy;      // tests whose spread is above bench_max_spread
+    int32_t bench_tests;      // tests timed
+    double bench_min_ms;      // fastest runs, summed over the tests
+    double bench_median_ms;   // median runs, summed over the tests
+    double bench_spread;      // largest spread of a test in %
+    double bench_max_spread;  // spread limit of the problem in %
+    int32_t profile;                            // profile_state
+    char profile_test[RECORD_TEST_NAME_SIZE];   // input file of the profiled run
+    int32_t profile_clock;                      // 1 if sampled on the CPU clock, the CPU has no cycle counter
+    int32_t profile_samples;                    // samples taken
+    int32_t profile_lost;                       // samples lost to a full ring buffer
+    int64_t profile_counters[PROFILE_COUNTERS]; // profile_counter totals, -1 where the CPU does not count
+    int32_t profile_funcs;                      // entries in profile_top
+    profile_func profile_top[RECORD_PROFILE_FUNCS]; // hottest functions, most samples first
+    int32_t message_inline;   // 1 to show the message on the verdict line, in parentheses
+    uint32_t message_off;     // verdict detail, at log + message_off
+    uint32_t message_len;     // byte size of the detail, 0 for none
+    uint32_t log_len;         // bytes used in log
+    char log[RECORD_LOG_SIZE]; // message bytes
+} judge_record;
+
+/**
+ * @brief Start an empty record
+ * @param r record
+ */
+void record_init(judge_record *r);
+
+/**
+ * @brief Set the verdict and its detail, cut to the room left in the log
+ * @param r record
+ * @param verdict verdict_kind
+ * @param detail message, NULL for none
+ * @param inline_detail 1 for a short note on the verdict line, 0 for lines below it
+ */
+void record_verdict(judge_record *r, verdict_kind verdict, const char *detail, int inline_detail);
+
+/**
+ * @brief Format a record as the text replied to clients
+ * @param r complete record
+ * @param buf text (output), NUL-terminated
+ * @param size byte size of buf
+ * @return byte size of the text, cut to size - 1
+ */
+size_t record_format(const judge_record *r, char *buf, size_t size);
+
+/**
+ * @brief Map the slot the server lent to this stage
+ * @param spec "<memfd>:<eventfd>:<slot>"
+ * @param slot record in the shared region (output)
+ * @param event_fd eventfd to signal (output)
+ * @return 0 on success, -1 on error
+ */
+int record_attach(const char *spec, judge_record **slot, int *event_fd);
+
+/**
+ * @brief Copy a record into the shared slot, mark it ready and wake the server
+ * @param r complete record
+ * @param slot slot returned by record_attach
+ * @param event_fd eventfd returned by record_attach
+ */
+void record_publish(const judge_record *r, judge_record *slot, int event_fd);
+
+#endif // JUDGE_RECORD_H
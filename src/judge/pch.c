@@ -0,0 +1,283 @@
+#include "pch.h"
+#include "../util/sha256.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/**
+ * @brief create a directory and its missing parents
+ * @param path directory path
+ * @return 0 on success, -1 on error
+ */
+static int make_dirs(const char *path)
+{
+    char buf[512];
+    strncpy(buf, path, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    for (char *p = buf + 1; *p; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(buf, 0755) < 0 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    if (mkdir(buf, 0755) < 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief find the compiler binary the way execvp would
+ * @param name compiler command
+ * @param path path of the binary (output)
+ * @param size byte size of path
+ * @param st status of the binary, symlinks followed (output)
+ * @return 0 if found, -1 otherwise
+ */
+static int find_compiler(const char *name, char *path, size_t size, struct stat *st)
+{
+    if (strchr(name, '/'))
+    {
+        snprintf(path, size, "%s", name);
+        return stat(path, st);
+    }
+    const char *dirs = getenv("PATH");
+    if (!dirs)
+        dirs = "/usr/local/bin:/usr/bin:/bin";
+    while (*dirs)
+    {
+        size_t len = strcspn(dirs, ":");
+        snprintf(path, size, "%.*s/%s", (int)len, len ? dirs : ".", name);
+        if (stat(path, st) == 0 && S_ISREG(st->st_mode) && access(path, X_OK) == 0)
+            return 0;
+        dirs += len + (dirs[len] == ':');
+    }
+    return -1;
+}
+
+/**
+ * @brief path of the cached identity of the compiler binary and flags of a toolchain
+ * @param tc toolchain
+ * @param cache_path path of the cache file (output)
+ * @param size byte size of cache_path
+ * @return 0 on success, -1 if the compiler binary was not found
+ */
+static int identity_cache_path(const toolchain *tc, char *cache_path, size_t size)
+{
+    char path[512];
+    struct stat st;
+    if (find_compiler(tc->compiler, path, sizeof(path), &st) < 0)
+        return -1;
+    // an upgrade replaces the binary, changing its inode, size or mtime
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, path, strlen(path) + 1);
+    sha256_update(&ctx, &st.st_dev, sizeof(st.st_dev));
+    sha256_update(&ctx, &st.st_ino, sizeof(st.st_ino));
+    sha256_update(&ctx, &st.st_size, sizeof(st.st_size));
+    sha256_update(&ctx, &st.st_mtim, sizeof(st.st_mtim));
+    for (int i = 0; tc->flags[i]; i++)
+        sha256_update(&ctx, tc->flags[i], strlen(tc->flags[i]) + 1);
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+    snprintf(cache_path, size, "%s/%s-%.16s", PCH_IDENTITY_DIR, tc->name, hex);
+    return 0;
+}
+
+/**
+ * @brief hash the compiler version, target and flags of a toolchain by asking the compiler
+ * @param tc toolchain
+ * @param hex hex digest (output)
+ * @return 0 on success, -1 if the compiler could not be queried
+ */
+static int query_identity(const toolchain *tc, char hex[SHA256_HEX_SIZE])
+{
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "%s -dumpfullversion 2>/dev/null && %s -dumpmachine 2>/dev/null",
+             tc->compiler, tc->compiler);
+    FILE *fp = popen(cmd, "r");
+    if (!fp)
+    {
+        perror("popen failed");
+        return -1;
+    }
+    char version[256];
+    size_t n = fread(version, 1, sizeof(version), fp);
+    if (pclose(fp) != 0 || n == 0)
+        return -1;
+
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, tc->compiler, strlen(tc->compiler) + 1);
+    sha256_update(&ctx, version, n);
+    for (int i = 0; tc->flags[i]; i++)
+        sha256_update(&ctx, tc->flags[i], strlen(tc->flags[i]) + 1);
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    sha256_final(&ctx, digest);
+    sha256_hex(digest, hex);
+    return 0;
+}
+
+/**
+ * @brief hash the compiler version, target and flags of a toolchain. The compiler is
+ *      only asked once per binary, the answer is cached in PCH_IDENTITY_DIR.
+ * @param tc toolchain
+ * @param hex hex digest (output)
+ * @return 0 on success, -1 if the compiler could not be queried
+ */
+static int toolchain_identity(const toolchain *tc, char hex[SHA256_HEX_SIZE])
+{
+    char cache_path[512];
+    int cached = (identity_cache_path(tc, cache_path, sizeof(cache_path)) == 0);
+    if (cached)
+    {
+        int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            ssize_t n = read(fd, hex, SHA256_HEX_SIZE - 1);
+            close(fd);
+            if (n == SHA256_HEX_SIZE - 1)
+            {
+                hex[n] = '\0';
+                return 0;
+            }
+        }
+    }
+    if (query_identity(tc, hex) < 0)
+        return -1;
+    if (cached && make_dirs(PCH_IDENTITY_DIR) == 0)
+    {
+        // written whole before it is visible, concurrent compiles may race to write it
+        char tmp[600];
+        snprintf(tmp, sizeof(tmp), "%s.%d.tmp", cache_path, (int)getpid());
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0)
+        {
+            int ok = write(fd, hex, SHA256_HEX_SIZE - 1) == SHA256_HEX_SIZE - 1;
+            close(fd);
+            if (!ok || rename(tmp, cache_path) < 0)
+                unlink(tmp);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief build the PCH in a detached process, unless another one already is
+ * @param tc toolchain
+ * @param stub header stub the PCH is built from
+ * @param gch path of the PCH
+ * @param lock_path lock file serializing builders
+ */
+static void spawn_builder(const toolchain *tc, const char *stub, const char *gch, const char *lock_path)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        return;
+    }
+    else if (pid > 0)
+    {
+        return;
+    }
+
+    // never hold the judge's result pipe open, the server waits for its EOF
+    int null_fd = open("/dev/null", O_RDWR);
+    if (null_fd >= 0)
+    {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        if (null_fd > STDERR_FILENO)
+            close(null_fd);
+    }
+    // the submission that missed the PCH is compiling right now, let it win
+    if (nice(19) < 0)
+        perror("nice failed");
+    int lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX | LOCK_NB) < 0 || access(gch, R_OK) == 0)
+        _exit(0);
+
+    char tmp[600];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", gch, (int)getpid());
+    char language[32];
+    snprintf(language, sizeof(language), "%s-header", tc->language);
+    const char *argv[TOOLCHAIN_MAX_FLAGS + 8];
+    int argc = 0;
+    argv[argc++] = tc->compiler;
+    for (int i = 0; tc->flags[i]; i++)
+        argv[argc++] = tc->flags[i];
+    argv[argc++] = "-x";
+    argv[argc++] = language;
+    argv[argc++] = stub;
+    argv[argc++] = "-o";
+    argv[argc++] = tmp;
+    argv[argc] = NULL;
+
+    pid_t cc = fork();
+    if (cc == 0)
+    {
+        execvp(tc->compiler, (char *const *)argv);
+        _exit(1);
+    }
+    int status;
+    if (cc > 0 && waitpid(cc, &status, 0) == cc && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        rename(tmp, gch);
+    else
+        unlink(tmp);
+    _exit(0);
+}
+
+int pch_prepare(const toolchain *tc, char *include_dir, size_t size)
+{
+    if (!tc->pch_header)
+        return -1;
+    char identity[SHA256_HEX_SIZE];
+    if (toolchain_identity(tc, identity) < 0)
+        return -1;
+    snprintf(include_dir, size, "%s/%s-%.16s", PCH_DIR, tc->name, identity);
+
+    char gch[512];
+    snprintf(gch, sizeof(gch), "%s/%s.gch", include_dir, tc->pch_header);
+    if (access(gch, R_OK) == 0)
+        return 0;
+
+    // the stub falls through to the real header whenever the PCH is rejected
+    char stub[512];
+    snprintf(stub, sizeof(stub), "%s/%s", include_dir, tc->pch_header);
+    char stub_dir[512];
+    strncpy(stub_dir, stub, sizeof(stub_dir));
+    *strrchr(stub_dir, '/') = '\0';
+    if (make_dirs(stub_dir) < 0)
+    {
+        perror("mkdir pch failed");
+        return -1;
+    }
+    if (access(stub, R_OK) != 0)
+    {
+        FILE *fp = fopen(stub, "w");
+        if (!fp)
+        {
+            perror("fopen failed");
+            return -1;
+        }
+        fprintf(fp, "#include_next <%s>\n", tc->pch_header);
+        fclose(fp);
+    }
+
+    char lock_path[600];
+    snprintf(lock_path, sizeof(lock_path), "%s/.lock", include_dir);
+    spawn_builder(tc, stub, gch, lock_path);
+    return -1;
+}
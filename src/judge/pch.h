@@ -0,0 +1,23 @@
+#ifndef PCH_H
+#define PCH_H
+
+#include "../defineshit.h"
+#include "../toolchain/toolchain.h"
+#include <stddef.h>
+
+#define PCH_DIR "temp/pch"
+#define PCH_IDENTITY_DIR PCH_DIR "/identity" // compiler identities, keyed on the compiler binary's path, size and mtime
+
+/**
+ * @brief Find the precompiled header of a toolchain for the installed compiler.
+ *      PCHs live in temp/pch/<name>-<hash of compiler version and flags>/, so
+ *      a compiler upgrade or a flag change never picks up a stale one. On a
+ *      miss a detached process builds it and the caller compiles without it.
+ * @param tc toolchain.
+ * @param include_dir directory to pass with -I (output).
+ * @param size byte size of include_dir.
+ * @return 0 if the PCH is ready, -1 to compile without it.
+ */
+int pch_prepare(const toolchain *tc, char *include_dir, size_t size);
+
+#endif // PCH_H
@@ -0,0 +1,565 @@
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define MAX_OBJECTS 16     // mapped files resolved to symbols
+#define MAX_MAPS 32        // executable mappings of those files
+#define MAX_FUNCS 1024     // distinct functions counted, the samples of later ones count for their file
+#define RECORD_SCRATCH 8192 // ring buffer record copied out, larger ones are skipped
+
+// from libstdc++, C++ symbols are shown as written in the source
+extern char *__cxa_demangle(const char *mangled, char *buf, size_t *len, int *status);
+
+/**
+ * @brief function symbol of a mapped file
+ */
+typedef struct symbol
+{
+    uint64_t addr;    // link-time address
+    uint64_t size;    // byte size, 0 if unknown
+    const char *name; // in the mapped file
+} symbol;
+
+/**
+ * @brief file mapped by the solution, with its function symbols
+ */
+typedef struct object
+{
+    char path[256];
+    const char *base;        // file name, in path
+    void *image;             // whole file, MAP_FAILED if it could not be read
+    size_t image_size;
+    const Elf64_Phdr *phdr;  // program headers, turn file offsets into link-time addresses
+    int n_phdr;
+    symbol *syms;            // sorted by address
+    int n_syms;
+} object;
+
+/**
+ * @brief executable mapping of an object
+ */
+typedef struct mapping
+{
+    uint64_t start;  // first address
+    uint64_t end;    // address past the mapping
+    uint64_t pgoff;  // file offset of start
+    object *obj;
+} mapping;
+
+/**
+ * @brief samples of one function, or of a file for addresses without a symbol
+ */
+typedef struct func_count
+{
+    const object *obj; // NULL for addresses outside every mapping
+    const char *name;  // NULL for an address without a symbol
+    long samples;
+} func_count;
+
+struct profile_session
+{
+    int counters[PROFILE_COUNTERS]; // counting events, -1 if the CPU does not count them
+    int sampler;                    // sampling event, owns the ring buffer
+    int clock;                      // 1 if sampling on the CPU clock
+    char *ring;                     // control page, then PROFILE_RING_PAGES data pages
+    size_t page_size;
+    object objects[MAX_OBJECTS];
+    int n_objects;
+    mapping maps[MAX_MAPS];
+    int n_maps;
+    func_count funcs[MAX_FUNCS];
+    int n_funcs;
+    func_count *last;               // function of the previous sample, usually the next one's too
+    long samples;
+    long lost;
+    char scratch[RECORD_SCRATCH];
+};
+
+/**
+ * @brief open one event on a process that has not exec'd yet, enabled at its exec
+ * @param pid process
+ * @param type PERF_TYPE_*
+ * @param config event of that type
+ * @param sample 1 to sample instruction pointers, 0 to count
+ * @param ring_bytes data size of the ring buffer, sets the wake-up mark
+ * @return file descriptor, or -1 on error
+ */
+static int open_event(pid_t pid, uint32_t type, uint64_t config, int sample, size_t ring_bytes)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    if (sample)
+    {
+        attr.freq = 1;
+        attr.sample_freq = PROFILE_FREQ;
+        attr.sample_type = PERF_SAMPLE_IP;
+        // the loader's mappings, to find the file of a sampled address
+        attr.mmap = 1;
+        attr.watermark = 1;
+        attr.wakeup_watermark = ring_bytes / 2;
+    }
+    return syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+profile_session *profile_open(pid_t pid)
+{
+    static const uint64_t hardware[PROFILE_COUNTERS] = {
+        [PROFILE_CYCLES] = PERF_COUNT_HW_CPU_CYCLES,
+        [PROFILE_INSTRUCTIONS] = PERF_COUNT_HW_INSTRUCTIONS,
+        [PROFILE_CACHE_MISSES] = PERF_COUNT_HW_CACHE_MISSES,
+        [PROFILE_BRANCH_MISSES] = PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    profile_session *s = calloc(1, sizeof(profile_session));
+    if (!s)
+    {
+        perror("malloc failed");
+        return NULL;
+    }
+    s->page_size = sysconf(_SC_PAGESIZE);
+    size_t ring_bytes = PROFILE_RING_PAGES * s->page_size;
+    // virtual machines often have no PMU, the CPU clock still samples
+    s->sampler = open_event(pid, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 1, ring_bytes);
+    if (s->sampler < 0)
+    {
+        s->clock = 1;
+        s->sampler = open_event(pid, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK, 1, ring_bytes);
+    }
+    if (s->sampler < 0)
+    {
+        perror("perf_event_open failed");
+        free(s);
+        return NULL;
+    }
+    s->ring = mmap(NULL, s->page_size + ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, s->sampler, 0);
+    if (s->ring == MAP_FAILED)
+    {
+        perror("mmap perf ring failed");
+        close(s->sampler);
+        free(s);
+        return NULL;
+    }
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+        s->counters[i] = open_event(pid, PERF_TYPE_HARDWARE, hardware[i], 0, 0);
+    return s;
+}
+
+int profile_fd(const profile_session *s)
+{
+    return s->sampler;
+}
+
+/**
+ * @brief qsort comparator for symbols by address
+ */
+static int compare_symbols(const void *a, const void *b)
+{
+    uint64_t x = ((const symbol *)a)->addr;
+    uint64_t y = ((const symbol *)b)->addr;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief map an ELF file and collect its function symbols, the full table if the file
+ *      is not stripped, the exported functions otherwise
+ * @param obj object with path set
+ */
+static void load_symbols(object *obj)
+{
+    obj->image = MAP_FAILED;
+    int fd = open(obj->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(Elf64_Ehdr))
+    {
+        obj->image_size = st.st_size;
+        obj->image = mmap(NULL, obj->image_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (obj->image == MAP_FAILED)
+        return;
+    const char *image = obj->image;
+    const Elf64_Ehdr *eh = obj->image;
+    if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+        eh->e_phoff + (uint64_t)eh->e_phnum * sizeof(Elf64_Phdr) > obj->image_size ||
+        eh->e_shoff + (uint64_t)eh->e_shnum * sizeof(Elf64_Shdr) > obj->image_size)
+        return;
+    obj->phdr = (const Elf64_Phdr *)(image + eh->e_phoff);
+    obj->n_phdr = eh->e_phnum;
+    const Elf64_Shdr *sh = (const Elf64_Shdr *)(image + eh->e_shoff);
+    const Elf64_Shdr *table = NULL;
+    for (int i = 0; i < eh->e_shnum; i++)
+    {
+        if (sh[i].sh_type == SHT_SYMTAB || (sh[i].sh_type == SHT_DYNSYM && !table))
+            table = &sh[i];
+    }
+    if (!table || table->sh_link >= eh->e_shnum || table->sh_offset + table->sh_size > obj->image_size)
+        return;
+    const Elf64_Shdr *strtab = &sh[table->sh_link];
+    if (strtab->sh_offset + strtab->sh_size > obj->image_size || strtab->sh_size == 0)
+        return;
+    const Elf64_Sym *syms = (const Elf64_Sym *)(image + table->sh_offset);
+    size_t n = table->sh_size / sizeof(Elf64_Sym);
+    obj->syms = malloc((n ? n : 1) * sizeof(symbol));
+    if (!obj->syms)
+        return;
+    for (size_t i = 0; i < n; i++)
+    {
+        int type = ELF64_ST_TYPE(syms[i].st_info);
+        if ((type != STT_FUNC && type != STT_GNU_IFUNC) || syms[i].st_shndx == SHN_UNDEF || syms[i].st_value == 0 ||
+            syms[i].st_name >= strtab->sh_size)
+            continue;
+        symbol *sym = &obj->syms[obj->n_syms++];
+        sym->addr = syms[i].st_value;
+        sym->size = syms[i].st_size;
+        sym->name = image + strtab->sh_offset + syms[i].st_name;
+    }
+    qsort(obj->syms, obj->n_syms, sizeof(symbol), compare_symbols);
+}
+
+/**
+ * @brief record an executable mapping of the solution, loading its file on first sight
+ * @param s session
+ * @param start first address
+ * @param len byte size
+ * @param pgoff file offset of start
+ * @param path mapped file, "[vdso]" and the like for the kernel's own
+ */
+static void add_mapping(profile_session *s, uint64_t start, uint64_t len, uint64_t pgoff, const char *path)
+{
+    if (s->n_maps == MAX_MAPS)
+        return;
+    object *obj = NULL;
+    for (int i = 0; i < s->n_objects && !obj; i++)
+    {
+        if (strcmp(s->objects[i].path, path) == 0)
+            obj = &s->objects[i];
+    }
+    if (!obj)
+    {
+        if (s->n_objects == MAX_OBJECTS)
+            return;
+        obj = &s->objects[s->n_objects++];
+        snprintf(obj->path, sizeof(obj->path), "%s", path);
+        const char *slash = strrchr(obj->path, '/');
+        obj->base = slash ? slash + 1 : obj->path;
+        if (path[0] == '/')
+            load_symbols(obj);
+        else
+            obj->image = MAP_FAILED;
+    }
+    mapping *m = &s->maps[s->n_maps++];
+    m->start = start;
+    m->end = start + len;
+    m->pgoff = pgoff;
+    m->obj = obj;
+}
+
+/**
+ * @brief find the function symbol holding an address
+ * @param obj file the address is mapped from
+ * @param offset file offset of the address
+ * @return symbol name, or NULL if none covers it
+ */
+static const char *find_symbol(const object *obj, uint64_t offset)
+{
+    // PIE executables and libraries load anywhere, the segment gives the link-time address
+    uint64_t addr = 0;
+    int found = 0;
+    for (int i = 0; i < obj->n_phdr && !found; i++)
+    {
+        const Elf64_Phdr *ph = &obj->phdr[i];
+        if (ph->p_type == PT_LOAD && offset >= ph->p_offset && offset < ph->p_offset + ph->p_filesz)
+        {
+            addr = offset - ph->p_offset + ph->p_vaddr;
+            found = 1;
+        }
+    }
+    if (!found || obj->n_syms == 0)
+        return NULL;
+    int lo = 0, hi = obj->n_syms - 1;
+    if (addr < obj->syms[0].addr)
+        return NULL;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (obj->syms[mid].addr <= addr)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    const symbol *sym = &obj->syms[lo];
+    if (sym->size && addr >= sym->addr + sym->size)
+        return NULL;
+    return sym->name;
+}
+
+/**
+ * @brief count a sample for a function
+ * @param s session
+ * @param obj file of the sampled address, NULL if outside every mapping
+ * @param name function, NULL if no symbol covers the address
+ */
+static void count_sample(profile_session *s, const object *obj, const char *name)
+{
+    if (s->last && s->last->obj == obj && s->last->name == name)
+    {
+        s->last->samples++;
+        return;
+    }
+    for (int i = 0; i < s->n_funcs; i++)
+    {
+        if (s->funcs[i].obj == obj && s->funcs[i].name == name)
+        {
+            s->last = &s->funcs[i];
+            s->last->samples++;
+            return;
+        }
+    }
+    if (s->n_funcs == MAX_FUNCS)
+    {
+        // no room for another function, it counts for its file
+        if (name)
+            count_sample(s, obj, NULL);
+        return;
+    }
+    s->last = &s->funcs[s->n_funcs++];
+    s->last->obj = obj;
+    s->last->name = name;
+    s->last->samples = 1;
+}
+
+/**
+ * @brief count a sample for the function holding its address
+ * @param s session
+ * @param ip sampled instruction pointer
+ */
+static void add_sample(profile_session *s, uint64_t ip)
+{
+    s->samples++;
+    for (int i = 0; i < s->n_maps; i++)
+    {
+        const mapping *m = &s->maps[i];
+        if (ip >= m->start && ip < m->end)
+        {
+            count_sample(s, m->obj, find_symbol(m->obj, ip - m->start + m->pgoff));
+            return;
+        }
+    }
+    count_sample(s, NULL, NULL);
+}
+
+/**
+ * @brief copy bytes out of the ring buffer, wrapping at its end
+ */
+static void ring_copy(const char *data, size_t size, uint64_t pos, void *out, size_t len)
+{
+    size_t off = pos & (size - 1);
+    size_t first = size - off < len ? size - off : len;
+    memcpy(out, data + off, first);
+    memcpy((char *)out + first, data, len - first);
+}
+
+void profile_drain(profile_session *s)
+{
+    struct perf_event_mmap_page *meta = (struct perf_event_mmap_page *)s->ring;
+    const char *data = s->ring + s->page_size;
+    size_t size = PROFILE_RING_PAGES * s->page_size;
+    uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = meta->data_tail;
+    while (tail + sizeof(struct perf_event_header) <= head)
+    {
+        struct perf_event_header hdr;
+        ring_copy(data, size, tail, &hdr, sizeof(hdr));
+        if (hdr.size < sizeof(hdr) || tail + hdr.size > head)
+            break;
+        if (hdr.size <= RECORD_SCRATCH)
+        {
+            ring_copy(data, size, tail, s->scratch, hdr.size);
+            const char *body = s->scratch + sizeof(hdr);
+            if (hdr.type == PERF_RECORD_SAMPLE)
+            {
+                uint64_t ip;
+                memcpy(&ip, body, sizeof(ip));
+                add_sample(s, ip);
+            }
+            else if (hdr.type == PERF_RECORD_MMAP && hdr.size > sizeof(hdr) + 32)
+            {
+                // pid, tid, then addr, len, pgoff and the NUL-terminated file name
+                uint64_t addr, len, pgoff;
+                memcpy(&addr, body + 8, 8);
+                memcpy(&len, body + 16, 8);
+                memcpy(&pgoff, body + 24, 8);
+                s->scratch[hdr.size - 1] = '\0';
+                add_mapping(s, addr, len, pgoff, body + 32);
+            }
+            else if (hdr.type == PERF_RECORD_LOST)
+            {
+                uint64_t lost;
+                memcpy(&lost, body + 8, sizeof(lost));
+                s->lost += lost;
+            }
+        }
+        tail += hdr.size;
+    }
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief read a counting event, scaled up if it shared the PMU with other events
+ * @param fd event, -1 if not counted
+ * @return count, or -1 if the CPU did not count it
+ */
+static int64_t read_counter(int fd)
+{
+    uint64_t v[3]; // value, time enabled, time running
+    if (fd < 0 || read(fd, v, sizeof(v)) != sizeof(v) || v[2] == 0)
+        return -1;
+    if (v[2] < v[1])
+        return (int64_t)((double)v[0] * v[1] / v[2]);
+    return (int64_t)v[0];
+}
+
+/**
+ * @brief qsort comparator putting the functions with the most samples first
+ */
+static int compare_funcs(const void *a, const void *b)
+{
+    long x = ((const func_count *)a)->samples;
+    long y = ((const func_count *)b)->samples;
+    return (x < y) - (x > y);
+}
+
+/**
+ * @brief collapse the template arguments and the parameters of a C++ name,
+ *      std::sort<int*>(int*, int*) becomes std::sort<...>(...)
+ * @param name demangled name
+ * @param out short name (output)
+ * @param size byte size of out
+ */
+static void collapse_name(const char *name, char *out, size_t size)
+{
+    size_t len = 0;
+    int depth = 0;
+    for (const char *p = name; *p && len + 6 < size; p++)
+    {
+        if (*p == '<' || *p == '(')
+        {
+            if (depth++ == 0)
+            {
+                memcpy(out + len, *p == '<' ? "<..." : "(...", 4);
+                len += 4;
+            }
+        }
+        else if ((*p == '>' || *p == ')') && depth > 0)
+        {
+            if (--depth == 0)
+                out[len++] = *p;
+        }
+        else if (depth == 0)
+        {
+            out[len++] = *p;
+        }
+    }
+    out[len] = '\0';
+}
+
+/**
+ * @brief name a function for the report, cutting long names with "..."
+ * @param s session
+ * @param f function
+ * @param out name (output)
+ */
+static void function_name(const profile_session *s, const func_count *f, char out[RECORD_SYMBOL_SIZE])
+{
+    int n;
+    if (!f->obj)
+    {
+        n = snprintf(out, RECORD_SYMBOL_SIZE, "[unknown]");
+    }
+    else if (!f->name)
+    {
+        n = snprintf(out, RECORD_SYMBOL_SIZE, "[%s]", f->obj->base);
+    }
+    else
+    {
+        int status = -1;
+        char *demangled = strncmp(f->name, "_Z", 2) == 0 ? __cxa_demangle(f->name, NULL, NULL, &status) : NULL;
+        const char *name = (status == 0 && demangled) ? demangled : f->name;
+        char short_name[RECORD_SYMBOL_SIZE * 2];
+        if (name == demangled && strlen(name) >= RECORD_SYMBOL_SIZE)
+        {
+            collapse_name(name, short_name, sizeof(short_name));
+            name = short_name;
+        }
+        // the executable is mapped first, functions of the libraries name their file
+        if (f->obj == &s->objects[0])
+            n = snprintf(out, RECORD_SYMBOL_SIZE, "%s", name);
+        else
+            n = snprintf(out, RECORD_SYMBOL_SIZE, "%s [%s]", name, f->obj->base);
+        free(demangled);
+    }
+    if (n >= RECORD_SYMBOL_SIZE)
+        memcpy(out + RECORD_SYMBOL_SIZE - 4, "...", 4);
+}
+
+/**
+ * @brief release the events, the ring buffer and the mapped files
+ * @param s session
+ */
+static void free_session(profile_session *s)
+{
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+    {
+        if (s->counters[i] >= 0)
+            close(s->counters[i]);
+    }
+    munmap(s->ring, s->page_size + PROFILE_RING_PAGES * s->page_size);
+    close(s->sampler);
+    for (int i = 0; i < s->n_objects; i++)
+    {
+        if (s->objects[i].image != MAP_FAILED)
+            munmap(s->objects[i].image, s->objects[i].image_size);
+        free(s->objects[i].syms);
+    }
+    free(s);
+}
+
+void profile_close(profile_session *s, judge_record *rec)
+{
+    rec->profile = PROFILE_DONE;
+    rec->profile_clock = s->clock;
+    rec->profile_samples = s->samples;
+    rec->profile_lost = s->lost;
+    for (int i = 0; i < PROFILE_COUNTERS; i++)
+        rec->profile_counters[i] = read_counter(s->counters[i]);
+    qsort(s->funcs, s->n_funcs, sizeof(func_count), compare_funcs);
+    rec->profile_funcs = s->n_funcs < RECORD_PROFILE_FUNCS ? s->n_funcs : RECORD_PROFILE_FUNCS;
+    for (int i = 0; i < rec->profile_funcs; i++)
+    {
+        function_name(s, &s->funcs[i], rec->profile_top[i].name);
+        rec->profile_top[i].samples = s->funcs[i].samples;
+    }
+    free_session(s);
+}
+
+void profile_abort(profile_session *s)
+{
+    free_session(s);
+}
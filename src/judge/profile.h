@@ -0,0 +1,53 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "../defineshit.h"
+#include "judge_record.h"
+#include <sys/types.h>
+
+/*
+ * Profile of one run of a solution. Counters and an instruction pointer sampler are
+ * opened with perf_event_open on the stopped child and start counting at its exec;
+ * user space only, so they work at perf_event_paranoid 2. Samples are resolved to the
+ * functions of the executable and of the libraries it maps, from their ELF symbol tables.
+ */
+
+#define PROFILE_FREQ 4000       // samples per second of CPU time
+#define PROFILE_RING_PAGES 64   // data pages of the sample ring buffer, a power of two
+
+typedef struct profile_session profile_session;
+
+/**
+ * @brief Open the counters and the sampler on a child that has not exec'd yet
+ * @param pid child, blocked until the session is open
+ * @return session, or NULL if the process may not be sampled
+ */
+profile_session *profile_open(pid_t pid);
+
+/**
+ * @brief Descriptor that becomes readable once the ring buffer is half full
+ * @param s session
+ * @return file descriptor to poll
+ */
+int profile_fd(const profile_session *s);
+
+/**
+ * @brief Take the samples and mappings written to the ring buffer so far
+ * @param s session
+ */
+void profile_drain(profile_session *s);
+
+/**
+ * @brief Read the counters, put the hottest functions in the record and free the session
+ * @param s session, drained after the child exited
+ * @param rec result record, receives the profile_* fields
+ */
+void profile_close(profile_session *s, judge_record *rec);
+
+/**
+ * @brief Free a session without reporting
+ * @param s session
+ */
+void profile_abort(profile_session *s);
+
+#endif // PROFILE_H
@@ -0,0 +1,219 @@
+#include "sanitize.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char *const sanitize_default_patterns[] = {
+    "build/src/",     // program build path
+    "files/receive/", // received file path
+    "temp/",          // temporary file path
+    NULL
+};
+
+/**
+ * @brief append bytes to the output, respecting the output limit
+ * @param s sanitizer
+ * @param data bytes to append
+ * @param len byte size of the data
+ */
+static void emit(sanitizer *s, const char *data, size_t len)
+{
+    if (s->truncated || len == 0)
+        return;
+    if (s->limit && s->out_len + len > s->limit)
+    {
+        len = s->limit - s->out_len;
+        s->truncated = 1;
+    }
+    if (s->out_len + len + 1 > s->out_cap)
+    {
+        size_t cap = s->out_cap ? s->out_cap : 1024;
+        while (s->out_len + len + 1 > cap)
+            cap *= 2;
+        char *out = realloc(s->out, cap);
+        if (!out)
+        {
+            s->truncated = 1;
+            return;
+        }
+        s->out = out;
+        s->out_cap = cap;
+    }
+    memcpy(s->out + s->out_len, data, len);
+    s->out_len += len;
+}
+
+int sanitizer_init(sanitizer *s, const char *const *patterns, const char *const *replacements, size_t limit)
+{
+    memset(s, 0, sizeof(*s));
+    s->limit = limit;
+    s->replacements = replacements;
+
+    size_t total = 1;
+    for (int i = 0; patterns[i] != NULL; i++)
+    {
+        size_t len = strlen(patterns[i]);
+        if (len == 0 || len > SANITIZE_MAX_PATTERN_LEN)
+            return -1;
+        total += len;
+    }
+
+    s->go = malloc(total * sizeof(*s->go));
+    s->depth = calloc(total, sizeof(int));
+    s->match_len = calloc(total, sizeof(int));
+    s->match_id = calloc(total, sizeof(int));
+    int *fail = calloc(total, sizeof(int));
+    int *queue = malloc(total * sizeof(int));
+    if (!s->go || !s->depth || !s->match_len || !s->match_id || !fail || !queue)
+    {
+        free(fail);
+        free(queue);
+        sanitizer_free(s);
+        return -1;
+    }
+    memset(s->go, -1, total * sizeof(*s->go));
+    s->n_states = 1;
+
+    // trie of the patterns
+    for (int i = 0; patterns[i] != NULL; i++)
+    {
+        int cur = 0;
+        for (const unsigned char *p = (const unsigned char *)patterns[i]; *p; p++)
+        {
+            if (s->go[cur][*p] < 0)
+            {
+                s->go[cur][*p] = s->n_states;
+                s->depth[s->n_states] = s->depth[cur] + 1;
+                s->n_states++;
+            }
+            cur = s->go[cur][*p];
+        }
+        s->match_len[cur] = s->depth[cur];
+        s->match_id[cur] = i;
+    }
+
+    // failure links in BFS order, completing the goto function into a DFA
+    int head = 0, tail = 0;
+    for (int c = 0; c < 256; c++)
+    {
+        if (s->go[0][c] < 0)
+        {
+            s->go[0][c] = 0;
+        }
+        else
+        {
+            fail[s->go[0][c]] = 0;
+            queue[tail++] = s->go[0][c];
+        }
+    }
+    while (head < tail)
+    {
+        int u = queue[head++];
+        if (!s->match_len[u])
+        {
+            s->match_len[u] = s->match_len[fail[u]];
+            s->match_id[u] = s->match_id[fail[u]];
+        }
+        for (int c = 0; c < 256; c++)
+        {
+            int v = s->go[u][c];
+            if (v < 0)
+            {
+                s->go[u][c] = s->go[fail[u]][c];
+            }
+            else
+            {
+                fail[v] = s->go[fail[u]][c];
+                queue[tail++] = v;
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+void sanitizer_feed(sanitizer *s, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)data[i];
+        s->pending[s->pending_len++] = (char)c;
+        s->state = s->go[s->state][c];
+        if (s->match_len[s->state])
+        {
+            // drop the matched pattern and restart after it
+            const char *replacement = s->replacements ? s->replacements[s->match_id[s->state]] : NULL;
+            s->pending_len -= s->match_len[s->state];
+            s->state = 0;
+            if (replacement)
+            {
+                emit(s, s->pending, s->pending_len);
+                s->pending_len = 0;
+                emit(s, replacement, strlen(replacement));
+            }
+        }
+        // only the current prefix can still turn into a match
+        size_t keep = s->depth[s->state];
+        if (s->pending_len > keep)
+        {
+            size_t n = s->pending_len - keep;
+            emit(s, s->pending, n);
+            memmove(s->pending, s->pending + n, keep);
+            s->pending_len = keep;
+        }
+    }
+}
+
+char *sanitizer_finish(sanitizer *s)
+{
+    emit(s, s->pending, s->pending_len);
+    s->pending_len = 0;
+    s->state = 0;
+
+    int truncated = s->truncated;
+    s->truncated = 0;
+    s->limit = 0;
+    if (truncated)
+        emit(s, SANITIZE_TRUNCATED_NOTE, strlen(SANITIZE_TRUNCATED_NOTE));
+
+    if (!s->out)
+    {
+        s->out = malloc(1);
+        if (!s->out)
+            return NULL;
+    }
+    s->out[s->out_len] = '\0';
+    char *out = s->out;
+    s->out = NULL;
+    s->out_len = 0;
+    s->out_cap = 0;
+    return out;
+}
+
+void sanitizer_free(sanitizer *s)
+{
+    free(s->go);
+    free(s->depth);
+    free(s->match_len);
+    free(s->match_id);
+    free(s->out);
+    s->go = NULL;
+    s->depth = NULL;
+    s->match_len = NULL;
+    s->match_id = NULL;
+    s->out = NULL;
+}
+
+char *sanitize_error_message(const char *msg)
+{
+    if (!msg)
+        return NULL;
+
+    sanitizer s;
+    if (sanitizer_init(&s, sanitize_default_patterns, NULL, 0) < 0)
+        return NULL;
+    sanitizer_feed(&s, msg, strlen(msg));
+    char *sanitized = sanitizer_finish(&s);
+    sanitizer_free(&s);
+    return sanitized;
+}
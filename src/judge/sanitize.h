@@ -0,0 +1,75 @@
+#ifndef SANITIZE_H
+#define SANITIZE_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+
+#define SANITIZE_MAX_PATTERN_LEN 64
+#define SANITIZE_TRUNCATED_NOTE "\n... (truncated)\n"
+
+/**
+ * @brief streaming sanitizer, masks every pattern in one pass (Aho-Corasick)
+ */
+typedef struct sanitizer
+{
+    int (*go)[256];                         // goto function, complete DFA after build
+    int *depth;                             // depth of each state (matched prefix length)
+    int *match_len;                         // longest pattern ending at each state, 0 if none
+    int *match_id;                          // index of that pattern
+    const char *const *replacements;        // replacement of each pattern, NULL to remove all
+    int n_states;                           // number of states
+    int state;                              // current state
+    char pending[SANITIZE_MAX_PATTERN_LEN]; // bytes that may still be part of a match
+    size_t pending_len;                     // byte size of the pending bytes
+    char *out;                              // sanitized output (heap-allocated)
+    size_t out_len;                         // byte size of the sanitized output
+    size_t out_cap;                         // capacity of the output buffer
+    size_t limit;                           // output limit in bytes, 0 for unlimited
+    int truncated;                          // 1 if the output hit the limit
+} sanitizer;
+
+/**
+ * @brief NULL-terminated list of path patterns masked from judge messages
+ */
+extern const char *const sanitize_default_patterns[];
+
+/**
+ * @brief Build the matcher for the given patterns.
+ * @param s sanitizer to initialize.
+ * @param patterns NULL-terminated list of patterns to mask.
+ * @param replacements replacement of each pattern (NULL entry to remove it), or NULL to remove all.
+ * @param limit output limit in bytes, 0 for unlimited.
+ * @return 0 on success, -1 on error.
+ */
+int sanitizer_init(sanitizer *s, const char *const *patterns, const char *const *replacements, size_t limit);
+
+/**
+ * @brief Feed a chunk of the message. Matches may span chunks.
+ * @param s sanitizer.
+ * @param data chunk to sanitize.
+ * @param len byte size of the chunk.
+ */
+void sanitizer_feed(sanitizer *s, const char *data, size_t len);
+
+/**
+ * @brief Flush the pending bytes and take the sanitized message.
+ *      The result is heap-allocated and should be freed by the caller.
+ * @param s sanitizer.
+ * @return NUL-terminated sanitized message, or NULL on error.
+ */
+char *sanitizer_finish(sanitizer *s);
+
+/**
+ * @brief Release the matcher and any output not taken by sanitizer_finish.
+ * @param s sanitizer.
+ */
+void sanitizer_free(sanitizer *s);
+
+/**
+ * @brief Sanitize an error message by masking file paths and file names.
+ * @param msg error message to sanitize.
+ * @return sanitized error message (heap-allocated), or NULL on error.
+ */
+char *sanitize_error_message(const char *msg);
+
+#endif // SANITIZE_H
@@ -0,0 +1,206 @@
+#include "test_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+/**
+ * @brief ordering key of a test
+ */
+typedef struct ranked_test
+{
+    char *name;   // input file name
+    double score; // expected rejections per ms of running the test
+} ranked_test;
+
+/**
+ * @brief build the stats file path of a problem
+ * @param problem_dir test case directory
+ * @param path path (output)
+ * @param size size of the path buffer
+ */
+static void stats_path(const char *problem_dir, char *path, size_t size)
+{
+    char name[256];
+    strncpy(name, problem_dir, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    for (char *p = name; *p; p++)
+    {
+        if (*p == '/')
+            *p = '_';
+    }
+    snprintf(path, size, "%s/%s.stats", STATS_DIR, name);
+}
+
+/**
+ * @brief add an empty entry for a test
+ * @param stats history
+ * @param name input file name
+ * @return new entry, or NULL on error
+ */
+static test_stat *add_entry(test_stats *stats, const char *name)
+{
+    if (stats->count == stats->cap)
+    {
+        int cap = stats->cap ? stats->cap * 2 : 16;
+        test_stat *items = realloc(stats->items, cap * sizeof(test_stat));
+        if (!items)
+            return NULL;
+        stats->items = items;
+        stats->cap = cap;
+    }
+    test_stat *item = &stats->items[stats->count++];
+    memset(item, 0, sizeof(*item));
+    strncpy(item->name, name, sizeof(item->name) - 1);
+    return item;
+}
+
+/**
+ * @brief parse "<name> <runs> <fails> <total_ms>" lines
+ * @param fp stats file
+ * @param stats history (output)
+ */
+static void parse_stats(FILE *fp, test_stats *stats)
+{
+    char name[TEST_NAME_SIZE];
+    long runs, fails, total_ms;
+    while (fscanf(fp, "%127s %ld %ld %ld", name, &runs, &fails, &total_ms) == 4)
+    {
+        test_stat *item = add_entry(stats, name);
+        if (!item)
+            break;
+        item->runs = runs;
+        item->fails = fails;
+        item->total_ms = total_ms;
+    }
+}
+
+int test_stats_load(const char *problem_dir, test_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    char path[512];
+    stats_path(problem_dir, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return errno == ENOENT ? 0 : -1;
+    flock(fd, LOCK_SH);
+    FILE *fp = fdopen(fd, "r");
+    if (!fp)
+    {
+        close(fd);
+        return -1;
+    }
+    parse_stats(fp, stats);
+    fclose(fp);
+    return 0;
+}
+
+const test_stat *test_stats_find(const test_stats *stats, const char *name)
+{
+    for (int i = 0; i < stats->count; i++)
+    {
+        if (strcmp(stats->items[i].name, name) == 0)
+            return &stats->items[i];
+    }
+    return NULL;
+}
+
+int test_stats_update(const char *problem_dir, const test_stat *runs, int count)
+{
+    if (mkdir(STATS_DIR, 0755) < 0 && errno != EEXIST)
+    {
+        perror("mkdir stats failed");
+        return -1;
+    }
+    char path[512];
+    stats_path(problem_dir, path, sizeof(path));
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror("open stats failed");
+        return -1;
+    }
+    // other judges of the same problem update the file concurrently
+    flock(fd, LOCK_EX);
+
+    test_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    FILE *fp = fdopen(dup(fd), "r");
+    if (fp)
+    {
+        parse_stats(fp, &stats);
+        fclose(fp);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        test_stat *item = (test_stat *)test_stats_find(&stats, runs[i].name);
+        if (!item)
+            item = add_entry(&stats, runs[i].name);
+        if (!item)
+            break;
+        item->runs += runs[i].runs;
+        item->fails += runs[i].fails;
+        item->total_ms += runs[i].total_ms;
+    }
+
+    int ret = 0;
+    if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0)
+        ret = -1;
+    for (int i = 0; ret == 0 && i < stats.count; i++)
+    {
+        if (dprintf(fd, "%s %ld %ld %ld\n", stats.items[i].name, stats.items[i].runs,
+                    stats.items[i].fails, stats.items[i].total_ms) < 0)
+            ret = -1;
+    }
+    if (ret < 0)
+        perror("write stats failed");
+    test_stats_free(&stats);
+    close(fd);
+    return ret;
+}
+
+/**
+ * @brief compare ranked tests, higher score first, then by name
+ */
+static int compare_ranked(const void *a, const void *b)
+{
+    const ranked_test *x = a;
+    const ranked_test *y = b;
+    if (x->score != y->score)
+        return x->score > y->score ? -1 : 1;
+    return strcmp(x->name, y->name);
+}
+
+void test_stats_order(char **names, int count, const test_stats *stats)
+{
+    ranked_test *ranked = malloc(count * sizeof(ranked_test));
+    if (!ranked)
+        return;
+    for (int i = 0; i < count; i++)
+    {
+        const test_stat *item = test_stats_find(stats, names[i]);
+        long runs = item ? item->runs : 0;
+        long fails = item ? item->fails : 0;
+        // smoothed failure rate, so that unseen tests are neither first nor last
+        double fail_rate = (fails + 1.0) / (runs + 2.0);
+        double cost_ms = (runs ? (double)item->total_ms / runs : 0) + 1.0;
+        ranked[i].name = names[i];
+        ranked[i].score = fail_rate / cost_ms;
+    }
+    qsort(ranked, count, sizeof(ranked_test), compare_ranked);
+    for (int i = 0; i < count; i++)
+        names[i] = ranked[i].name;
+    free(ranked);
+}
+
+void test_stats_free(test_stats *stats)
+{
+    free(stats->items);
+    stats->items = NULL;
+    stats->count = 0;
+    stats->cap = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef TEST_STATS_H
+#define TEST_STATS_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+
+#define STATS_DIR "files/stats"
+#define TEST_NAME_SIZE 128
+
+/**
+ * @brief judging history of one test case
+ */
+typedef struct test_stat
+{
+    char name[TEST_NAME_SIZE]; // input file name (e.g. 01.in)
+    long runs;                 // number of judged runs
+    long fails;                // number of runs that were not Accepted
+    long total_ms;             // total execution time of the runs in ms
+} test_stat;
+
+/**
+ * @brief judging history of a problem
+ */
+typedef struct test_stats
+{
+    test_stat *items; // per-test history
+    int count;        // number of tests
+    int cap;          // capacity of items
+} test_stats;
+
+/**
+ * @brief Load the history of a problem, an empty history if there is none
+ * @param problem_dir test case directory
+ * @param stats history (output), freed with test_stats_free
+ * @return 0 on success, -1 on error
+ */
+int test_stats_load(const char *problem_dir, test_stats *stats);
+
+/**
+ * @brief Find the history of a test
+ * @param stats history
+ * @param name input file name
+ * @return history of the test, or NULL if the test was never judged
+ */
+const test_stat *test_stats_find(const test_stats *stats, const char *name);
+
+/**
+ * @brief Add runs to the history of a problem, under an exclusive file lock
+ * @param problem_dir test case directory
+ * @param runs runs to add, one entry per executed test
+ * @param count number of runs
+ * @return 0 on success, -1 on error
+ */
+int test_stats_update(const char *problem_dir, const test_stat *runs, int count);
+
+/**
+ * @brief Order tests so that the most often failing and cheapest ones come first
+ * @param names input file names, sorted in place
+ * @param count number of names
+ * @param stats history of the problem
+ */
+void test_stats_order(char **names, int count, const test_stats *stats);
+
+/**
+ * @brief Release a history
+ * @param stats history
+ */
+void test_stats_free(test_stats *stats);
+
+#endif // TEST_STATS_H
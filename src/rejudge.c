@@ -0,0 +1,600 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "store/submission_store.h"
+#include "sched/judge_sched.h"
+#include "cache/verdict_cache.h"
+#include "toolchain/toolchain.h"
+#include "util/sha256.h"
+#include "defineshit.h"
+
+#define VERDICT_DIR "files/verdicts" // last verdict of every rejudged submission, per problem
+#define VERDICT_SIZE 32              // verdict summary: the first line of the result
+#define JOBS_PER_WORKER 4            // jobs in flight per worker, bounds the sources held in memory
+#define PROGRESS_SECONDS 2
+
+/**
+ * @brief submission to rejudge
+ */
+typedef struct rejudge_sub
+{
+    unsigned char hash[SHA256_DIGEST_SIZE]; // hash of the language and the source, as in the verdict cache
+    uint64_t id;                            // submission ID
+    char verdict[VERDICT_SIZE];             // new verdict, empty until judged
+} rejudge_sub;
+
+/**
+ * @brief submissions with the same language and source, judged once
+ */
+typedef struct rejudge_group
+{
+    size_t first;  // index of the first submission, subs are sorted by hash
+    size_t count;  // number of submissions
+    cache_key key; // verdict cache key of the source
+} rejudge_group;
+
+/**
+ * @brief verdict recorded by an earlier rejudge
+ */
+typedef struct baseline_entry
+{
+    uint64_t id;                // submission ID
+    char verdict[VERDICT_SIZE]; // verdict summary
+} baseline_entry;
+
+static rejudge_sub *subs = NULL;
+static size_t n_subs = 0;
+static size_t subs_cap = 0;
+static rejudge_group *groups = NULL;
+static size_t n_groups = 0;
+static baseline_entry *baseline = NULL; // sorted by ID
+static size_t n_baseline = 0;
+
+static size_t in_flight = 0;     // jobs handed to the scheduler and not finished
+static size_t done_subs = 0;     // submissions with their new verdict
+static size_t done_groups = 0;   // sources with their new verdict
+static size_t cached_groups = 0; // sources answered by the verdict cache
+static size_t changed = 0;       // submissions whose verdict differs from the baseline
+static volatile sig_atomic_t stopping = 0;
+static FILE *diff_out = NULL; // the original stdout, the scheduler's log goes to stderr
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-j workers] [-C run_cpus] [-p test_dir] [-d store_dir] [-b baseline] all | <id> | <from>-[<to>]...\n",
+            prog);
+}
+
+static void sigchld_handler(int signo)
+{
+    (void)signo;
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+        ;
+}
+
+static void sigint_handler(int signo)
+{
+    (void)signo;
+    stopping = 1;
+}
+
+/**
+ * @brief compare submissions by source hash, then by ID
+ */
+static int compare_hash(const void *a, const void *b)
+{
+    const rejudge_sub *x = a, *y = b;
+    int c = memcmp(x->hash, y->hash, SHA256_DIGEST_SIZE);
+    if (c != 0)
+        return c;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/**
+ * @brief compare submissions by ID
+ */
+static int compare_id(const void *a, const void *b)
+{
+    const rejudge_sub *x = a, *y = b;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/**
+ * @brief compare baseline entries by ID
+ */
+static int compare_entry(const void *a, const void *b)
+{
+    const baseline_entry *x = a, *y = b;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+/**
+ * @brief compare a submission ID with a baseline entry
+ */
+static int compare_baseline(const void *key, const void *entry)
+{
+    uint64_t id = *(const uint64_t *)key;
+    const baseline_entry *e = entry;
+    return (id > e->id) - (id < e->id);
+}
+
+/**
+ * @brief find the toolchain a submission was stored with
+ * @param entry index entry
+ * @return toolchain, or NULL if the language is unknown
+ */
+static const toolchain *entry_toolchain(const store_entry *entry)
+{
+    char lang[STORE_LANG_SIZE + 1];
+    memcpy(lang, entry->lang, STORE_LANG_SIZE);
+    lang[STORE_LANG_SIZE] = '\0';
+    return toolchain_by_name(lang);
+}
+
+/**
+ * @brief add a stored submission to the set, hashing its source
+ * @param id submission ID
+ * @return 0 if added, -1 if it is not stored, was removed or has an unknown language
+ */
+static int add_submission(uint64_t id)
+{
+    char *source;
+    size_t len;
+    store_entry entry;
+    if (store_get(id, &source, &len, &entry) < 0)
+        return -1;
+    const toolchain *tc = entry_toolchain(&entry);
+    if (!tc)
+    {
+        fprintf(stderr, "submission %llu: unknown language %.8s\n", (unsigned long long)id, entry.lang);
+        free(source);
+        return -1;
+    }
+    if (n_subs == subs_cap)
+    {
+        size_t grown_cap = subs_cap ? subs_cap * 2 : 1024;
+        rejudge_sub *grown = realloc(subs, grown_cap * sizeof(rejudge_sub));
+        if (!grown)
+        {
+            free(source);
+            return -1;
+        }
+        subs = grown;
+        subs_cap = grown_cap;
+    }
+    rejudge_sub *sub = &subs[n_subs++];
+    memset(sub, 0, sizeof(*sub));
+    sub->id = id;
+    // same key as the server's, so verdicts are shared with the verdict cache
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, tc->name, strlen(tc->name) + 1);
+    sha256_update(&ctx, source, len);
+    sha256_final(&ctx, sub->hash);
+    free(source);
+    return 0;
+}
+
+/**
+ * @brief add the submissions named by an argument: all, an ID or a range of IDs
+ * @param arg argument
+ * @return 0 on success, -1 if the argument is invalid
+ */
+static int add_range(const char *arg)
+{
+    uint64_t last = store_last_id();
+    uint64_t from, to;
+    char *end;
+    if (strcmp(arg, "all") == 0)
+    {
+        from = 1;
+        to = last;
+    }
+    else
+    {
+        from = strtoull(arg, &end, 10);
+        to = from;
+        if (*end == '-')
+            to = end[1] ? strtoull(end + 1, &end, 10) : last;
+        if (end == arg || (*end && *end != '-') || from == 0)
+            return -1;
+    }
+    for (uint64_t id = from; id <= to && id <= last; id++)
+        add_submission(id);
+    return 0;
+}
+
+/**
+ * @brief sort the submissions by source and group identical ones
+ * @return 0 on success, -1 on error
+ */
+static int make_groups(void)
+{
+    qsort(subs, n_subs, sizeof(rejudge_sub), compare_hash);
+    // an ID named twice is judged once
+    size_t kept = 0;
+    for (size_t i = 0; i < n_subs; i++)
+    {
+        if (kept > 0 && subs[kept - 1].id == subs[i].id)
+            continue;
+        subs[kept++] = subs[i];
+    }
+    n_subs = kept;
+    groups = malloc((n_subs ? n_subs : 1) * sizeof(rejudge_group));
+    if (!groups)
+        return -1;
+    for (size_t i = 0; i < n_subs; i++)
+    {
+        if (n_groups > 0 && memcmp(subs[i].hash, subs[groups[n_groups - 1].first].hash, SHA256_DIGEST_SIZE) == 0)
+        {
+            groups[n_groups - 1].count++;
+            continue;
+        }
+        rejudge_group *g = &groups[n_groups++];
+        memset(g, 0, sizeof(*g));
+        g->first = i;
+        g->count = 1;
+        memcpy(g->key.source, subs[i].hash, SHA256_DIGEST_SIZE);
+    }
+    return 0;
+}
+
+/**
+ * @brief load the verdicts of the previous rejudge
+ * @param path baseline file, lines of "<id>\t<verdict>" sorted by ID
+ */
+static void load_baseline(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return;
+    size_t cap = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *tab = strchr(line, '\t');
+        if (!tab)
+            continue;
+        if (n_baseline == cap)
+        {
+            size_t grown_cap = cap ? cap * 2 : 1024;
+            baseline_entry *grown = realloc(baseline, grown_cap * sizeof(baseline_entry));
+            if (!grown)
+                break;
+            baseline = grown;
+            cap = grown_cap;
+        }
+        baseline_entry *e = &baseline[n_baseline++];
+        e->id = strtoull(line, NULL, 10);
+        tab[strcspn(tab, "\n")] = '\0';
+        snprintf(e->verdict, sizeof(e->verdict), "%s", tab + 1);
+    }
+    fclose(fp);
+    qsort(baseline, n_baseline, sizeof(baseline_entry), compare_entry);
+}
+
+/**
+ * @brief write the baseline back: the new verdicts, and the old ones of the
+ *      submissions that were not rejudged
+ * @param path baseline file
+ * @return 0 on success, -1 on error
+ */
+static int save_baseline(const char *path)
+{
+    char tmp[600];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+    {
+        perror("fopen baseline failed");
+        return -1;
+    }
+    qsort(subs, n_subs, sizeof(rejudge_sub), compare_id);
+    size_t i = 0, j = 0;
+    while (i < n_subs || j < n_baseline)
+    {
+        if (i < n_subs && !subs[i].verdict[0])
+        {
+            i++;
+            continue;
+        }
+        if (j < n_baseline && (i == n_subs || baseline[j].id < subs[i].id))
+        {
+            fprintf(fp, "%llu\t%s\n", (unsigned long long)baseline[j].id, baseline[j].verdict);
+            j++;
+            continue;
+        }
+        if (j < n_baseline && baseline[j].id == subs[i].id)
+            j++;
+        fprintf(fp, "%llu\t%s\n", (unsigned long long)subs[i].id, subs[i].verdict);
+        i++;
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0)
+    {
+        perror("write baseline failed");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief reduce a judge result to its first line, without time and memory
+ * @param result judge result
+ * @param verdict summary (output), VERDICT_SIZE bytes
+ */
+static void summarize(const char *result, char *verdict)
+{
+    while (*result == '\n')
+        result++;
+    size_t len = strcspn(result, "\n");
+    if (len > 0 && result[len - 1] == ':')
+        len--;
+    if (len > VERDICT_SIZE - 1)
+        len = VERDICT_SIZE - 1;
+    memcpy(verdict, result, len);
+    verdict[len] = '\0';
+    if (len == 0)
+        snprintf(verdict, VERDICT_SIZE, "Internal Error");
+}
+
+/**
+ * @brief verdict the server gave a submission that was never rejudged
+ * @param id submission ID
+ * @param verdict summary (output), VERDICT_SIZE bytes
+ * @return 0 if the server recorded one, -1 otherwise
+ */
+static int server_verdict(uint64_t id, char *verdict)
+{
+    // the first line is all that is compared
+    char result[VERDICT_SIZE * 2];
+    size_t len;
+    if (store_get_verdict(id, result, sizeof(result), &len) < 0)
+        return -1;
+    summarize(result, verdict);
+    return 0;
+}
+
+/**
+ * @brief take the verdict of a source for all of its submissions, printing the changed ones
+ * @param g group
+ * @param result judge result
+ */
+static void group_done(rejudge_group *g, const char *result)
+{
+    char verdict[VERDICT_SIZE];
+    summarize(result, verdict);
+    for (size_t i = g->first; i < g->first + g->count; i++)
+    {
+        rejudge_sub *sub = &subs[i];
+        memcpy(sub->verdict, verdict, VERDICT_SIZE);
+        const baseline_entry *old = bsearch(&sub->id, baseline, n_baseline, sizeof(baseline_entry), compare_baseline);
+        char served[VERDICT_SIZE];
+        const char *old_verdict = old ? old->verdict : (server_verdict(sub->id, served) == 0 ? served : NULL);
+        if (!old_verdict || strcmp(old_verdict, verdict) != 0)
+        {
+            fprintf(diff_out, "%llu\t%s\t%s\n", (unsigned long long)sub->id, old_verdict ? old_verdict : "-", verdict);
+            changed++;
+        }
+    }
+    // the diff is read as it comes
+    fflush(diff_out);
+    done_subs += g->count;
+    done_groups++;
+}
+
+/**
+ * @brief take the verdict of a finished job
+ * @param job finished job
+ */
+static void judge_done(judge_job *job)
+{
+    rejudge_group *g = job->owner;
+    if (verdict_cache_final(job->result))
+        verdict_cache_store(&g->key, job->result, job->result_len);
+    in_flight--;
+    group_done(g, job->result);
+}
+
+/**
+ * @brief judge a source, or answer it from the verdict cache
+ * @param g group
+ */
+static void submit_group(rejudge_group *g)
+{
+    char result[JUDGE_RESULT_SIZE];
+    size_t len;
+    if (verdict_cache_lookup(&g->key, result, sizeof(result), &len) == 0)
+    {
+        cached_groups++;
+        group_done(g, result);
+        return;
+    }
+    uint64_t id = subs[g->first].id;
+    char *source;
+    store_entry entry;
+    const toolchain *tc = NULL;
+    if (store_get(id, &source, &len, &entry) < 0 || !(tc = entry_toolchain(&entry)))
+    {
+        group_done(g, "Internal Error: (Source not found)");
+        return;
+    }
+    // named apart from the server's sub<id> so both can judge the same ID at once
+    char name[64];
+    snprintf(name, sizeof(name), "rejudge%llu%s", (unsigned long long)id, tc->extension);
+    judge_job *job = judge_job_create(name, judge_done, g);
+    if (!job)
+    {
+        free(source);
+        group_done(g, "Internal Error: (Could not start judge)");
+        return;
+    }
+    job->local_only = 1;
+    job->source = source;
+    job->source_len = len;
+    in_flight++;
+    judge_sched_submit(job);
+}
+
+/**
+ * @brief report progress on stderr
+ * @param start start time
+ * @param last time of the last report (in/out)
+ */
+static void progress(const struct timespec *start, time_t *last)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec - *last < PROGRESS_SECONDS)
+        return;
+    *last = now.tv_sec;
+    double elapsed = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+    fprintf(stderr, "%zu/%zu submissions, %zu changed, %.0f/s\n", done_subs, n_subs, changed,
+            elapsed > 0 ? done_subs / elapsed : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *store_dir = STORE_DIR;
+    const char *baseline_path = NULL;
+    sched_config config;
+    memset(&config, 0, sizeof(config));
+    config.problem_dir = DEFAULT_PROBLEM_DIR;
+    int workers = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:C:p:d:b:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            workers = atoi(optarg);
+            break;
+        case 'C':
+            config.run_cpus = optarg;
+            break;
+        case 'p':
+            config.problem_dir = optarg;
+            break;
+        case 'd':
+            store_dir = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (workers <= 0)
+        workers = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    // compiling and running overlap, every core stays busy
+    config.compile_workers = workers;
+    config.run_workers = workers;
+
+    if (store_open(store_dir) < 0)
+        return 1;
+    for (int i = optind; i < argc; i++)
+    {
+        if (add_range(argv[i]) < 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (make_groups() < 0)
+    {
+        perror("malloc failed");
+        return 1;
+    }
+
+    char default_path[128];
+    if (!baseline_path)
+    {
+        unsigned char digest[SHA256_DIGEST_SIZE];
+        char hex[SHA256_HEX_SIZE];
+        sha256_ctx ctx;
+        sha256_init(&ctx);
+        sha256_update(&ctx, config.problem_dir, strlen(config.problem_dir));
+        sha256_final(&ctx, digest);
+        sha256_hex(digest, hex);
+        if (mkdir(VERDICT_DIR, 0755) < 0 && errno != EEXIST)
+            perror("mkdir verdicts failed");
+        snprintf(default_path, sizeof(default_path), "%s/%.16s.tsv", VERDICT_DIR, hex);
+        baseline_path = default_path;
+    }
+    load_baseline(baseline_path);
+    fprintf(stderr, "Rejudging %zu submission(s), %zu distinct source(s), against %s\n", n_subs, n_groups,
+            config.problem_dir);
+
+    diff_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!diff_out || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+    {
+        perror("redirect stdout failed");
+        return 1;
+    }
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    signal(SIGCHLD, sigchld_handler);
+    signal(SIGPIPE, SIG_IGN);
+    // on SIGINT the baseline keeps what was judged, the jobs in flight are dropped
+    struct sigaction sa_int;
+    memset(&sa_int, 0, sizeof(sa_int));
+    sa_int.sa_handler = sigint_handler;
+    sigemptyset(&sa_int.sa_mask);
+    sigaction(SIGINT, &sa_int, NULL);
+    judge_sched_init(&config);
+    if (verdict_cache_init(config.problem_dir) < 0)
+        fprintf(stderr, "verdict cache unavailable\n");
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    time_t last_report = start.tv_sec;
+    size_t next = 0;
+    size_t window = (size_t)workers * JOBS_PER_WORKER;
+    while (!stopping && (next < n_groups || in_flight > 0))
+    {
+        while (in_flight < window && next < n_groups)
+            submit_group(&groups[next++]);
+        if (in_flight == 0)
+            continue;
+
+        fd_set read_fds, write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        int max_fd = -1;
+        judge_sched_fill_fds(&read_fds, &write_fds, &max_fd);
+        struct timeval timeout = {1, 0};
+        if (select(max_fd + 1, &read_fds, &write_fds, NULL, &timeout) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("select failed");
+            break;
+        }
+        judge_sched_handle(&read_fds, &write_fds);
+        progress(&start, &last_report);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "Rejudged %zu/%zu submission(s) in %.1f s: %zu source(s) judged, %zu from the cache, %zu changed\n",
+            done_subs, n_subs, elapsed, done_groups - cached_groups, cached_groups, changed);
+
+    int ret = save_baseline(baseline_path) < 0 || stopping;
+    store_close();
+    free(subs);
+    free(groups);
+    free(baseline);
+    fclose(diff_out);
+    return ret;
+}
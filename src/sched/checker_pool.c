@@ -0,0 +1,149 @@
+#include "checker_pool.h"
+#include "../judge/checker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+
+static resident_checker checkers[MAX_RESIDENT_CHECKERS];
+static int n_checkers = 0;
+static char checker_path[512];
+
+/**
+ * @brief stop a checker, its exit is reaped by the SIGCHLD handler
+ * @param chk checker
+ */
+static void stop_checker(resident_checker *chk)
+{
+    if (chk->pid > 0)
+        kill(chk->pid, SIGKILL);
+    if (chk->request_fd >= 0)
+        close(chk->request_fd);
+    if (chk->reply_fd >= 0)
+        close(chk->reply_fd);
+    chk->pid = 0;
+    chk->request_fd = -1;
+    chk->reply_fd = -1;
+}
+
+/**
+ * @brief start a checker process
+ * @param chk checker
+ * @return 0 on success, -1 on error
+ */
+static int start_checker(resident_checker *chk)
+{
+    int request[2], reply[2];
+    // the server's ends stay out of judges and other checkers, run stages get them explicitly
+    if (pipe2(request, O_CLOEXEC) < 0)
+    {
+        perror("pipe failed");
+        return -1;
+    }
+    if (pipe2(reply, O_CLOEXEC) < 0)
+    {
+        perror("pipe failed");
+        close(request[0]);
+        close(request[1]);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        close(request[0]);
+        close(request[1]);
+        close(reply[0]);
+        close(reply[1]);
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        if (dup2(request[0], STDIN_FILENO) < 0 || dup2(reply[1], STDOUT_FILENO) < 0)
+        {
+            perror("dup2 failed");
+            _exit(1);
+        }
+        // no client socket or listener may outlive the server in a checker
+        close_range(3, ~0u, 0);
+        execl(checker_path, CHECKER_FILE, (char *)NULL);
+        perror("execl checker failed");
+        _exit(1);
+    }
+    close(request[0]);
+    close(reply[1]);
+    chk->pid = pid;
+    chk->request_fd = request[1];
+    chk->reply_fd = reply[0];
+    return 0;
+}
+
+/**
+ * @brief check that an idle checker is still usable: it has not exited and has no
+ *      reply pending for a run stage that died mid-check
+ * @param chk idle checker
+ * @return 1 if usable, 0 otherwise
+ */
+static int checker_idle_ok(const resident_checker *chk)
+{
+    struct pollfd pfd = {.fd = chk->reply_fd, .events = POLLIN};
+    return chk->pid > 0 && poll(&pfd, 1, 0) == 0;
+}
+
+void checker_pool_init(const char *problem_dir, int size)
+{
+    snprintf(checker_path, sizeof(checker_path), "%s/%s", problem_dir, CHECKER_FILE);
+    n_checkers = 0;
+    if (access(checker_path, X_OK) < 0)
+        return;
+    n_checkers = size < MAX_RESIDENT_CHECKERS ? size : MAX_RESIDENT_CHECKERS;
+    for (int i = 0; i < n_checkers; i++)
+    {
+        memset(&checkers[i], 0, sizeof(checkers[i]));
+        checkers[i].request_fd = -1;
+        checkers[i].reply_fd = -1;
+    }
+    printf("Resident checker: %s (%d)\n", checker_path, n_checkers);
+}
+
+int checker_pool_take(int *request_fd, int *reply_fd)
+{
+    for (int i = 0; i < n_checkers; i++)
+    {
+        resident_checker *chk = &checkers[i];
+        if (chk->busy)
+            continue;
+        if (!checker_idle_ok(chk))
+        {
+            stop_checker(chk);
+            if (start_checker(chk) < 0)
+                return -1;
+        }
+        chk->busy = 1;
+        *request_fd = chk->request_fd;
+        *reply_fd = chk->reply_fd;
+        return i;
+    }
+    return -1;
+}
+
+void checker_pool_release(int index)
+{
+    if (index >= 0 && index < n_checkers)
+        checkers[index].busy = 0;
+}
+
+void checker_pool_restart(int index)
+{
+    if (index < 0 || index >= n_checkers)
+        return;
+    resident_checker *chk = &checkers[index];
+    stop_checker(chk);
+    // on failure the next checker_pool_take tries again
+    start_checker(chk);
+    chk->busy = 0;
+}
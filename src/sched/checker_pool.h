@@ -0,0 +1,48 @@
+#ifndef CHECKER_POOL_H
+#define CHECKER_POOL_H
+
+#include "../defineshit.h"
+#include <sys/types.h>
+
+#define MAX_RESIDENT_CHECKERS 64
+
+/**
+ * @brief checker process kept running between run stages
+ */
+typedef struct resident_checker
+{
+    pid_t pid;      // checker process, 0 until started
+    int request_fd; // write end of the checker's stdin
+    int reply_fd;   // read end of the checker's stdout
+    int busy;       // lent to a run stage
+} resident_checker;
+
+/**
+ * @brief Look for the checker of the problem, the processes start on first use
+ * @param problem_dir test case directory
+ * @param size number of checkers, one per run worker
+ */
+void checker_pool_init(const char *problem_dir, int size);
+
+/**
+ * @brief Lend an idle checker to a run stage, restarting it if it exited
+ * @param request_fd write end of the checker's stdin (output)
+ * @param reply_fd read end of the checker's stdout (output)
+ * @return checker index, or -1 if the problem has no checker or none could start
+ */
+int checker_pool_take(int *request_fd, int *reply_fd);
+
+/**
+ * @brief Give a checker back once its run stage finished
+ * @param index checker index returned by checker_pool_take, -1 for none
+ */
+void checker_pool_release(int index);
+
+/**
+ * @brief Replace a checker whose run stage ended without a final verdict: it may be
+ *      stuck, or still waiting for the rest of a request the stage never finished
+ * @param index checker index returned by checker_pool_take, -1 for none
+ */
+void checker_pool_restart(int index);
+
+#endif // CHECKER_POOL_H
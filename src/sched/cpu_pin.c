@@ -0,0 +1,206 @@
+#include "cpu_pin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static cpu_set_t reserved;  // CPUs given to run stages
+static cpu_set_t taken;     // reserved CPUs with a run stage pinned to them
+static int enabled = 0;     // 1 once CPUs are reserved
+
+/**
+ * @brief parse a kernel CPU list such as "0-3,8,10-11"
+ * @param list CPU list
+ * @param set CPUs (output)
+ * @return 0 on success, -1 if the list is malformed
+ */
+static int parse_cpulist(const char *list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    const char *p = list;
+    while (*p && !isspace((unsigned char)*p))
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return -1;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return -1;
+            p = end;
+        }
+        if (last >= CPU_SETSIZE)
+            return -1;
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+        if (*p == ',')
+            p++;
+        else if (*p && !isspace((unsigned char)*p))
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief read a CPU list from sysfs
+ * @param path sysfs file
+ * @param set CPUs (output)
+ * @return 0 on success, -1 on error
+ */
+static int read_cpulist(const char *path, cpu_set_t *set)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+    {
+        perror(path);
+        return -1;
+    }
+    char line[4096] = "";
+    if (!fgets(line, sizeof(line), fp))
+        line[0] = '\0';
+    fclose(fp);
+    if (parse_cpulist(line, set) < 0)
+    {
+        fprintf(stderr, "%s: invalid CPU list\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief print a CPU set as a list
+ * @param set CPUs
+ */
+static void print_cpus(const cpu_set_t *set)
+{
+    const char *sep = "";
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, set))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+            last++;
+        if (last > cpu)
+            printf("%s%d-%d", sep, cpu, last);
+        else
+            printf("%s%d", sep, cpu);
+        sep = ",";
+        cpu = last;
+    }
+}
+
+int cpu_pin_init(const char *spec, int *run_workers)
+{
+    int node;
+    if (strcmp(spec, "isolated") == 0)
+    {
+        if (read_cpulist(CPU_ISOLATED_PATH, &reserved) < 0)
+            return -1;
+    }
+    else if (sscanf(spec, "node%d", &node) == 1)
+    {
+        char path[128];
+        snprintf(path, sizeof(path), NODE_CPULIST_PATH, node);
+        if (read_cpulist(path, &reserved) < 0)
+            return -1;
+    }
+    else if (parse_cpulist(spec, &reserved) < 0)
+    {
+        fprintf(stderr, "invalid CPU list: %s\n", spec);
+        return -1;
+    }
+
+    // isolated CPUs are outside the default affinity, so check against the online ones
+    cpu_set_t online;
+    if (read_cpulist(CPU_ONLINE_PATH, &online) < 0)
+        return -1;
+    CPU_AND(&reserved, &reserved, &online);
+    int count = CPU_COUNT(&reserved);
+    if (count == 0)
+    {
+        fprintf(stderr, "no online CPU in %s\n", spec);
+        return -1;
+    }
+    if (*run_workers <= 0 || *run_workers > count)
+        *run_workers = count;
+    CPU_ZERO(&taken);
+    enabled = 1;
+
+    // the server, its threads and the compile stages keep to the other CPUs
+    cpu_set_t rest;
+    if (sched_getaffinity(0, sizeof(rest), &rest) < 0)
+    {
+        perror("sched_getaffinity failed");
+        return -1;
+    }
+    // drop the reserved CPUs from the affinity; isolated ones were never in it
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &reserved))
+            CPU_CLR(cpu, &rest);
+    }
+    CPU_AND(&rest, &rest, &online);
+    printf("Run stages pinned to CPUs ");
+    print_cpus(&reserved);
+    if (CPU_COUNT(&rest) == 0)
+    {
+        printf(", no CPU left for the server, it shares them\n");
+        return 0;
+    }
+    printf(", server on CPUs ");
+    print_cpus(&rest);
+    printf("\n");
+    if (sched_setaffinity(0, sizeof(rest), &rest) < 0)
+    {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+    return 0;
+}
+
+int cpu_pin_take(void)
+{
+    if (!enabled)
+        return -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &reserved) && !CPU_ISSET(cpu, &taken))
+        {
+            CPU_SET(cpu, &taken);
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+int cpu_pin_claim(int cpu)
+{
+    if (!enabled || cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &reserved) || CPU_ISSET(cpu, &taken))
+        return -1;
+    CPU_SET(cpu, &taken);
+    return cpu;
+}
+
+void cpu_pin_release(int cpu)
+{
+    if (cpu >= 0 && cpu < CPU_SETSIZE)
+        CPU_CLR(cpu, &taken);
+}
+
+int cpu_pin_self(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    {
+        perror("sched_setaffinity failed");
+        return -1;
+    }
+    return 0;
+}
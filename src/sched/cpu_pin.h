@@ -0,0 +1,47 @@
+#ifndef CPU_PIN_H
+#define CPU_PIN_H
+
+#include "../defineshit.h"
+#include <sched.h>
+
+#define CPU_ISOLATED_PATH "/sys/devices/system/cpu/isolated"
+#define CPU_ONLINE_PATH "/sys/devices/system/cpu/online"
+#define NODE_CPULIST_PATH "/sys/devices/system/node/node%d/cpulist"
+
+/**
+ * @brief Reserve CPUs for the run stages and move this process to the others
+ * @param spec "isolated" for the kernel's isolated CPUs, "node<N>" for the CPUs of a NUMA
+ *      node, or a CPU list such as "2-5,8"
+ * @param run_workers number of run workers, lowered to the number of reserved CPUs and
+ *      set to it if 0 (in/out)
+ * @return 0 on success, -1 on error
+ */
+int cpu_pin_init(const char *spec, int *run_workers);
+
+/**
+ * @brief Give a run stage a reserved CPU of its own
+ * @return CPU number, or -1 if pinning is off or every reserved CPU is taken
+ */
+int cpu_pin_take(void);
+
+/**
+ * @brief Mark the CPU of a run stage handed over by the previous server as taken
+ * @param cpu CPU the stage was pinned to, -1 for none
+ * @return cpu if it is reserved here and was free, -1 otherwise
+ */
+int cpu_pin_claim(int cpu);
+
+/**
+ * @brief Free the CPU of a finished run stage
+ * @param cpu CPU returned by cpu_pin_take or cpu_pin_claim, -1 for none
+ */
+void cpu_pin_release(int cpu);
+
+/**
+ * @brief Pin the calling process to one CPU, in the child of a run stage before exec
+ * @param cpu CPU number
+ * @return 0 on success, -1 on error
+ */
+int cpu_pin_self(int cpu);
+
+#endif // CPU_PIN_H
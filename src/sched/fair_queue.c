@@ -0,0 +1,464 @@
+#include "fair_queue.h"
+#include "../judge/test_stats.h"
+#include "../toolchain/toolchain.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#define USER_BUCKETS 256
+#define EWMA_WEIGHT 0.25 // weight of the latest measured stage time in a prediction
+#define MAX_LANGS 8
+
+/**
+ * @brief queues and history of one user
+ */
+typedef struct fair_user
+{
+    uint32_t id;                      // client IPv4 address in network order, 0 for local jobs
+    judge_job *head[FAIR_STAGES];     // queued jobs per stage, cheapest first
+    int queued[FAIR_STAGES];          // number of queued jobs per stage
+    double served[FAIR_STAGES];       // ms of service charged so far per stage
+    int heap_pos[FAIR_STAGES];        // index in the heap of the stage while jobs are queued
+    double run_scale;                 // measured run stage time over the prediction for the language
+    int run_samples;                  // run stages measured, 0 to use the language's prediction as is
+    int64_t last_seen;                // when a job of the user was last queued or finished
+    int32_t waits[FAIR_WAIT_SAMPLES]; // latest queue waits in ms, a ring
+    long n_waits;                     // waits recorded so far
+    struct fair_user *hash_next;      // next user in the same bucket
+    struct fair_user *next;           // next user in creation order
+} fair_user;
+
+/**
+ * @brief predicted stage times of a language
+ */
+typedef struct lang_cost
+{
+    const toolchain *tc; // language
+    double compile_ms;   // predicted compile stage time
+    double run_ms;       // predicted run stage time
+} lang_cost;
+
+static fair_user *buckets[USER_BUCKETS];
+static fair_user *users = NULL;       // users with recent jobs, in creation order
+static fair_user **users_tail = &users;
+static int n_users = 0;
+static fair_user local_user;          // jobs without a client, and users that could not be allocated
+static fair_user **heap[FAIR_STAGES]; // users with queued jobs per stage, a min-heap on served
+static int heap_len[FAIR_STAGES];
+static int heap_cap = 0;              // slots of each heap, one per user so a push never fails
+static int queued[FAIR_STAGES];       // number of queued jobs per stage
+static double vclock[FAIR_STAGES];    // service of the user picked last, idle users resume from it
+static double problem_run_ms = FAIR_DEFAULT_COST_MS; // predicted run stage time of the problem
+static lang_cost langs[MAX_LANGS];
+static int n_langs = 0;
+static int32_t global_waits[FAIR_GLOBAL_SAMPLES]; // latest queue waits over all users, a ring
+static long n_global_waits = 0;
+static int32_t sorted[FAIR_GLOBAL_SAMPLES];       // scratch for the percentiles
+
+/**
+ * @brief lookup table bucket of a user
+ * @param id client IPv4 address
+ * @return bucket
+ */
+static fair_user **bucket_of(uint32_t id)
+{
+    return &buckets[(id ^ (id >> 8) ^ (id >> 16) ^ (id >> 24)) % USER_BUCKETS];
+}
+
+/**
+ * @brief add a user to the lookup table and the creation order, with a slot in each heap
+ * @param u user
+ * @return 0 on success, -1 if the heaps cannot grow
+ */
+static int link_user(fair_user *u)
+{
+    if (n_users == heap_cap)
+    {
+        int cap = heap_cap ? heap_cap * 2 : 64;
+        for (int stage = 0; stage < FAIR_STAGES; stage++)
+        {
+            fair_user **grown = realloc(heap[stage], cap * sizeof(fair_user *));
+            if (!grown)
+            {
+                perror("realloc failed");
+                return -1;
+            }
+            heap[stage] = grown;
+        }
+        heap_cap = cap;
+    }
+    fair_user **b = bucket_of(u->id);
+    u->hash_next = *b;
+    *b = u;
+    u->next = NULL;
+    *users_tail = u;
+    users_tail = &u->next;
+    n_users++;
+    return 0;
+}
+
+/**
+ * @brief find the user of a job, creating it on first sight
+ * @param job job, re-keyed to the local user if no memory is left for a new one
+ * @return user
+ */
+static fair_user *user_of(judge_job *job)
+{
+    uint32_t id = job->user;
+    fair_user *u;
+    for (u = *bucket_of(id); u; u = u->hash_next)
+    {
+        if (u->id == id)
+            break;
+    }
+    if (!u)
+    {
+        u = calloc(1, sizeof(fair_user));
+        if (!u)
+            perror("malloc failed");
+        else
+            u->id = id;
+        if (u && link_user(u) < 0)
+        {
+            free(u);
+            u = NULL;
+        }
+        if (!u)
+        {
+            job->user = 0;
+            u = &local_user;
+        }
+    }
+    u->last_seen = fair_now_ms();
+    return u;
+}
+
+/**
+ * @brief place a user in the heap of a stage
+ */
+static void heap_set(int stage, int i, fair_user *u)
+{
+    heap[stage][i] = u;
+    u->heap_pos[stage] = i;
+}
+
+/**
+ * @brief move a user towards the root of the heap while it has less service than its parent
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ * @param i index of the user
+ */
+static void sift_up(int stage, int i)
+{
+    fair_user *u = heap[stage][i];
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (heap[stage][parent]->served[stage] <= u->served[stage])
+            break;
+        heap_set(stage, i, heap[stage][parent]);
+        i = parent;
+    }
+    heap_set(stage, i, u);
+}
+
+/**
+ * @brief move a user towards the leaves of the heap while a child has less service
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ * @param i index of the user
+ */
+static void sift_down(int stage, int i)
+{
+    fair_user *u = heap[stage][i];
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= heap_len[stage])
+            break;
+        if (child + 1 < heap_len[stage] && heap[stage][child + 1]->served[stage] < heap[stage][child]->served[stage])
+            child++;
+        if (heap[stage][child]->served[stage] >= u->served[stage])
+            break;
+        heap_set(stage, i, heap[stage][child]);
+        i = child;
+    }
+    heap_set(stage, i, u);
+}
+
+/**
+ * @brief take a user whose last job of a stage left the queue out of its heap
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ * @param u user
+ */
+static void heap_delete(int stage, fair_user *u)
+{
+    int i = u->heap_pos[stage];
+    fair_user *last = heap[stage][--heap_len[stage]];
+    if (last == u)
+        return;
+    heap_set(stage, i, last);
+    sift_up(stage, i);
+    sift_down(stage, last->heap_pos[stage]);
+}
+
+/**
+ * @brief forget the users that have nothing queued and no job queued or finished for
+ *      FAIR_USER_IDLE_MS, so the table does not grow with every client ever seen
+ */
+static void drop_idle_users(void)
+{
+    int64_t now = fair_now_ms();
+    fair_user **p = &users;
+    users_tail = &users;
+    while (*p)
+    {
+        fair_user *u = *p;
+        if (u == &local_user || u->queued[FAIR_COMPILE] || u->queued[FAIR_RUN] ||
+            now - u->last_seen < FAIR_USER_IDLE_MS)
+        {
+            p = &u->next;
+            users_tail = p;
+            continue;
+        }
+        *p = u->next;
+        fair_user **b = bucket_of(u->id);
+        while (*b != u)
+            b = &(*b)->hash_next;
+        *b = u->hash_next;
+        n_users--;
+        // a job still running comes back as a new user resuming from the current service
+        free(u);
+    }
+}
+
+/**
+ * @brief predicted stage times of the language of a job
+ * @param job job
+ * @return predictions, updated in place once a stage is measured
+ */
+static lang_cost *lang_of(const judge_job *job)
+{
+    const toolchain *tc = toolchain_by_path(job->source_filename);
+    if (!tc)
+        tc = toolchain_default();
+    for (int i = 0; i < n_langs; i++)
+    {
+        if (langs[i].tc == tc)
+            return &langs[i];
+    }
+    if (n_langs == MAX_LANGS)
+        return &langs[0];
+    langs[n_langs].tc = tc;
+    langs[n_langs].compile_ms = FAIR_DEFAULT_COST_MS;
+    langs[n_langs].run_ms = problem_run_ms;
+    return &langs[n_langs++];
+}
+
+void fair_init(const char *problem_dir)
+{
+    if (link_user(&local_user) < 0)
+        exit(EXIT_FAILURE);
+    // every test of an accepted solution runs once: the sum of their mean times
+    test_stats stats;
+    if (test_stats_load(problem_dir, &stats) < 0)
+        return;
+    double sum = 0;
+    int measured = 0;
+    for (int i = 0; i < stats.count; i++)
+    {
+        if (stats.items[i].runs > 0)
+        {
+            sum += (double)stats.items[i].total_ms / stats.items[i].runs;
+            measured++;
+        }
+    }
+    test_stats_free(&stats);
+    if (measured > 0)
+        problem_run_ms = sum;
+}
+
+int64_t fair_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void fair_push(judge_job *job, int stage)
+{
+    fair_user *u = user_of(job);
+    lang_cost *lang = lang_of(job);
+    if (stage == FAIR_COMPILE)
+        job->cost_ms = lang->compile_ms;
+    else
+        job->cost_ms = lang->run_ms * (u->run_samples ? u->run_scale : 1.0);
+    if (!u->queued[stage])
+    {
+        // an idle user does not bank the time it was away
+        if (u->served[stage] < vclock[stage])
+            u->served[stage] = vclock[stage];
+        heap_set(stage, heap_len[stage]++, u);
+        sift_up(stage, u->heap_pos[stage]);
+    }
+    judge_job **p = &u->head[stage];
+    while (*p && (*p)->cost_ms <= job->cost_ms)
+        p = &(*p)->next;
+    job->next = *p;
+    *p = job;
+    u->queued[stage]++;
+    queued[stage]++;
+}
+
+judge_job *fair_pop(int stage)
+{
+    if (!queued[stage])
+        return NULL;
+    fair_user *pick = heap[stage][0];
+    judge_job *job = pick->head[stage];
+    pick->head[stage] = job->next;
+    job->next = NULL;
+    pick->queued[stage]--;
+    queued[stage]--;
+    vclock[stage] = pick->served[stage];
+    pick->served[stage] += job->cost_ms;
+    if (pick->queued[stage])
+        sift_down(stage, 0);
+    else
+        heap_delete(stage, pick);
+    job->waited_ms += fair_now_ms() - job->queued_at;
+    return job;
+}
+
+int fair_remove(judge_job *job, int stage)
+{
+    fair_user *u = user_of(job);
+    for (judge_job **p = &u->head[stage]; *p; p = &(*p)->next)
+    {
+        if (*p == job)
+        {
+            *p = job->next;
+            job->next = NULL;
+            u->queued[stage]--;
+            queued[stage]--;
+            if (!u->queued[stage])
+                heap_delete(stage, u);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int fair_queued(int stage)
+{
+    return queued[stage];
+}
+
+void fair_stage_done(judge_job *job, int stage, int64_t elapsed_ms)
+{
+    fair_user *u = user_of(job);
+    u->served[stage] += elapsed_ms - job->cost_ms;
+    if (u->queued[stage])
+    {
+        sift_up(stage, u->heap_pos[stage]);
+        sift_down(stage, u->heap_pos[stage]);
+    }
+    lang_cost *lang = lang_of(job);
+    if (stage == FAIR_COMPILE)
+    {
+        lang->compile_ms += EWMA_WEIGHT * (elapsed_ms - lang->compile_ms);
+        return;
+    }
+    // the user's solutions are predicted relative to the language, not to each other
+    double scale = elapsed_ms / (lang->run_ms > 1 ? lang->run_ms : 1);
+    u->run_scale = u->run_samples ? u->run_scale + EWMA_WEIGHT * (scale - u->run_scale) : scale;
+    u->run_samples++;
+    lang->run_ms += EWMA_WEIGHT * (elapsed_ms - lang->run_ms);
+    // seeds the languages seen later
+    problem_run_ms += EWMA_WEIGHT * (elapsed_ms - problem_run_ms);
+}
+
+void fair_job_done(judge_job *job)
+{
+    // answered by a judge node without queueing here
+    if (!job->queued_at)
+        return;
+    int32_t wait = job->waited_ms > INT32_MAX ? INT32_MAX : (int32_t)job->waited_ms;
+    fair_user *u = user_of(job);
+    u->waits[u->n_waits++ % FAIR_WAIT_SAMPLES] = wait;
+    global_waits[n_global_waits++ % FAIR_GLOBAL_SAMPLES] = wait;
+    if (n_global_waits % FAIR_REPORT_JOBS == 0)
+        drop_idle_users();
+}
+
+/**
+ * @brief qsort comparator for waits
+ */
+static int compare_waits(const void *a, const void *b)
+{
+    int32_t x = *(const int32_t *)a;
+    int32_t y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief median and p99 of the waits kept in a ring
+ * @param ring waits
+ * @param n waits recorded so far
+ * @param cap size of the ring
+ * @param p50 median in ms (output)
+ * @param p99 99th percentile in ms (output)
+ * @return number of waits the percentiles are over
+ */
+static int percentiles(const int32_t *ring, long n, int cap, int32_t *p50, int32_t *p99)
+{
+    int m = n < cap ? (int)n : cap;
+    memcpy(sorted, ring, m * sizeof(int32_t));
+    qsort(sorted, m, sizeof(int32_t), compare_waits);
+    *p50 = sorted[(m - 1) / 2];
+    *p99 = sorted[(99 * m + 99) / 100 - 1];
+    return m;
+}
+
+/**
+ * @brief qsort comparator putting the users with the most finished jobs first
+ */
+static int compare_busiest(const void *a, const void *b)
+{
+    long x = (*(fair_user *const *)a)->n_waits;
+    long y = (*(fair_user *const *)b)->n_waits;
+    return (x < y) - (x > y);
+}
+
+void fair_report(FILE *out)
+{
+    if (!n_global_waits)
+        return;
+    int32_t p50, p99;
+    int m = percentiles(global_waits, n_global_waits, FAIR_GLOBAL_SAMPLES, &p50, &p99);
+    fprintf(out, "Queue wait: p50 %d ms, p99 %d ms over the last %d jobs\n", p50, p99, m);
+
+    int n_users = 0;
+    for (fair_user *u = users; u; u = u->next)
+        n_users += (u->n_waits > 0);
+    fair_user **busiest = malloc(n_users * sizeof(fair_user *));
+    if (!busiest)
+        return;
+    int i = 0;
+    for (fair_user *u = users; u; u = u->next)
+    {
+        if (u->n_waits > 0)
+            busiest[i++] = u;
+    }
+    qsort(busiest, n_users, sizeof(fair_user *), compare_busiest);
+    for (i = 0; i < n_users && i < FAIR_REPORT_USERS; i++)
+    {
+        fair_user *u = busiest[i];
+        char name[INET_ADDRSTRLEN] = "local";
+        if (u->id)
+            inet_ntop(AF_INET, &u->id, name, sizeof(name));
+        m = percentiles(u->waits, u->n_waits, FAIR_WAIT_SAMPLES, &p50, &p99);
+        fprintf(out, "  %s: p50 %d ms, p99 %d ms over the last %d jobs, %d queued\n", name, p50, p99, m,
+                u->queued[FAIR_COMPILE] + u->queued[FAIR_RUN]);
+    }
+    free(busiest);
+}
@@ -0,0 +1,90 @@
+#ifndef FAIR_QUEUE_H
+#define FAIR_QUEUE_H
+
+#include "../defineshit.h"
+#include "judge_sched.h"
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Fair-share queues in front of the compile and run workers. Every user (client address)
+ * has its own queue per stage, ordered by predicted cost. The next job comes from the
+ * user with the least service so far, counted in predicted ms and corrected by the
+ * measured stage time once the stage ends. Only users with queued jobs are in the
+ * min-heap a job is picked from.
+ */
+
+#define FAIR_COMPILE 0
+#define FAIR_RUN 1
+#define FAIR_STAGES 2
+#define FAIR_WAIT_SAMPLES 256     // latest queue waits kept per user for the p99
+#define FAIR_GLOBAL_SAMPLES 4096  // latest queue waits kept over all users
+#define FAIR_DEFAULT_COST_MS 500  // predicted stage time before anything was measured
+#define FAIR_REPORT_JOBS 200      // finished jobs between two wait reports
+#define FAIR_REPORT_USERS 8       // users listed in a report, the busiest first
+#define FAIR_USER_IDLE_MS 600000  // users with nothing queued and no job for this long are forgotten
+
+/**
+ * @brief Seed the predicted run stage time of the problem from its test history
+ *      (test count x mean run time of each test)
+ * @param problem_dir test case directory
+ */
+void fair_init(const char *problem_dir);
+
+/**
+ * @brief Current time of the queue and stage timestamps
+ * @return CLOCK_MONOTONIC time in ms
+ */
+int64_t fair_now_ms(void);
+
+/**
+ * @brief Queue a job behind the cheaper jobs of its user, predicting the cost of the stage
+ * @param job job to queue, job->user set
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ */
+void fair_push(judge_job *job, int stage);
+
+/**
+ * @brief Take the cheapest job of the user with the least service and charge its cost
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ * @return job, or NULL if nothing is queued
+ */
+judge_job *fair_pop(int stage);
+
+/**
+ * @brief Remove a queued job
+ * @param job job to remove
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ * @return 1 if the job was queued, 0 otherwise
+ */
+int fair_remove(judge_job *job, int stage);
+
+/**
+ * @brief Number of queued jobs
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ * @return number of jobs
+ */
+int fair_queued(int stage);
+
+/**
+ * @brief Replace the predicted cost of a finished stage by its measured time and
+ *      learn from it for later predictions
+ * @param job job whose stage ended
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ * @param elapsed_ms measured stage time
+ */
+void fair_stage_done(judge_job *job, int stage, int64_t elapsed_ms);
+
+/**
+ * @brief Record the queue wait of a finished job
+ * @param job finished job
+ */
+void fair_job_done(judge_job *job);
+
+/**
+ * @brief Print the p99 queue wait over all users and of the busiest users
+ * @param out output stream
+ */
+void fair_report(FILE *out);
+
+#endif // FAIR_QUEUE_H
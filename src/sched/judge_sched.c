@@ -0,0 +1,842 @@
+#include "judge_sched.h"
+#include "checker_pool.h"
+#include "cpu_pin.h"
+#include "result_slots.h"
+#include "fair_queue.h"
+#include "../judge/bench.h"
+#include <sys/timerfd.h>
+
+#define JUDGE_START_ERROR "Internal Error: (Could not start judge)\n"
+#define JUDGE_LOST_ERROR "Internal Error: (Judge exited without a result)\n"
+#define BENCH_MAX_DEFER_MS 10000 // a bench stage waits this long at most for the run queue to empty
+
+/**
+ * @brief FIFO queue of jobs
+ */
+typedef struct job_queue
+{
+    judge_job *head;
+    judge_job *tail;
+} job_queue;
+
+static sched_config sched_cfg;
+static job_queue bench_queue;     // accepted, waiting for an idle run worker to time it
+static judge_job *active = NULL;  // jobs with a running stage process
+static int compiling = 0;         // number of running compile stages
+static int running = 0;           // number of running run and bench stages
+static int benching = 0;          // number of running bench stages
+static int bench_enabled = 0;     // 1 if the problem is timed over repeated runs
+static long finished = 0;         // jobs reported to their owner
+static int node_timer_fd = -1;    // timerfd, expires at the earliest reply deadline of a dispatched job
+static int64_t node_timer_at = 0; // deadline the timer is armed for, 0 if disarmed
+
+/**
+ * @brief append a job to the queue
+ * @param q queue
+ * @param job job to append
+ */
+static void queue_push(job_queue *q, judge_job *job)
+{
+    job->next = NULL;
+    if (q->tail)
+        q->tail->next = job;
+    else
+        q->head = job;
+    q->tail = job;
+}
+
+/**
+ * @brief take the first job from the queue
+ * @param q queue
+ * @return first job, or NULL if the queue is empty
+ */
+static judge_job *queue_pop(job_queue *q)
+{
+    judge_job *job = q->head;
+    if (job)
+    {
+        q->head = job->next;
+        if (!q->head)
+            q->tail = NULL;
+        job->next = NULL;
+    }
+    return job;
+}
+
+/**
+ * @brief remove a job from the queue
+ * @param q queue
+ * @param job job to remove
+ * @return 1 if the job was queued, 0 otherwise
+ */
+static int queue_remove(job_queue *q, judge_job *job)
+{
+    judge_job *prev = NULL;
+    for (judge_job *cur = q->head; cur; prev = cur, cur = cur->next)
+    {
+        if (cur == job)
+        {
+            if (prev)
+                prev->next = cur->next;
+            else
+                q->head = cur->next;
+            if (q->tail == cur)
+                q->tail = prev;
+            cur->next = NULL;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief remove a job from the active list
+ * @param job job to remove
+ */
+static void active_remove(judge_job *job)
+{
+    judge_job **p = &active;
+    while (*p)
+    {
+        if (*p == job)
+        {
+            *p = job->next;
+            break;
+        }
+        p = &(*p)->next;
+    }
+    job->next = NULL;
+}
+
+/**
+ * @brief remove the executable a compile stage left behind
+ * @param job job whose executable is removed
+ */
+static void remove_executable(judge_job *job)
+{
+    // same naming as the judge: temp/<base name without extension>
+    const char *base = strrchr(job->source_filename, '/');
+    base = base ? base + 1 : job->source_filename;
+    char path[300];
+    snprintf(path, sizeof(path), "temp/%s", base);
+    char *dot = strrchr(path + 5, '.');
+    if (dot)
+        *dot = '\0';
+    remove(path);
+}
+
+/**
+ * @brief release a job and its buffers
+ * @param job job to free
+ */
+static void free_job(judge_job *job)
+{
+    if (job->stdin_fd >= 0)
+        close(job->stdin_fd);
+    free(job->source);
+    free(job->send_buf);
+    free(job);
+}
+
+/**
+ * @brief report the verdict to the owner and free the job
+ * @param job finished job
+ */
+static void finish_job(judge_job *job)
+{
+    job->stage = JOB_DONE;
+    job->result[job->result_len] = '\0';
+    if (job->on_done)
+    {
+        fair_job_done(job);
+        if (sched_cfg.report_waits && ++finished % FAIR_REPORT_JOBS == 0)
+            fair_report(stdout);
+        job->on_done(job);
+    }
+    free_job(job);
+}
+
+/**
+ * @brief queue a job for a compile or run worker behind the cheaper jobs of its user
+ * @param job job to queue
+ * @param stage FAIR_COMPILE or FAIR_RUN
+ */
+static void enqueue(judge_job *job, int stage)
+{
+    job->queued_at = fair_now_ms();
+    fair_push(job, stage);
+}
+
+/**
+ * @brief fork the judge for one stage of the job. The compile stage reads the
+ *      source from job->stdin_fd, written from job->source or by the uploading connection.
+ * @param job job to run
+ * @param stage JOB_COMPILING, JOB_RUNNING or JOB_BENCHING
+ * @return 0 on success, -1 on error
+ */
+static int start_stage(judge_job *job, job_stage stage)
+{
+    int with_stdin = (stage == JOB_COMPILING);
+    // the run stage checks every test with a checker that outlives it
+    char checker_fds[32];
+    int request_fd, reply_fd;
+    int checker = (stage == JOB_RUNNING) ? checker_pool_take(&request_fd, &reply_fd) : -1;
+    if (checker >= 0)
+        snprintf(checker_fds, sizeof(checker_fds), "%d:%d", request_fd, reply_fd);
+    // the solutions it runs inherit its CPU
+    int cpu = (stage != JOB_COMPILING) ? cpu_pin_take() : -1;
+    char result_spec[48];
+    int slot = result_slots_take(result_spec, sizeof(result_spec));
+    if (slot < 0)
+    {
+        fprintf(stderr, "no free result slot\n");
+        checker_pool_release(checker);
+        cpu_pin_release(cpu);
+        return -1;
+    }
+    int pipe_fd[2];
+    int stdin_fd[2] = {-1, -1};
+    if (pipe2(pipe_fd, O_CLOEXEC) < 0)
+    {
+        perror("pipe failed");
+        checker_pool_release(checker);
+        cpu_pin_release(cpu);
+        result_slots_release(slot);
+        return -1;
+    }
+    // close-on-exec keeps other judges from holding this stdin open
+    if (with_stdin && pipe2(stdin_fd, O_CLOEXEC) < 0)
+    {
+        perror("pipe failed");
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        checker_pool_release(checker);
+        cpu_pin_release(cpu);
+        result_slots_release(slot);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        if (with_stdin)
+        {
+            close(stdin_fd[0]);
+            close(stdin_fd[1]);
+        }
+        checker_pool_release(checker);
+        cpu_pin_release(cpu);
+        result_slots_release(slot);
+        return -1;
+    }
+    else if (pid == 0)
+    {
+        if (dup2(pipe_fd[1], STDOUT_FILENO) < 0)
+        {
+            perror("dup2 failed");
+            exit(EXIT_FAILURE);
+        }
+        if (with_stdin && dup2(stdin_fd[0], STDIN_FILENO) < 0)
+        {
+            perror("dup2 failed");
+            exit(EXIT_FAILURE);
+        }
+        // the checker's pipes are close-on-exec in the server, the judge keeps them
+        if (checker >= 0 && (fcntl(request_fd, F_SETFD, 0) < 0 || fcntl(reply_fd, F_SETFD, 0) < 0))
+        {
+            perror("fcntl failed");
+            exit(EXIT_FAILURE);
+        }
+        if (cpu >= 0 && cpu_pin_self(cpu) < 0)
+            exit(EXIT_FAILURE);
+        if (result_slots_inherit() < 0)
+            exit(EXIT_FAILURE);
+        const char *argv[16];
+        int argc = 0;
+        argv[argc++] = "judge";
+        argv[argc++] = (stage == JOB_COMPILING ? "-c" : stage == JOB_RUNNING ? "-r" : "-b");
+        if (stage == JOB_RUNNING && (bench_enabled || job->profile))
+            argv[argc++] = "-K";
+        if (stage == JOB_BENCHING && job->profile)
+        {
+            argv[argc++] = "-P";
+            argv[argc++] = job->profile_test;
+        }
+        if (with_stdin)
+            argv[argc++] = "-i";
+        if (stage == JOB_RUNNING && sched_cfg.fail_fast)
+            argv[argc++] = "-f";
+        argv[argc++] = "-p";
+        argv[argc++] = sched_cfg.problem_dir;
+        if (checker >= 0)
+        {
+            argv[argc++] = "-k";
+            argv[argc++] = checker_fds;
+        }
+        argv[argc++] = "-o";
+        argv[argc++] = result_spec;
+        argv[argc++] = job->source_filename;
+        argv[argc] = NULL;
+        execv(JUDGE_PATH, (char *const *)argv);
+        perror("execv failed");
+        exit(EXIT_FAILURE);
+    }
+
+    close(pipe_fd[1]);
+    fcntl(pipe_fd[0], F_SETFL, fcntl(pipe_fd[0], F_GETFL, 0) | O_NONBLOCK);
+    job->pipe_fd = pipe_fd[0];
+    if (with_stdin)
+    {
+        close(stdin_fd[0]);
+        fcntl(stdin_fd[1], F_SETFL, fcntl(stdin_fd[1], F_GETFL, 0) | O_NONBLOCK);
+        job->stdin_fd = stdin_fd[1];
+    }
+    job->pid = pid;
+    job->started_at = fair_now_ms();
+    job->checker = checker;
+    job->cpu = cpu;
+    job->slot = slot;
+    job->stage = stage;
+    job->next = active;
+    active = job;
+    if (stage == JOB_COMPILING)
+        compiling++;
+    else
+        running++;
+    if (stage == JOB_BENCHING)
+        benching++;
+    return 0;
+}
+
+/**
+ * @brief check whether the scheduler still has source bytes to write to a compile stage
+ * @param job job to check
+ * @return 1 if bytes are pending, 0 otherwise
+ */
+static int source_pending(const judge_job *job)
+{
+    return job->stage == JOB_COMPILING && job->stdin_fd >= 0 && job->source && job->source_off < job->source_len;
+}
+
+/**
+ * @brief write the source to the compile stage, closing its stdin once complete
+ * @param job compiling job
+ */
+static void feed_source(judge_job *job)
+{
+    while (job->source_off < job->source_len)
+    {
+        ssize_t n = write(job->stdin_fd, job->source + job->source_off, job->source_len - job->source_off);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+                return;
+            // the judge is gone, it reports on its own
+            perror("write source to judge failed");
+            break;
+        }
+        job->source_off += n;
+    }
+    close(job->stdin_fd);
+    job->stdin_fd = -1;
+}
+
+/**
+ * @brief start queued jobs while workers of their stage are free
+ */
+static void dispatch(void)
+{
+    judge_job *job;
+    while (running < sched_cfg.run_workers && (job = fair_pop(FAIR_RUN)))
+    {
+        if (start_stage(job, JOB_RUNNING) < 0)
+        {
+            remove_executable(job);
+            memcpy(job->result, JUDGE_START_ERROR, strlen(JUDGE_START_ERROR));
+            job->result_len = strlen(JUDGE_START_ERROR);
+            finish_job(job);
+        }
+    }
+    // timing runs only take run workers no submission is waiting for, and leave one of them free,
+    // unless the oldest one was put off for too long
+    int bench_workers = sched_cfg.run_workers > 1 ? sched_cfg.run_workers - 1 : 1;
+    while (running < sched_cfg.run_workers && benching < bench_workers && bench_queue.head &&
+           (!fair_queued(FAIR_RUN) || fair_now_ms() - bench_queue.head->queued_at >= BENCH_MAX_DEFER_MS))
+    {
+        job = queue_pop(&bench_queue);
+        if (start_stage(job, JOB_BENCHING) < 0)
+        {
+            // the verdict stands without the timing
+            remove_executable(job);
+            finish_job(job);
+        }
+    }
+    while (compiling < sched_cfg.compile_workers && (job = fair_pop(FAIR_COMPILE)))
+    {
+        if (start_stage(job, JOB_COMPILING) < 0)
+        {
+            memcpy(job->result, JUDGE_START_ERROR, strlen(JUDGE_START_ERROR));
+            job->result_len = strlen(JUDGE_START_ERROR);
+            finish_job(job);
+            continue;
+        }
+        job->source_off = 0;
+        feed_source(job);
+    }
+}
+
+/**
+ * @brief send a job to a judge node and wait for it among the active jobs
+ * @param job job with its source
+ * @return 0 on success, -1 if no node could take the job
+ */
+static int dispatch_remote(judge_job *job)
+{
+    if (node_pool_dispatch(job) < 0)
+        return -1;
+    job->started_at = fair_now_ms();
+    job->next = active;
+    active = job;
+    return 0;
+}
+
+/**
+ * @brief move a dispatched job forward, retrying on another node or locally on failure
+ * @param job dispatched job
+ * @param read_fds read set returned by select
+ * @param write_fds write set returned by select
+ * @param now CLOCK_MONOTONIC ms, for the reply deadline
+ */
+static void remote_progress(judge_job *job, fd_set *read_fds, fd_set *write_fds, int64_t now)
+{
+    int r = node_pool_handle(job, FD_ISSET(job->pipe_fd, read_fds), FD_ISSET(job->pipe_fd, write_fds));
+    // a partitioned node or a hung judge never closes the connection
+    if (r == 0 && now - job->started_at >= NODE_REPLY_TIMEOUT_MS)
+    {
+        fprintf(stderr, "judge node timed out on %s\n", job->source_filename);
+        r = -1;
+    }
+    if (r == 0)
+        return;
+    active_remove(job);
+    node_pool_release(job, r < 0);
+    if (r > 0)
+    {
+        finish_job(job);
+        return;
+    }
+    if (dispatch_remote(job) == 0)
+        return;
+    // no node left to try
+    job->result_len = 0;
+    job->stage = JOB_QUEUED_COMPILE;
+    enqueue(job, FAIR_COMPILE);
+}
+
+/**
+ * @brief find the test an accepted run stage spent the most time on
+ * @param rec record of the run stage
+ * @param name input file name of the test (output)
+ */
+static void slowest_test(const judge_record *rec, char name[RECORD_TEST_NAME_SIZE])
+{
+    int n = rec->test_count < RECORD_MAX_TESTS ? rec->test_count : RECORD_MAX_TESTS;
+    int slowest = 0;
+    for (int i = 1; i < n; i++)
+    {
+        if (rec->tests[i].time_ms > rec->tests[slowest].time_ms)
+            slowest = i;
+    }
+    memcpy(name, rec->tests[slowest].name, RECORD_TEST_NAME_SIZE);
+    name[RECORD_TEST_NAME_SIZE - 1] = '\0';
+}
+
+/**
+ * @brief give the owner the verdict of a job queued for timing or profiling,
+ *      dropping the job if the owner no longer wants the rest
+ * @param job job in the bench queue
+ */
+static void report_verdict(judge_job *job)
+{
+    job_done_fn on_verdict = job->on_verdict;
+    if (!on_verdict)
+        return;
+    job->on_verdict = NULL;
+    job->result[job->result_len] = '\0';
+    on_verdict(job);
+    if (!job->on_done)
+    {
+        queue_remove(&bench_queue, job);
+        remove_executable(job);
+        free_job(job);
+    }
+}
+
+/**
+ * @brief advance a job whose stage published its result or exited
+ * @param job job whose stage finished
+ */
+static void stage_finished(judge_job *job)
+{
+    close(job->pipe_fd);
+    job->pipe_fd = -1;
+    active_remove(job);
+    const judge_record *rec = result_slots_ready(job->slot);
+    verdict_kind verdict = rec ? rec->verdict : VERDICT_NONE;
+    // a bench stage adds its timing to the verdict of the run stage
+    if (rec)
+        job->result_len += record_format(rec, job->result + job->result_len, JUDGE_RESULT_SIZE - job->result_len);
+    else if (job->stage != JOB_BENCHING)
+        job->result_len = snprintf(job->result, JUDGE_RESULT_SIZE, "%s", JUDGE_LOST_ERROR);
+    if (job->stage == JOB_RUNNING && job->profile && verdict == VERDICT_ACCEPTED)
+        slowest_test(rec, job->profile_test);
+    result_slots_release(job->slot);
+    job->slot = -1;
+    // the user is charged what the stage took instead of what was predicted
+    if (job->stage != JOB_BENCHING)
+        fair_stage_done(job, job->stage == JOB_COMPILING ? FAIR_COMPILE : FAIR_RUN, fair_now_ms() - job->started_at);
+    if (job->stage == JOB_COMPILING)
+    {
+        compiling--;
+        if (job->stdin_fd >= 0)
+        {
+            close(job->stdin_fd);
+            job->stdin_fd = -1;
+        }
+        if (verdict == VERDICT_COMPILED && job->on_done)
+        {
+            // the store keeps the source, the run stage only needs the executable
+            free(job->source);
+            job->source = NULL;
+            job->stage = JOB_QUEUED_RUN;
+            enqueue(job, FAIR_RUN);
+            return;
+        }
+        if (verdict == VERDICT_COMPILED)
+            remove_executable(job);
+    }
+    else
+    {
+        running--;
+        if (job->stage == JOB_BENCHING)
+            benching--;
+        // a stage that died or failed mid-check leaves its checker in an unknown state
+        if (verdict == VERDICT_ACCEPTED || verdict == VERDICT_WRONG_ANSWER || verdict == VERDICT_RUNTIME_ERROR)
+            checker_pool_release(job->checker);
+        else
+            checker_pool_restart(job->checker);
+        job->checker = -1;
+        cpu_pin_release(job->cpu);
+        job->cpu = -1;
+        // the run stage leaves an accepted executable behind for timing and profiling
+        if (job->stage == JOB_RUNNING && (bench_enabled || job->profile) && verdict == VERDICT_ACCEPTED)
+        {
+            if (!job->on_done)
+            {
+                remove_executable(job);
+            }
+            else
+            {
+                job->stage = JOB_QUEUED_BENCH;
+                job->queued_at = fair_now_ms();
+                queue_push(&bench_queue, job);
+                report_verdict(job);
+                return;
+            }
+        }
+    }
+    finish_job(job);
+}
+
+void judge_sched_init(const sched_config *config)
+{
+    sched_cfg = *config;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1)
+        cpus = 1;
+    if (sched_cfg.compile_workers <= 0)
+        sched_cfg.compile_workers = cpus;
+    if (result_slots_init() < 0)
+        exit(EXIT_FAILURE);
+    if (sched_cfg.run_cpus && cpu_pin_init(sched_cfg.run_cpus, &sched_cfg.run_workers) < 0)
+        exit(EXIT_FAILURE);
+    if (sched_cfg.run_workers <= 0)
+        sched_cfg.run_workers = cpus;
+    if (!sched_cfg.problem_dir)
+        sched_cfg.problem_dir = DEFAULT_PROBLEM_DIR;
+    if (sched_cfg.n_nodes > 0)
+    {
+        node_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (node_timer_fd < 0)
+        {
+            perror("timerfd_create failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (sched_cfg.compile_workers + sched_cfg.run_workers > RECORD_SLOTS)
+    {
+        fprintf(stderr, "at most %d compile and run workers in total\n", RECORD_SLOTS);
+        exit(EXIT_FAILURE);
+    }
+    printf("Judge workers: %d compile, %d run\n", sched_cfg.compile_workers, sched_cfg.run_workers);
+    fair_init(sched_cfg.problem_dir);
+    bench_config bench;
+    bench_enabled = (bench_load(sched_cfg.problem_dir, &bench) > 0);
+    if (bench_enabled)
+        printf("Accepted submissions timed over %d runs after %d warm-up\n", bench.runs, bench.warmup);
+    checker_pool_init(sched_cfg.problem_dir, sched_cfg.run_workers);
+    for (int i = 0; i < sched_cfg.n_nodes; i++)
+    {
+        if (node_pool_add(sched_cfg.nodes[i]) < 0)
+            exit(EXIT_FAILURE);
+    }
+}
+
+judge_job *judge_job_create(const char *source_filename, job_done_fn on_done, void *owner)
+{
+    judge_job *job = malloc(sizeof(judge_job));
+    if (!job)
+    {
+        perror("malloc failed");
+        return NULL;
+    }
+    memset(job, 0, sizeof(judge_job));
+    strncpy(job->source_filename, source_filename, sizeof(job->source_filename));
+    job->source_filename[sizeof(job->source_filename) - 1] = '\0';
+    job->stage = JOB_QUEUED_COMPILE;
+    job->pipe_fd = -1;
+    job->stdin_fd = -1;
+    job->node = -1;
+    job->checker = -1;
+    job->cpu = -1;
+    job->slot = -1;
+    job->on_done = on_done;
+    job->owner = owner;
+    return job;
+}
+
+int judge_sched_stream(judge_job *job)
+{
+    // forwarded jobs are sent whole, and never overtake jobs waiting for a compile worker
+    if ((!job->local_only && node_pool_size() > 0) || compiling >= sched_cfg.compile_workers || fair_queued(FAIR_COMPILE))
+        return -1;
+    return start_stage(job, JOB_COMPILING);
+}
+
+void judge_sched_submit(judge_job *job)
+{
+    if (job->stage == JOB_COMPILING)
+    {
+        // streaming: EOF on stdin lets the compiler finish
+        job->source_off = job->source_len;
+        if (job->stdin_fd >= 0)
+        {
+            close(job->stdin_fd);
+            job->stdin_fd = -1;
+        }
+        return;
+    }
+    if (!job->local_only && node_pool_size() > 0 && dispatch_remote(job) == 0)
+        return;
+    enqueue(job, FAIR_COMPILE);
+    dispatch();
+}
+
+void judge_sched_adopt(judge_job *job)
+{
+    job->next = NULL;
+    switch (job->stage)
+    {
+    case JOB_QUEUED_COMPILE:
+        // without its source the job is still being uploaded and is submitted later
+        if (job->source)
+            fair_push(job, FAIR_COMPILE);
+        break;
+    case JOB_QUEUED_RUN:
+        fair_push(job, FAIR_RUN);
+        break;
+    case JOB_QUEUED_BENCH:
+        queue_push(&bench_queue, job);
+        break;
+    case JOB_COMPILING:
+    case JOB_RUNNING:
+    case JOB_BENCHING:
+        // the stage process belongs to the previous server, only its pipes are ours
+        if (job->stage == JOB_COMPILING)
+            compiling++;
+        else
+        {
+            running++;
+            job->cpu = cpu_pin_claim(job->cpu);
+        }
+        job->slot = result_slots_claim(job->slot);
+        if (job->stage == JOB_BENCHING)
+            benching++;
+        job->next = active;
+        active = job;
+        break;
+    case JOB_REMOTE:
+        if (node_pool_adopt(job) == 0)
+        {
+            job->next = active;
+            active = job;
+            break;
+        }
+        if (job->pipe_fd >= 0)
+            close(job->pipe_fd);
+        job->pipe_fd = -1;
+        job->node = -1;
+        job->result_len = 0;
+        job->stage = JOB_QUEUED_COMPILE;
+        enqueue(job, FAIR_COMPILE);
+        break;
+    default:
+        break;
+    }
+}
+
+void judge_sched_cancel(judge_job *job)
+{
+    job->on_done = NULL;
+    job->on_verdict = NULL;
+    job->owner = NULL;
+    if (job->stdin_fd >= 0)
+    {
+        close(job->stdin_fd);
+        job->stdin_fd = -1;
+    }
+    if (job->stage == JOB_QUEUED_COMPILE)
+    {
+        fair_remove(job, FAIR_COMPILE);
+        free_job(job);
+    }
+    else if (job->stage == JOB_QUEUED_RUN || job->stage == JOB_QUEUED_BENCH)
+    {
+        if (job->stage == JOB_QUEUED_RUN)
+            fair_remove(job, FAIR_RUN);
+        else
+            queue_remove(&bench_queue, job);
+        remove_executable(job);
+        free_job(job);
+    }
+}
+
+void judge_sched_stats(int *capacity, int *load)
+{
+    int queued = fair_queued(FAIR_COMPILE) + fair_queued(FAIR_RUN);
+    for (judge_job *job = bench_queue.head; job; job = job->next)
+        queued++;
+    *capacity = sched_cfg.run_workers;
+    *load = queued + compiling + running;
+}
+
+void judge_sched_report(FILE *out)
+{
+    fair_report(out);
+}
+
+/**
+ * @brief arm the node timer for the earliest reply deadline of the dispatched jobs,
+ *      or disarm it when none is dispatched
+ */
+static void arm_node_timer(void)
+{
+    if (node_timer_fd < 0)
+        return;
+    int64_t earliest = 0;
+    for (judge_job *job = active; job; job = job->next)
+    {
+        int64_t deadline = job->started_at + NODE_REPLY_TIMEOUT_MS;
+        if (job->stage == JOB_REMOTE && (!earliest || deadline < earliest))
+            earliest = deadline;
+    }
+    if (earliest == node_timer_at)
+        return;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = earliest / 1000;
+    its.it_value.tv_nsec = (earliest % 1000) * 1000000;
+    if (timerfd_settime(node_timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        perror("timerfd_settime failed");
+    node_timer_at = earliest;
+}
+
+void judge_sched_fill_fds(fd_set *read_fds, fd_set *write_fds, int *max_fd)
+{
+    int event_fd = result_slots_event_fd();
+    FD_SET(event_fd, read_fds);
+    if (event_fd > *max_fd)
+        *max_fd = event_fd;
+    if (node_timer_fd >= 0)
+    {
+        arm_node_timer();
+        FD_SET(node_timer_fd, read_fds);
+        if (node_timer_fd > *max_fd)
+            *max_fd = node_timer_fd;
+    }
+    for (judge_job *job = active; job; job = job->next)
+    {
+        if (job->stage == JOB_REMOTE && job->send_off < job->send_len)
+            FD_SET(job->pipe_fd, write_fds);
+        else
+            FD_SET(job->pipe_fd, read_fds);
+        if (job->pipe_fd > *max_fd)
+            *max_fd = job->pipe_fd;
+        if (source_pending(job))
+        {
+            FD_SET(job->stdin_fd, write_fds);
+            if (job->stdin_fd > *max_fd)
+                *max_fd = job->stdin_fd;
+        }
+    }
+}
+
+void judge_sched_handle(fd_set *read_fds, fd_set *write_fds)
+{
+    // drained before the slots are looked at, a record published after that signals again
+    if (FD_ISSET(result_slots_event_fd(), read_fds))
+        result_slots_drain();
+    if (node_timer_fd >= 0 && FD_ISSET(node_timer_fd, read_fds))
+    {
+        uint64_t count;
+        if (read(node_timer_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+            perror("read timerfd failed");
+        // expired, armed again for the next deadline
+        node_timer_at = 0;
+    }
+    int64_t now = fair_now_ms();
+    judge_job *job = active;
+    judge_job *next;
+    while (job)
+    {
+        next = job->next;
+        if (source_pending(job) && FD_ISSET(job->stdin_fd, write_fds))
+            feed_source(job);
+        if (job->stage == JOB_REMOTE)
+        {
+            remote_progress(job, read_fds, write_fds, now);
+        }
+        else if (result_slots_ready(job->slot))
+        {
+            stage_finished(job);
+        }
+        else if (FD_ISSET(job->pipe_fd, read_fds))
+        {
+            // the judge reports through its slot, the pipe only ends when it exits
+            char buf[256];
+            ssize_t n = read(job->pipe_fd, buf, sizeof(buf));
+            if (n == 0 || (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR))
+            {
+                if (n < 0)
+                    perror("read judge failed");
+                stage_finished(job);
+            }
+        }
+        job = next;
+    }
+    dispatch();
+}
@@ -0,0 +1,168 @@
+#ifndef JUDGE_SCHED_H
+#define JUDGE_SCHED_H
+
+#include "../defineshit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include "node_pool.h"
+#include "../judge/judge_record.h"
+
+#define JUDGE_PATH "build/src/judge"
+#define DEFAULT_PROBLEM_DIR "io"
+#define JUDGE_RESULT_SIZE (RECORD_LOG_SIZE + 2048) // a formatted record always fits
+
+// stage of a judge job
+typedef enum
+{
+    JOB_QUEUED_COMPILE,
+    JOB_COMPILING,
+    JOB_QUEUED_RUN,
+    JOB_RUNNING,
+    JOB_QUEUED_BENCH,
+    JOB_BENCHING,
+    JOB_REMOTE,
+    JOB_DONE
+} job_stage;
+
+typedef struct judge_job judge_job;
+
+/**
+ * @brief called once the verdict of a job is complete
+ * @param job finished job, freed by the scheduler after the callback
+ */
+typedef void (*job_done_fn)(judge_job *job);
+
+/**
+ * @brief judge job structure, owned by the scheduler once submitted
+ */
+struct judge_job
+{
+    char source_filename[256];       // submission name, sets the judge's temp file names and language
+    job_stage stage;                 // current stage
+    pid_t pid;                       // process id of the running stage
+    int pipe_fd;                     // stdout pipe of the running stage, EOF once it exits / non-blocking
+    int stdin_fd;                    // stdin of the compile stage / non-blocking
+    char *source;                    // complete source, NULL while it is uploaded
+    size_t source_len;               // byte size of the source
+    size_t source_off;               // byte size of the source already written to stdin_fd
+    int local_only;                  // 1 to never forward the job to a judge node
+    int node;                        // index of the judge node, -1 if judged locally
+    int checker;                     // resident checker lent to the run stage, -1 for none
+    int cpu;                         // CPU the run stage is pinned to, -1 for none
+    int slot;                        // result slot of the running stage, -1 for none
+    int attempts;                    // number of judge nodes tried
+    uint32_t user;                   // client IPv4 address in network order, 0 for local jobs: fair-share key
+    double cost_ms;                  // predicted time of the queued or running stage, charged to the user
+    int64_t queued_at;               // CLOCK_MONOTONIC ms the job entered its queue, 0 if never queued
+    int64_t started_at;              // CLOCK_MONOTONIC ms the running stage started, or the job was dispatched
+    int64_t waited_ms;               // time spent in the compile and run queues so far
+    int profile;                     // 1 to profile the slowest test once accepted
+    char profile_test[RECORD_TEST_NAME_SIZE]; // slowest test of the run stage, profiled in the bench stage
+    char *send_buf;                  // JUDGEJOB header and source sent to the node
+    size_t send_len;                 // byte size of the send buffer
+    size_t send_off;                 // byte size of the send buffer already sent
+    char node_header[NODE_HEADER_SIZE]; // NODESTAT header replied by the node
+    size_t node_header_len;          // byte size of the reply header received
+    char result[JUDGE_RESULT_SIZE];  // judge result buffer
+    size_t result_len;               // judge result byte size
+    job_done_fn on_done;             // completion callback, NULL once cancelled
+    job_done_fn on_verdict;          // called with the verdict when an accepted job goes on to be timed or
+                                     // profiled, may hand on_done to a new owner or clear it to skip that;
+                                     // NULL to report once with on_done
+    void *owner;                     // owner of the job (client connection)
+    struct judge_job *next;          // next job in the same queue
+};
+
+/**
+ * @brief scheduler configuration
+ */
+typedef struct sched_config
+{
+    int compile_workers; // number of concurrent compile stages, 0 for one per CPU
+    int run_workers;     // number of concurrent run stages, 0 for one per CPU
+    const char *problem_dir; // test case directory passed to the judge, NULL for io
+    int fail_fast;       // stop judging at the first test that is not Accepted
+    const char *run_cpus; // CPUs reserved for run stages (see cpu_pin_init), NULL to not pin
+    int report_waits;    // print the queue wait percentiles every FAIR_REPORT_JOBS finished jobs
+    const char *nodes[MAX_JUDGE_NODES]; // judge nodes as "host:port"
+    int n_nodes;         // number of judge nodes, 0 to judge everything locally
+} sched_config;
+
+/**
+ * @brief Initialize the scheduler
+ * @param config scheduler configuration
+ */
+void judge_sched_init(const sched_config *config);
+
+/**
+ * @brief Create a job for a submission
+ * @param source_filename submission name (e.g. sub42.c)
+ * @param on_done completion callback
+ * @param owner owner of the job
+ * @return heap-allocated job, or NULL on error
+ */
+judge_job *judge_job_create(const char *source_filename, job_done_fn on_done, void *owner);
+
+/**
+ * @brief Start the compile stage right away, reading the source from job->stdin_fd
+ * @param job job that is still being uploaded
+ * @return 0 if the compiler was started, -1 if no compile worker is free
+ */
+int judge_sched_stream(judge_job *job);
+
+/**
+ * @brief Hand a fully received job to the scheduler
+ * @param job job to judge with job->source set, closes the streaming stdin if any
+ */
+void judge_sched_submit(judge_job *job);
+
+/**
+ * @brief Take over a job handed over by the previous server process. Its stage,
+ *      descriptors and buffers are kept; a remote job whose node is unknown is judged locally.
+ * @param job job to adopt
+ */
+void judge_sched_adopt(judge_job *job);
+
+/**
+ * @brief Stop reporting to the owner, queued jobs are dropped and running ones reaped later
+ * @param job job to cancel
+ */
+void judge_sched_cancel(judge_job *job);
+
+/**
+ * @brief Report the local capacity and load, as sent to front-end servers
+ * @param capacity number of run workers (out)
+ * @param load number of jobs queued or running (out)
+ */
+void judge_sched_stats(int *capacity, int *load);
+
+/**
+ * @brief Print the queue wait percentiles over all users and of the busiest users
+ * @param out output stream
+ */
+void judge_sched_report(FILE *out);
+
+/**
+ * @brief Add the result eventfd, the pipes of running stages, the node sockets and the
+ *      timer of the node reply deadlines to the fd sets
+ * @param read_fds read set
+ * @param write_fds write set
+ * @param max_fd highest descriptor in the sets (in/out)
+ */
+void judge_sched_fill_fds(fd_set *read_fds, fd_set *write_fds, int *max_fd);
+
+/**
+ * @brief Collect stage output, advance finished jobs and start queued ones
+ * @param read_fds read set returned by select
+ * @param write_fds write set returned by select
+ */
+void judge_sched_handle(fd_set *read_fds, fd_set *write_fds);
+
+#endif // JUDGE_SCHED_H
@@ -0,0 +1,299 @@
+#include "node_pool.h"
+#include "judge_sched.h"
+#include "../toolchain/toolchain.h"
+#include <poll.h>
+#include <netdb.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+static judge_node nodes[MAX_JUDGE_NODES];
+static int n_nodes = 0;
+
+/**
+ * @brief mark a node down so the scheduler skips it for a while
+ * @param node failed node
+ */
+static void mark_down(judge_node *node)
+{
+    if (node->down_until <= time(NULL))
+        fprintf(stderr, "judge node %s is down\n", node->name);
+    node->down_until = time(NULL) + NODE_DOWN_SECONDS;
+    node->dispatched = 0;
+}
+
+/**
+ * @brief apply a NODESTAT header reported by a node
+ * @param node reporting node
+ * @param header 16-byte header
+ * @return 0 on success, -1 if the header is not a NODESTAT header
+ */
+static int apply_stat(judge_node *node, const char *header)
+{
+    if (memcmp(header, NODESTAT, 8) != 0)
+        return -1;
+    uint32_t net_capacity, net_load;
+    memcpy(&net_capacity, header + 8, 4);
+    memcpy(&net_load, header + 12, 4);
+    node->capacity = (int)be32toh(net_capacity);
+    node->load = (int)be32toh(net_load);
+    if (node->capacity < 1)
+        node->capacity = 1;
+    node->dispatched = 0;
+    return 0;
+}
+
+/**
+ * @brief wait for a descriptor with a timeout
+ * @param fd file descriptor
+ * @param events poll events
+ * @return 1 if ready, 0 on timeout or error
+ */
+static int wait_fd(int fd, short events)
+{
+    struct pollfd pfd = {.fd = fd, .events = events};
+    int r;
+    do
+    {
+        r = poll(&pfd, 1, NODE_PROBE_TIMEOUT_MS);
+    } while (r < 0 && errno == EINTR);
+    return r > 0;
+}
+
+/**
+ * @brief ask a node for its capacity and load, blocking for at most a few timeouts
+ * @param node node to probe
+ * @return 0 on success, -1 on error
+ */
+static int probe_node(judge_node *node)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    char header[NODE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, STATUSRQ, 8);
+
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    size_t got = 0;
+    if (connect(fd, (struct sockaddr *)&node->addr, sizeof(node->addr)) < 0 && errno != EINPROGRESS)
+        goto fail;
+    if (!wait_fd(fd, POLLOUT) || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0 || err)
+        goto fail;
+    if (send(fd, header, sizeof(header), MSG_NOSIGNAL) != (ssize_t)sizeof(header))
+        goto fail;
+    while (got < sizeof(header))
+    {
+        if (!wait_fd(fd, POLLIN))
+            goto fail;
+        ssize_t n = recv(fd, header + got, sizeof(header) - got, 0);
+        if (n <= 0)
+            goto fail;
+        got += n;
+    }
+    close(fd);
+    return apply_stat(node, header);
+
+fail:
+    close(fd);
+    return -1;
+}
+
+/**
+ * @brief pick the least-loaded node that is up
+ * @return node index, or -1 if every node is down
+ */
+static int pick_node(void)
+{
+    time_t now = time(NULL);
+    int best = -1;
+    double best_ratio = 0;
+    for (int i = 0; i < n_nodes; i++)
+    {
+        if (nodes[i].down_until > now)
+            continue;
+        double ratio = (double)(nodes[i].load + nodes[i].dispatched) / nodes[i].capacity;
+        if (best < 0 || ratio < best_ratio ||
+            (ratio == best_ratio && nodes[i].capacity > nodes[best].capacity))
+        {
+            best = i;
+            best_ratio = ratio;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief copy the JUDGEJOB header and the source into the job's send buffer
+ * @param job job to send
+ * @return 0 on success, -1 on error
+ */
+static int load_source(judge_job *job)
+{
+    job->send_buf = malloc(NODE_HEADER_SIZE + job->source_len);
+    if (!job->send_buf)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    const toolchain *tc = toolchain_by_path(job->source_filename);
+    memcpy(job->send_buf, tc ? tc->job_tag : JUDGEJOB, 8);
+    uint64_t net_size = htobe64((uint64_t)job->source_len);
+    memcpy(job->send_buf + 8, &net_size, 8);
+    if (job->source_len > 0)
+        memcpy(job->send_buf + NODE_HEADER_SIZE, job->source, job->source_len);
+    job->send_len = NODE_HEADER_SIZE + job->source_len;
+    return 0;
+}
+
+int node_pool_add(const char *spec)
+{
+    if (n_nodes >= MAX_JUDGE_NODES)
+    {
+        fprintf(stderr, "too many judge nodes (max %d)\n", MAX_JUDGE_NODES);
+        return -1;
+    }
+    char host[64];
+    const char *colon = strrchr(spec, ':');
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(host))
+    {
+        fprintf(stderr, "invalid judge node '%s', expected host:port\n", spec);
+        return -1;
+    }
+    memcpy(host, spec, colon - spec);
+    host[colon - spec] = '\0';
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(host, colon + 1, &hints, &res);
+    if (rc != 0)
+    {
+        fprintf(stderr, "getaddrinfo(%s) failed: %s\n", spec, gai_strerror(rc));
+        return -1;
+    }
+    judge_node *node = &nodes[n_nodes++];
+    memset(node, 0, sizeof(*node));
+    strncpy(node->name, spec, sizeof(node->name) - 1);
+    memcpy(&node->addr, res->ai_addr, sizeof(node->addr));
+    freeaddrinfo(res);
+    node->capacity = 1;
+
+    if (probe_node(node) < 0)
+        mark_down(node);
+    else
+        printf("Judge node %s: capacity %d, load %d\n", node->name, node->capacity, node->load);
+    return 0;
+}
+
+int node_pool_size(void)
+{
+    return n_nodes;
+}
+
+void node_pool_encode_stat(char *header, int capacity, int load)
+{
+    memcpy(header, NODESTAT, 8);
+    uint32_t net_capacity = htobe32((uint32_t)capacity);
+    uint32_t net_load = htobe32((uint32_t)load);
+    memcpy(header + 8, &net_capacity, 4);
+    memcpy(header + 12, &net_load, 4);
+}
+
+int node_pool_dispatch(judge_job *job)
+{
+    if (!job->send_buf && load_source(job) < 0)
+        return -1;
+    while (job->attempts < n_nodes)
+    {
+        int idx = pick_node();
+        if (idx < 0)
+            return -1;
+        job->attempts++;
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            perror("socket failed");
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&nodes[idx].addr, sizeof(nodes[idx].addr)) < 0 && errno != EINPROGRESS)
+        {
+            close(fd);
+            mark_down(&nodes[idx]);
+            continue;
+        }
+        job->node = idx;
+        job->pipe_fd = fd;
+        job->send_off = 0;
+        job->node_header_len = 0;
+        job->result_len = 0;
+        job->stage = JOB_REMOTE;
+        nodes[idx].dispatched++;
+        return 0;
+    }
+    return -1;
+}
+
+int node_pool_handle(judge_job *job, int readable, int writable)
+{
+    if (job->send_off < job->send_len)
+    {
+        if (!writable)
+            return 0;
+        // the first send also reports a failed connect
+        ssize_t n = send(job->pipe_fd, job->send_buf + job->send_off, job->send_len - job->send_off, MSG_NOSIGNAL);
+        if (n < 0)
+            return (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        job->send_off += n;
+        return 0;
+    }
+    if (!readable)
+        return 0;
+
+    char buf[JUDGE_RESULT_SIZE];
+    ssize_t n = recv(job->pipe_fd, buf, sizeof(buf), 0);
+    if (n < 0)
+        return (errno == EWOULDBLOCK || errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    if (n == 0)
+        return (job->node_header_len == NODE_HEADER_SIZE && job->result_len > 0) ? 1 : -1;
+
+    size_t off = 0;
+    if (job->node_header_len < NODE_HEADER_SIZE)
+    {
+        off = NODE_HEADER_SIZE - job->node_header_len;
+        if (off > (size_t)n)
+            off = n;
+        memcpy(job->node_header + job->node_header_len, buf, off);
+        job->node_header_len += off;
+        if (job->node_header_len == NODE_HEADER_SIZE && apply_stat(&nodes[job->node], job->node_header) < 0)
+            return -1;
+    }
+    size_t room = JUDGE_RESULT_SIZE - 1 - job->result_len;
+    size_t len = (size_t)n - off < room ? (size_t)n - off : room;
+    memcpy(job->result + job->result_len, buf + off, len);
+    job->result_len += len;
+    return 0;
+}
+
+int node_pool_adopt(judge_job *job)
+{
+    if (job->node < 0 || job->node >= n_nodes)
+        return -1;
+    // the send buffer is rebuilt from the source, send_off is kept
+    if (!job->send_buf && load_source(job) < 0)
+        return -1;
+    nodes[job->node].dispatched++;
+    return 0;
+}
+
+void node_pool_release(judge_job *job, int failed)
+{
+    if (job->pipe_fd >= 0)
+        close(job->pipe_fd);
+    job->pipe_fd = -1;
+    if (failed)
+        mark_down(&nodes[job->node]);
+    job->node = -1;
+}
@@ -0,0 +1,86 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include "../defineshit.h"
+#include <stdint.h>
+#include <time.h>
+#include <netinet/in.h>
+
+#define MAX_JUDGE_NODES 16
+#define NODE_HEADER_SIZE 16
+#define NODE_DOWN_SECONDS 5
+#define NODE_PROBE_TIMEOUT_MS 1000
+#define NODE_REPLY_TIMEOUT_MS 180000 // a node that has not answered a job this long after dispatch is down
+
+// request types in the first 8 bytes of the header
+#define JUDGEJOB "JUDGEJOB" // job forwarded by a front-end server, judged locally
+#define STATUSRQ "STATUSRQ" // capacity and load query
+#define NODESTAT "NODESTAT" // reply header: be32 capacity, be32 load
+
+typedef struct judge_job judge_job;
+
+/**
+ * @brief registered judge node
+ */
+typedef struct judge_node
+{
+    char name[64];           // host:port as registered
+    struct sockaddr_in addr; // node address
+    int capacity;            // reported capacity (run workers)
+    int load;                // reported jobs queued or running on the node
+    int dispatched;          // jobs sent since the last report
+    time_t down_until;       // skipped until this time after a failure
+} judge_node;
+
+/**
+ * @brief Register a judge node and query its capacity
+ * @param spec "host:port"
+ * @return 0 on success, -1 on error
+ */
+int node_pool_add(const char *spec);
+
+/**
+ * @brief Number of registered judge nodes
+ * @return number of nodes
+ */
+int node_pool_size(void);
+
+/**
+ * @brief Encode a NODESTAT header
+ * @param header 16-byte buffer
+ * @param capacity capacity to report
+ * @param load load to report
+ */
+void node_pool_encode_stat(char *header, int capacity, int load);
+
+/**
+ * @brief Connect the job to the least-loaded node that is up
+ * @param job job to dispatch, its source file is sent to the node
+ * @return 0 on success, -1 if no node could take the job
+ */
+int node_pool_dispatch(judge_job *job);
+
+/**
+ * @brief Move a dispatched job forward
+ * @param job dispatched job
+ * @param readable 1 if the node socket is readable
+ * @param writable 1 if the node socket is writable
+ * @return 0 to keep waiting, 1 once the result is complete, -1 if the node failed
+ */
+int node_pool_handle(judge_job *job, int readable, int writable);
+
+/**
+ * @brief Take over a job dispatched by the previous server process
+ * @param job job in JOB_REMOTE with its node index and socket
+ * @return 0 on success, -1 if the node is not registered here
+ */
+int node_pool_adopt(judge_job *job);
+
+/**
+ * @brief Release the node connection of a job
+ * @param job dispatched job
+ * @param failed 1 to mark the node down
+ */
+void node_pool_release(judge_job *job, int failed);
+
+#endif // NODE_POOL_H
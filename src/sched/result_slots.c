@@ -0,0 +1,146 @@
+#include "result_slots.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#define REGION_SIZE (RECORD_SLOTS * sizeof(judge_record))
+
+static judge_record *region = NULL; // RECORD_SLOTS records shared with the judges
+static int shm_fd = -1;             // memfd backing the region
+static int event_fd = -1;           // signalled by a judge after publishing
+static char lent[RECORD_SLOTS];     // 1 while a stage holds the slot
+
+/**
+ * @brief map the slots of a memfd
+ * @param fd memfd
+ * @return mapped region, or NULL on error
+ */
+static judge_record *map_region(int fd)
+{
+    judge_record *mapped = mmap(NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        perror("mmap result slots failed");
+        return NULL;
+    }
+    return mapped;
+}
+
+int result_slots_init(void)
+{
+    // pages are only backed once a judge writes to them
+    shm_fd = memfd_create("judge-results", MFD_CLOEXEC);
+    if (shm_fd < 0)
+    {
+        perror("memfd_create failed");
+        return -1;
+    }
+    if (ftruncate(shm_fd, REGION_SIZE) < 0)
+    {
+        perror("ftruncate result slots failed");
+        return -1;
+    }
+    region = map_region(shm_fd);
+    if (!region)
+        return -1;
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0)
+    {
+        perror("eventfd failed");
+        return -1;
+    }
+    return 0;
+}
+
+int result_slots_adopt(int fd)
+{
+    // a record layout change shows up as another region size
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size != REGION_SIZE)
+    {
+        fprintf(stderr, "handed over result slots have another layout\n");
+        close(fd);
+        return -1;
+    }
+    judge_record *mapped = map_region(fd);
+    if (!mapped)
+    {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    munmap(region, REGION_SIZE);
+    close(shm_fd);
+    region = mapped;
+    shm_fd = fd;
+    return 0;
+}
+
+int result_slots_take(char *spec, size_t size)
+{
+    for (int i = 0; i < RECORD_SLOTS; i++)
+    {
+        if (lent[i])
+            continue;
+        lent[i] = 1;
+        __atomic_store_n(&region[i].ready, 0, __ATOMIC_RELEASE);
+        snprintf(spec, size, "%d:%d:%d", shm_fd, event_fd, i);
+        return i;
+    }
+    return -1;
+}
+
+int result_slots_claim(int slot)
+{
+    if (slot < 0 || slot >= RECORD_SLOTS || lent[slot])
+        return -1;
+    lent[slot] = 1;
+    return slot;
+}
+
+void result_slots_release(int slot)
+{
+    if (slot >= 0 && slot < RECORD_SLOTS)
+        lent[slot] = 0;
+}
+
+const judge_record *result_slots_ready(int slot)
+{
+    if (slot < 0 || slot >= RECORD_SLOTS || !__atomic_load_n(&region[slot].ready, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &region[slot];
+}
+
+int result_slots_inherit(void)
+{
+    if (fcntl(shm_fd, F_SETFD, 0) < 0 || fcntl(event_fd, F_SETFD, 0) < 0)
+    {
+        perror("fcntl failed");
+        return -1;
+    }
+    return 0;
+}
+
+int result_slots_event_fd(void)
+{
+    return event_fd;
+}
+
+void result_slots_drain(void)
+{
+    uint64_t count;
+    if (read(event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("read eventfd failed");
+}
+
+int result_slots_shm_fd(void)
+{
+    return shm_fd;
+}
@@ -0,0 +1,72 @@
+#ifndef RESULT_SLOTS_H
+#define RESULT_SLOTS_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+#include "../judge/judge_record.h"
+
+/**
+ * @brief Create the shared result slots and the eventfd the judges signal
+ * @return 0 on success, -1 on error
+ */
+int result_slots_init(void);
+
+/**
+ * @brief Switch to the slots of the previous server, whose stages are still running
+ * @param fd memfd handed over by the previous server, closed on error
+ * @return 0 on success, -1 on error (the own slots are kept)
+ */
+int result_slots_adopt(int fd);
+
+/**
+ * @brief Lend a slot to a stage about to start, cleared and marked not ready
+ * @param spec "<memfd>:<eventfd>:<slot>" for the judge's -o (output)
+ * @param size byte size of spec
+ * @return slot index, or -1 if every slot is lent
+ */
+int result_slots_take(char *spec, size_t size);
+
+/**
+ * @brief Mark the slot of a stage handed over by the previous server as lent
+ * @param slot slot index, -1 for none
+ * @return slot if it was free, -1 otherwise
+ */
+int result_slots_claim(int slot);
+
+/**
+ * @brief Give a slot back once its stage finished
+ * @param slot slot index, -1 for none
+ */
+void result_slots_release(int slot);
+
+/**
+ * @brief Get the record of a stage if the judge published it
+ * @param slot slot index
+ * @return complete record, or NULL while the stage runs
+ */
+const judge_record *result_slots_ready(int slot);
+
+/**
+ * @brief Make the memfd and the eventfd inheritable, in the stage child before exec
+ * @return 0 on success, -1 on error
+ */
+int result_slots_inherit(void);
+
+/**
+ * @brief eventfd the judges signal, readable once a record is published
+ * @return eventfd
+ */
+int result_slots_event_fd(void);
+
+/**
+ * @brief Reset the eventfd counter before looking at the slots
+ */
+void result_slots_drain(void);
+
+/**
+ * @brief memfd of the slots, handed over on restart
+ * @return memfd
+ */
+int result_slots_shm_fd(void);
+
+#endif // RESULT_SLOTS_H
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include "tcp/tcp_server.h"
@@ -7,14 +8,63 @@
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    server_config config;
+    memset(&config, 0, sizeof(config));
+    config.sched.problem_dir = DEFAULT_PROBLEM_DIR;
+    config.sched.report_waits = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "sfuUt:c:r:C:n:p:")) != -1)
     {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+        switch (opt)
+        {
+        case 's':
+            config.stream_compile = 1;
+            break;
+        case 'f':
+            config.sched.fail_fast = 1;
+            break;
+        case 'u':
+            config.io_uring = 1;
+            break;
+        case 'U':
+            config.upgrade = 1;
+            break;
+        case 't':
+            config.net_threads = atoi(optarg);
+            break;
+        case 'c':
+            config.sched.compile_workers = atoi(optarg);
+            break;
+        case 'r':
+            config.sched.run_workers = atoi(optarg);
+            break;
+        case 'C':
+            config.sched.run_cpus = optarg;
+            break;
+        case 'p':
+            config.sched.problem_dir = optarg;
+            break;
+        case 'n':
+            if (config.sched.n_nodes >= MAX_JUDGE_NODES)
+            {
+                fprintf(stderr, "too many judge nodes (max %d)\n", MAX_JUDGE_NODES);
+                return 1;
+            }
+            config.sched.nodes[config.sched.n_nodes++] = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-s] [-f] [-u] [-U] [-t net_threads] [-c compile_workers] [-r run_workers] [-C run_cpus] [-n host:port]... [-p test_dir] <port>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "Usage: %s [-s] [-f] [-u] [-U] [-t net_threads] [-c compile_workers] [-r run_workers] [-C run_cpus] [-n host:port]... [-p test_dir] <port>\n", argv[0]);
         return 1;
     }
-    int port = atoi(argv[1]);
+    config.port = atoi(argv[optind]);
     printf("Start TCP server\n");
-    start_tcp_server(port);
+    start_tcp_server(&config);
     printf("TCP server closed, bye\n");
     return 0;
 }
@@ -0,0 +1,172 @@
+#include "result_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+
+static char result_dir[256];
+static unsigned issued = 0; // tickets issued since the last sweep
+
+/**
+ * @brief build the path of the verdict file of a submission
+ */
+static void result_path(uint64_t id, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%llu", result_dir, (unsigned long long)id);
+}
+
+/**
+ * @brief build the path of the link of a ticket
+ */
+static void ticket_path(uint64_t ticket, char *path, size_t size)
+{
+    snprintf(path, size, "%s/" RESULT_TICKET_DIR "/%016llx", result_dir, (unsigned long long)ticket);
+}
+
+/**
+ * @brief remove the tickets older than RESULT_TICKET_DAYS
+ */
+static void expire_tickets(void)
+{
+    char dir[300];
+    snprintf(dir, sizeof(dir), "%s/" RESULT_TICKET_DIR, result_dir);
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        perror("opendir tickets failed");
+        return;
+    }
+    time_t cutoff = time(NULL) - (time_t)RESULT_TICKET_DAYS * 24 * 3600;
+    struct dirent *e;
+    while ((e = readdir(d)))
+    {
+        if (e->d_name[0] == '.')
+            continue;
+        struct stat st;
+        if (fstatat(dirfd(d), e->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && st.st_mtime < cutoff)
+            unlinkat(dirfd(d), e->d_name, 0);
+    }
+    closedir(d);
+}
+
+/**
+ * @brief run expire_tickets in a forked child, the sweep grows with the outstanding
+ *      tickets and must not hold up the event loop
+ */
+static void expire_tickets_background(void)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+    }
+    else if (pid == 0)
+    {
+        // client sockets must not outlive the parent's close
+        close_range(3, ~0u, 0);
+        expire_tickets();
+        _exit(0);
+    }
+}
+
+int result_store_open(const char *dir)
+{
+    strncpy(result_dir, dir, sizeof(result_dir) - 1);
+    result_dir[sizeof(result_dir) - 1] = '\0';
+    char tickets[300];
+    snprintf(tickets, sizeof(tickets), "%s/" RESULT_TICKET_DIR, result_dir);
+    if ((mkdir(result_dir, 0755) < 0 && errno != EEXIST) || (mkdir(tickets, 0755) < 0 && errno != EEXIST))
+    {
+        perror("mkdir results failed");
+        return -1;
+    }
+    expire_tickets_background();
+    return 0;
+}
+
+uint64_t result_store_ticket(uint64_t id)
+{
+    if (++issued >= RESULT_EXPIRE_EVERY)
+    {
+        issued = 0;
+        expire_tickets_background();
+    }
+    char target[32], path[300];
+    snprintf(target, sizeof(target), "../%llu", (unsigned long long)id);
+    for (int attempt = 0; attempt < 8; attempt++)
+    {
+        uint64_t ticket;
+        if (getrandom(&ticket, sizeof(ticket), 0) != sizeof(ticket))
+        {
+            perror("getrandom failed");
+            return 0;
+        }
+        if (ticket == 0)
+            continue;
+        // the link names the submission's verdict file, which may not exist yet
+        ticket_path(ticket, path, sizeof(path));
+        if (symlink(target, path) == 0)
+            return ticket;
+        if (errno != EEXIST)
+        {
+            perror("symlink ticket failed");
+            return 0;
+        }
+    }
+    return 0;
+}
+
+int result_store_resolve(uint64_t ticket, uint64_t *id)
+{
+    char path[300], target[32];
+    ticket_path(ticket, path, sizeof(path));
+    ssize_t n = readlink(path, target, sizeof(target) - 1);
+    if (n <= 3 || memcmp(target, "../", 3) != 0)
+        return -1;
+    target[n] = '\0';
+    char *end;
+    *id = strtoull(target + 3, &end, 10);
+    return *end == '\0' ? 0 : -1;
+}
+
+int result_store_put(uint64_t id, const char *result, size_t len)
+{
+    // a query reading the file never sees half a verdict
+    char path[300], tmp[320];
+    result_path(id, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+    {
+        perror("fopen result failed");
+        return -1;
+    }
+    size_t written = fwrite(result, 1, len, fp);
+    if (fclose(fp) != 0 || written != len || rename(tmp, path) != 0)
+    {
+        perror("write result failed");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int result_store_get(uint64_t id, char *result, size_t size, size_t *len)
+{
+    char path[300];
+    result_path(id, path, sizeof(path));
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return -1;
+    size_t n = fread(result, 1, size - 1, fp);
+    fclose(fp);
+    result[n] = '\0';
+    *len = n;
+    return 0;
+}
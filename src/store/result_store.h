@@ -0,0 +1,55 @@
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define RESULT_DIR "files/results" // one file per submission issued a ticket, named by its ID
+#define RESULT_TICKET_DIR "tickets"  // under RESULT_DIR: one link per ticket, to the file of its submission
+#define RESULT_TICKET_DAYS 7         // tickets older than this are removed, their verdicts are kept
+#define RESULT_EXPIRE_EVERY 1024     // tickets issued between two sweeps for expired ones, run in a child
+
+/**
+ * @brief Open (or create) the result store
+ * @param dir result directory
+ * @return 0 on success, -1 on error
+ */
+int result_store_open(const char *dir);
+
+/**
+ * @brief Issue the ticket of a submission: a random token that maps to its ID, so
+ *      clients cannot read the verdicts of other submissions by guessing IDs
+ * @param id submission ID
+ * @return ticket, 0 on error
+ */
+uint64_t result_store_ticket(uint64_t id);
+
+/**
+ * @brief Find the submission a ticket was issued for
+ * @param ticket ticket returned by result_store_ticket
+ * @param id submission ID (output)
+ * @return 0 if the ticket is known, -1 otherwise
+ */
+int result_store_resolve(uint64_t ticket, uint64_t *id);
+
+/**
+ * @brief Keep the verdict of a detached submission, replacing any earlier one
+ * @param id submission ID
+ * @param result verdict text
+ * @param len byte size of the verdict
+ * @return 0 on success, -1 on error
+ */
+int result_store_put(uint64_t id, const char *result, size_t len);
+
+/**
+ * @brief Read the verdict of a detached submission
+ * @param id submission ID
+ * @param result verdict buffer (output), NUL-terminated
+ * @param size size of the verdict buffer
+ * @param len byte size of the verdict (output)
+ * @return 0 if the verdict is stored, -1 otherwise
+ */
+int result_store_get(uint64_t id, char *result, size_t size, size_t *len);
+
+#endif // RESULT_STORE_H
@@ -0,0 +1,748 @@
+#include "submission_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STORE_MAGIC "CJSTORE2"
+#define RECORD_MAGIC 0x43534a43u  // "CJSC"
+#define VERDICT_MAGIC 0x56534a43u // "CJSV"
+#define IS_RECORD(magic) ((magic) == RECORD_MAGIC || (magic) == VERDICT_MAGIC)
+#define INDEX_GROW 4096           // initial number of index entries
+#define STORE_COMPACT_AGE 60      // seconds a sealed segment must be unchanged before compaction
+#define LOCATION(seg, off) (((uint64_t)(seg) << 40) | (uint64_t)(off))
+#define LOC_SEGMENT(loc) ((uint32_t)((loc) >> 40))
+#define LOC_OFFSET(loc) ((loc) & ((1ull << 40) - 1))
+
+/**
+ * @brief header at the start of the index file
+ */
+typedef struct store_header
+{
+    char magic[8];           // STORE_MAGIC
+    uint64_t next_id;        // last allocated submission ID
+    uint32_t next_segment;   // last allocated segment number
+    uint32_t active_segment; // segment the appender writes to, 0 before the first write
+    uint64_t capacity;       // number of entries the index file holds
+    char reserved[32];
+} store_header;
+
+/**
+ * @brief header of a record in a segment, followed by the source or the verdict
+ */
+typedef struct record_header
+{
+    uint32_t magic;              // RECORD_MAGIC, or VERDICT_MAGIC for a verdict
+    uint32_t size;               // byte size of the source or verdict
+    uint64_t id;                 // submission ID
+    char lang[STORE_LANG_SIZE];  // toolchain name
+    int64_t stored_at;           // submission time
+} record_header;
+
+/**
+ * @brief record waiting in the batch for its index entry to be published
+ */
+typedef struct pending_record
+{
+    uint64_t id;       // submission ID
+    size_t offset;     // offset of the record in the batch
+    int verdict;       // 1 for a verdict record, only its location and size are published
+    store_entry entry; // entry to publish, location relative to the batch
+} pending_record;
+
+static char store_dir[256];
+static int index_fd = -1;
+static store_header *header = NULL; // mapped index file
+static store_entry *entries = NULL; // entries[id], right after the header
+static size_t mapped_size = 0;      // byte size of the mapping
+static int segment_fd = -1;         // active segment, opened by the appender
+static uint32_t segment_no = 0;     // number of the segment segment_fd appends to
+static char *batch = NULL;          // records not written yet
+static size_t batch_len = 0;
+static size_t batch_cap = 0;
+static pending_record *pending = NULL;
+static int n_pending = 0;
+static int pending_cap = 0;
+
+/**
+ * @brief build the path of a segment file
+ */
+static void segment_path(uint32_t seg, char *path, size_t size)
+{
+    snprintf(path, size, "%s/seg-%06u.dat", store_dir, seg);
+}
+
+/**
+ * @brief (re)map the whole index file
+ * @return 0 on success, -1 on error
+ */
+static int map_index(void)
+{
+    struct stat st;
+    if (fstat(index_fd, &st) < 0)
+    {
+        perror("fstat index failed");
+        return -1;
+    }
+    if (header)
+        munmap(header, mapped_size);
+    header = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, index_fd, 0);
+    if (header == MAP_FAILED)
+    {
+        perror("mmap index failed");
+        header = NULL;
+        entries = NULL;
+        return -1;
+    }
+    mapped_size = st.st_size;
+    entries = (store_entry *)(header + 1);
+    return 0;
+}
+
+/**
+ * @brief make sure the entry of an ID is mapped, following growth by the appender
+ * @param id submission ID
+ * @return 0 on success, -1 on error
+ */
+static int ensure_mapped(uint64_t id)
+{
+    if (sizeof(store_header) + (id + 1) * sizeof(store_entry) <= mapped_size)
+        return 0;
+    if (map_index() < 0)
+        return -1;
+    return sizeof(store_header) + (id + 1) * sizeof(store_entry) <= mapped_size ? 0 : -1;
+}
+
+/**
+ * @brief grow the index file so that it holds the entry of an ID
+ * @param id submission ID
+ * @return 0 on success, -1 on error
+ */
+static int grow_index(uint64_t id)
+{
+    flock(index_fd, LOCK_EX);
+    uint64_t capacity = header->capacity;
+    if (capacity <= id)
+    {
+        while (capacity <= id)
+            capacity *= 2;
+        if (ftruncate(index_fd, sizeof(store_header) + capacity * sizeof(store_entry)) < 0)
+        {
+            perror("ftruncate index failed");
+            flock(index_fd, LOCK_UN);
+            return -1;
+        }
+    }
+    int ret = map_index();
+    if (ret == 0)
+        header->capacity = capacity;
+    flock(index_fd, LOCK_UN);
+    return ret;
+}
+
+/**
+ * @brief write a whole buffer
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief index field that points at a record of the given kind
+ * @param rh record header, its entry mapped
+ * @return location or verdict field of the entry
+ */
+static uint64_t *record_slot(const record_header *rh)
+{
+    return rh->magic == VERDICT_MAGIC ? &entries[rh->id].verdict : &entries[rh->id].location;
+}
+
+/**
+ * @brief open the active segment for appending, starting a new one when it is full.
+ *      Judge nodes started from the same directory append to the same store.
+ * @param incoming byte size about to be appended
+ * @return 1 if a full segment was sealed, 0 otherwise, -1 on error
+ */
+static int open_segment(size_t incoming)
+{
+    int sealed = 0;
+    if (segment_fd >= 0 && segment_no != __atomic_load_n(&header->active_segment, __ATOMIC_ACQUIRE))
+    {
+        close(segment_fd);
+        segment_fd = -1;
+    }
+    struct stat st;
+    if (segment_fd >= 0 && fstat(segment_fd, &st) == 0 && st.st_size > 0 &&
+        (uint64_t)st.st_size + incoming > STORE_SEGMENT_SIZE)
+    {
+        // compaction allocates segment numbers from the same counter, and only
+        // one appender gets to advance the active segment
+        uint32_t next = __atomic_add_fetch(&header->next_segment, 1, __ATOMIC_SEQ_CST);
+        uint32_t expected = segment_no;
+        __atomic_compare_exchange_n(&header->active_segment, &expected, next, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+        close(segment_fd);
+        segment_fd = -1;
+        sealed = 1;
+    }
+    if (segment_fd >= 0)
+        return sealed;
+    uint32_t expected = 0;
+    if (__atomic_load_n(&header->active_segment, __ATOMIC_ACQUIRE) == 0)
+    {
+        uint32_t first = __atomic_add_fetch(&header->next_segment, 1, __ATOMIC_SEQ_CST);
+        __atomic_compare_exchange_n(&header->active_segment, &expected, first, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    }
+    segment_no = __atomic_load_n(&header->active_segment, __ATOMIC_ACQUIRE);
+
+    char path[300];
+    segment_path(segment_no, path, sizeof(path));
+    segment_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (segment_fd < 0)
+    {
+        perror("open segment failed");
+        return -1;
+    }
+    return sealed;
+}
+
+int store_open(const char *dir)
+{
+    strncpy(store_dir, dir, sizeof(store_dir) - 1);
+    store_dir[sizeof(store_dir) - 1] = '\0';
+    if (mkdir(store_dir, 0755) < 0 && errno != EEXIST)
+    {
+        perror("mkdir store failed");
+        return -1;
+    }
+    char path[300];
+    snprintf(path, sizeof(path), "%s/%s", store_dir, STORE_INDEX_FILE);
+    index_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (index_fd < 0)
+    {
+        perror("open index failed");
+        return -1;
+    }
+
+    flock(index_fd, LOCK_EX);
+    struct stat st;
+    if (fstat(index_fd, &st) == 0 && st.st_size < (off_t)sizeof(store_header))
+    {
+        store_header init;
+        memset(&init, 0, sizeof(init));
+        memcpy(init.magic, STORE_MAGIC, sizeof(init.magic));
+        init.capacity = INDEX_GROW;
+        if (ftruncate(index_fd, sizeof(store_header) + INDEX_GROW * sizeof(store_entry)) < 0 ||
+            pwrite(index_fd, &init, sizeof(init), 0) != sizeof(init))
+        {
+            perror("initialize index failed");
+            flock(index_fd, LOCK_UN);
+            return -1;
+        }
+    }
+    flock(index_fd, LOCK_UN);
+
+    if (map_index() < 0)
+        return -1;
+    if (memcmp(header->magic, STORE_MAGIC, sizeof(header->magic)) != 0)
+    {
+        fprintf(stderr, "%s is not a submission store index\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+void store_close(void)
+{
+    store_flush();
+    if (segment_fd >= 0)
+        close(segment_fd);
+    segment_fd = -1;
+    if (header)
+        munmap(header, mapped_size);
+    header = NULL;
+    entries = NULL;
+    if (index_fd >= 0)
+        close(index_fd);
+    index_fd = -1;
+    free(batch);
+    batch = NULL;
+    batch_cap = 0;
+    free(pending);
+    pending = NULL;
+    pending_cap = 0;
+}
+
+uint64_t store_reserve(void)
+{
+    uint64_t id = __atomic_add_fetch(&header->next_id, 1, __ATOMIC_SEQ_CST);
+    if (id >= header->capacity && grow_index(id) < 0)
+        return 0;
+    // another appender may have grown the index past our mapping
+    if (ensure_mapped(id) < 0)
+        return 0;
+    return id;
+}
+
+/**
+ * @brief add a record to the batch, flushing it once full
+ * @param magic RECORD_MAGIC or VERDICT_MAGIC
+ * @param id submission ID
+ * @param lang toolchain name
+ * @param data source or verdict
+ * @param len byte size of the data
+ * @return 0 on success, -1 on error
+ */
+static int queue_record(uint32_t magic, uint64_t id, const char *lang, const char *data, size_t len)
+{
+    if (id == 0 || id > header->next_id || len > STORE_MAX_SOURCE)
+        return -1;
+    size_t need = batch_len + sizeof(record_header) + len;
+    if (need > batch_cap)
+    {
+        size_t cap = batch_cap ? batch_cap : STORE_BATCH_SIZE;
+        while (cap < need)
+            cap *= 2;
+        char *grown = realloc(batch, cap);
+        if (!grown)
+        {
+            perror("realloc batch failed");
+            return -1;
+        }
+        batch = grown;
+        batch_cap = cap;
+    }
+    if (n_pending == pending_cap)
+    {
+        int cap = pending_cap ? pending_cap * 2 : 64;
+        pending_record *grown = realloc(pending, cap * sizeof(pending_record));
+        if (!grown)
+        {
+            perror("realloc batch failed");
+            return -1;
+        }
+        pending = grown;
+        pending_cap = cap;
+    }
+
+    record_header rh;
+    memset(&rh, 0, sizeof(rh));
+    rh.magic = magic;
+    rh.size = len;
+    rh.id = id;
+    strncpy(rh.lang, lang, sizeof(rh.lang) - 1);
+    rh.stored_at = time(NULL);
+
+    pending_record *p = &pending[n_pending++];
+    p->id = id;
+    p->offset = batch_len;
+    p->verdict = (magic == VERDICT_MAGIC);
+    memset(&p->entry, 0, sizeof(p->entry));
+    p->entry.size = len;
+    memcpy(p->entry.lang, rh.lang, sizeof(rh.lang));
+    p->entry.stored_at = rh.stored_at;
+
+    memcpy(batch + batch_len, &rh, sizeof(rh));
+    memcpy(batch + batch_len + sizeof(rh), data, len);
+    batch_len += sizeof(rh) + len;
+    if (batch_len >= STORE_BATCH_SIZE)
+        return store_flush();
+    return 0;
+}
+
+int store_append(uint64_t id, const char *lang, const char *data, size_t len)
+{
+    return queue_record(RECORD_MAGIC, id, lang, data, len);
+}
+
+int store_set_verdict(uint64_t id, const char *result, size_t len)
+{
+    return queue_record(VERDICT_MAGIC, id, "", result, len);
+}
+
+int store_flush(void)
+{
+    if (batch_len == 0)
+        return 0;
+    int sealed = open_segment(batch_len);
+    if (sealed < 0)
+        return -1;
+    // one O_APPEND write lands in one piece even with other appenders
+    off_t end;
+    if (write_all(segment_fd, batch, batch_len) < 0 || (end = lseek(segment_fd, 0, SEEK_CUR)) < 0)
+    {
+        perror("write segment failed");
+        close(segment_fd);
+        segment_fd = -1;
+        batch_len = 0;
+        n_pending = 0;
+        return -1;
+    }
+    uint64_t base = end - batch_len;
+    // entries only point at records that are completely written
+    for (int i = 0; i < n_pending; i++)
+    {
+        // a verdict may come for a submission another server process stored
+        if (ensure_mapped(pending[i].id) < 0)
+            continue;
+        store_entry *e = &entries[pending[i].id];
+        if (pending[i].verdict)
+        {
+            e->verdict_size = pending[i].entry.size;
+            __atomic_store_n(&e->verdict, LOCATION(segment_no, base + pending[i].offset), __ATOMIC_RELEASE);
+            continue;
+        }
+        e->size = pending[i].entry.size;
+        e->flags = 0;
+        memcpy(e->lang, pending[i].entry.lang, sizeof(e->lang));
+        e->stored_at = pending[i].entry.stored_at;
+        __atomic_store_n(&e->location, LOCATION(segment_no, base + pending[i].offset), __ATOMIC_RELEASE);
+    }
+    batch_len = 0;
+    n_pending = 0;
+    if (sealed)
+        store_compact_background();
+    return 0;
+}
+
+int store_get(uint64_t id, char **data, size_t *len, store_entry *entry)
+{
+    if (id == 0 || id > header->next_id || ensure_mapped(id) < 0)
+        return -1;
+    // compaction may move the record between the lookup and the open, look again once
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        store_entry e = entries[id];
+        e.location = __atomic_load_n(&entries[id].location, __ATOMIC_ACQUIRE);
+        if (e.location == 0 || (e.flags & STORE_REMOVED))
+            return -1;
+        char path[300];
+        segment_path(LOC_SEGMENT(e.location), path, sizeof(path));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == ENOENT)
+                continue;
+            perror("open segment failed");
+            return -1;
+        }
+        record_header rh;
+        off_t off = LOC_OFFSET(e.location);
+        char *buf = NULL;
+        if (pread(fd, &rh, sizeof(rh), off) == sizeof(rh) && rh.magic == RECORD_MAGIC && rh.id == id &&
+            (buf = malloc(rh.size + 1)) != NULL &&
+            pread(fd, buf, rh.size, off + sizeof(rh)) == (ssize_t)rh.size)
+        {
+            close(fd);
+            buf[rh.size] = '\0';
+            *data = buf;
+            *len = rh.size;
+            if (entry)
+                *entry = e;
+            return 0;
+        }
+        free(buf);
+        close(fd);
+    }
+    return -1;
+}
+
+int store_get_verdict(uint64_t id, char *result, size_t size, size_t *len)
+{
+    if (id == 0 || id > header->next_id || ensure_mapped(id) < 0)
+        return -1;
+    // compaction may move the record between the lookup and the open, look again once
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        uint64_t loc = __atomic_load_n(&entries[id].verdict, __ATOMIC_ACQUIRE);
+        if (loc == 0 || (entries[id].flags & STORE_REMOVED))
+            return -1;
+        char path[300];
+        segment_path(LOC_SEGMENT(loc), path, sizeof(path));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == ENOENT)
+                continue;
+            perror("open segment failed");
+            return -1;
+        }
+        record_header rh;
+        off_t off = LOC_OFFSET(loc);
+        size_t n = 0;
+        int ok = pread(fd, &rh, sizeof(rh), off) == sizeof(rh) && rh.magic == VERDICT_MAGIC && rh.id == id;
+        if (ok)
+        {
+            n = rh.size < size - 1 ? rh.size : size - 1;
+            ok = pread(fd, result, n, off + sizeof(rh)) == (ssize_t)n;
+        }
+        close(fd);
+        if (ok)
+        {
+            result[n] = '\0';
+            *len = n;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int store_remove(uint64_t id)
+{
+    if (id == 0 || id > header->next_id || ensure_mapped(id) < 0)
+        return -1;
+    if (__atomic_load_n(&entries[id].location, __ATOMIC_ACQUIRE) == 0)
+        return -1;
+    __atomic_or_fetch(&entries[id].flags, STORE_REMOVED, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+/**
+ * @brief copy the live records of one segment into the output segment
+ * @param seg segment to compact
+ * @param out_fd output segment
+ * @param out_size byte size of the output segment (in/out)
+ * @return 0 on success, -1 on error
+ */
+static int copy_live_records(uint32_t seg, int out_fd, uint64_t *out_size)
+{
+    char path[300];
+    segment_path(seg, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    char *map = NULL;
+    if (st.st_size > 0)
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+
+    int ret = 0;
+    uint64_t last_id = __atomic_load_n(&header->next_id, __ATOMIC_ACQUIRE);
+    off_t off = 0;
+    while (off + (off_t)sizeof(record_header) <= st.st_size)
+    {
+        record_header rh;
+        memcpy(&rh, map + off, sizeof(rh));
+        if (!IS_RECORD(rh.magic) || off + (off_t)sizeof(rh) + rh.size > st.st_size)
+            break;
+        size_t rec_len = sizeof(rh) + rh.size;
+        uint64_t old_loc = LOCATION(seg, off);
+        if (rh.id > 0 && rh.id <= last_id && ensure_mapped(rh.id) == 0 &&
+            __atomic_load_n(record_slot(&rh), __ATOMIC_ACQUIRE) == old_loc &&
+            !(entries[rh.id].flags & STORE_REMOVED))
+        {
+            if (write_all(out_fd, map + off, rec_len) < 0)
+            {
+                ret = -1;
+                break;
+            }
+            *out_size += rec_len;
+        }
+        off += rec_len;
+    }
+    if (map)
+        munmap(map, st.st_size);
+    return ret;
+}
+
+/**
+ * @brief point the entries of the records copied to the output segment at their new location
+ * @param out_seg number of the output segment
+ * @param old_segs compacted segments
+ * @param n_old number of compacted segments
+ */
+static void publish_moves(uint32_t out_seg, const uint32_t *old_segs, int n_old)
+{
+    char path[300];
+    segment_path(out_seg, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    off_t off = 0;
+    record_header rh;
+    while (pread(fd, &rh, sizeof(rh), off) == sizeof(rh) && IS_RECORD(rh.magic))
+    {
+        if (ensure_mapped(rh.id) == 0)
+        {
+            uint64_t *slot = record_slot(&rh);
+            uint64_t loc = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+            for (int i = 0; i < n_old; i++)
+            {
+                // an entry that changed in the meantime is left alone
+                if (LOC_SEGMENT(loc) == old_segs[i])
+                {
+                    __atomic_compare_exchange_n(slot, &loc, LOCATION(out_seg, off), 0,
+                                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+                    break;
+                }
+            }
+        }
+        off += sizeof(rh) + rh.size;
+    }
+    close(fd);
+}
+
+int store_compact(void)
+{
+    char path[300];
+    snprintf(path, sizeof(path), "%s/compact.lock", store_dir);
+    int lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0)
+    {
+        perror("open compact lock failed");
+        return -1;
+    }
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) < 0)
+    {
+        close(lock_fd);
+        return 0;
+    }
+
+    // live bytes of every segment, from one pass over the index
+    uint32_t n_segments = __atomic_load_n(&header->next_segment, __ATOMIC_ACQUIRE);
+    uint64_t last_id = __atomic_load_n(&header->next_id, __ATOMIC_ACQUIRE);
+    uint64_t *live = calloc(n_segments + 1, sizeof(uint64_t));
+    uint32_t *victims = malloc((n_segments + 1) * sizeof(uint32_t));
+    if (!live || !victims || ensure_mapped(last_id) < 0)
+    {
+        free(live);
+        free(victims);
+        close(lock_fd);
+        return -1;
+    }
+    for (uint64_t id = 1; id <= last_id; id++)
+    {
+        if (entries[id].flags & STORE_REMOVED)
+            continue;
+        uint64_t loc = __atomic_load_n(&entries[id].location, __ATOMIC_ACQUIRE);
+        if (loc && LOC_SEGMENT(loc) <= n_segments)
+            live[LOC_SEGMENT(loc)] += sizeof(record_header) + entries[id].size;
+        loc = __atomic_load_n(&entries[id].verdict, __ATOMIC_ACQUIRE);
+        if (loc && LOC_SEGMENT(loc) <= n_segments)
+            live[LOC_SEGMENT(loc)] += sizeof(record_header) + entries[id].verdict_size;
+    }
+
+    // sealed segments that are more than half dead, as long as the output stays one segment
+    int n_victims = 0;
+    uint64_t out_bytes = 0;
+    uint32_t active = __atomic_load_n(&header->active_segment, __ATOMIC_ACQUIRE);
+    for (uint32_t seg = 1; seg <= n_segments; seg++)
+    {
+        struct stat st;
+        segment_path(seg, path, sizeof(path));
+        // an appender that has not noticed the rotation yet may still write to a recent segment
+        if (seg == active || stat(path, &st) < 0 || live[seg] * 2 >= (uint64_t)st.st_size ||
+            time(NULL) - st.st_mtime < STORE_COMPACT_AGE)
+            continue;
+        if (out_bytes > 0 && out_bytes + live[seg] > STORE_SEGMENT_SIZE)
+            break;
+        victims[n_victims++] = seg;
+        out_bytes += live[seg];
+    }
+    free(live);
+
+    int removed = 0;
+    if (n_victims > 0)
+    {
+        uint32_t out_seg = __atomic_add_fetch(&header->next_segment, 1, __ATOMIC_SEQ_CST);
+        segment_path(out_seg, path, sizeof(path));
+        int out_fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (out_fd < 0)
+        {
+            perror("open segment failed");
+            removed = -1;
+        }
+        else
+        {
+            uint64_t out_size = 0;
+            int ok = 1;
+            for (int i = 0; i < n_victims && ok; i++)
+                ok = (copy_live_records(victims[i], out_fd, &out_size) == 0);
+            // the copies must be durable before the entries point at them
+            ok = ok && fsync(out_fd) == 0;
+            close(out_fd);
+            if (ok)
+            {
+                publish_moves(out_seg, victims, n_victims);
+                for (int i = 0; i < n_victims; i++)
+                {
+                    segment_path(victims[i], path, sizeof(path));
+                    if (unlink(path) == 0)
+                        removed++;
+                }
+                if (out_size == 0)
+                {
+                    segment_path(out_seg, path, sizeof(path));
+                    unlink(path);
+                }
+            }
+            else
+            {
+                perror("compact segment failed");
+                segment_path(out_seg, path, sizeof(path));
+                unlink(path);
+                removed = -1;
+            }
+        }
+    }
+    free(victims);
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+    return removed;
+}
+
+void store_compact_background(void)
+{
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork failed");
+    }
+    else if (pid == 0)
+    {
+        // the index mapping is shared with the parent, only the entries move;
+        // client sockets must not outlive the parent's close
+        if (index_fd > 3)
+            close_range(3, index_fd - 1, 0);
+        close_range(index_fd + 1, ~0u, 0);
+        store_compact();
+        _exit(0);
+    }
+}
+
+uint64_t store_last_id(void)
+{
+    return header ? __atomic_load_n(&header->next_id, __ATOMIC_ACQUIRE) : 0;
+}
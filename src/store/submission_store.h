@@ -0,0 +1,122 @@
+#ifndef SUBMISSION_STORE_H
+#define SUBMISSION_STORE_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define STORE_DIR "files/store"
+#define STORE_INDEX_FILE "index"
+#define STORE_SEGMENT_SIZE (64u << 20) // a segment is sealed once it grows past this size
+#define STORE_BATCH_SIZE (256u << 10)  // pending records are written once they reach this size
+#define STORE_MAX_SOURCE (16u << 20)   // largest accepted submission
+#define STORE_LANG_SIZE 8
+#define STORE_REMOVED 0x1
+
+/**
+ * @brief index entry of a submission, the index is an array of these by ID
+ */
+typedef struct store_entry
+{
+    uint64_t location;            // segment << 40 | offset of the record, 0 if not stored
+    uint32_t size;                // byte size of the source
+    uint32_t flags;               // STORE_REMOVED
+    char lang[STORE_LANG_SIZE];   // toolchain name
+    int64_t stored_at;            // submission time (unix time)
+    uint64_t verdict;             // segment << 40 | offset of the verdict record, 0 if none
+    uint32_t verdict_size;        // byte size of the verdict
+    uint32_t reserved;
+} store_entry;
+
+/**
+ * @brief Open (or create) the store. One process appends, others may read,
+ *      remove and compact concurrently.
+ * @param dir store directory
+ * @return 0 on success, -1 on error
+ */
+int store_open(const char *dir);
+
+/**
+ * @brief Flush pending records and unmap the index
+ */
+void store_close(void);
+
+/**
+ * @brief Allocate the next submission ID
+ * @return submission ID (from 1), or 0 on error
+ */
+uint64_t store_reserve(void);
+
+/**
+ * @brief Queue a submission for writing. The record reaches the segment with
+ *      the next store_flush, or right away once the batch is full.
+ * @param id ID returned by store_reserve
+ * @param lang toolchain name
+ * @param data source
+ * @param len byte size of the source
+ * @return 0 on success, -1 on error
+ */
+int store_append(uint64_t id, const char *lang, const char *data, size_t len);
+
+/**
+ * @brief Queue the verdict the server gave a submission, replacing any earlier one.
+ *      It is written with the next store_flush, like a source.
+ * @param id submission ID
+ * @param result verdict text
+ * @param len byte size of the verdict
+ * @return 0 on success, -1 on error
+ */
+int store_set_verdict(uint64_t id, const char *result, size_t len);
+
+/**
+ * @brief Write the pending records with one write and publish their index entries
+ * @return 0 on success, -1 on error
+ */
+int store_flush(void);
+
+/**
+ * @brief Read a submission, one index lookup and one read
+ * @param id submission ID
+ * @param data heap-allocated source (output), freed by the caller
+ * @param len byte size of the source (output)
+ * @param entry index entry (output), may be NULL
+ * @return 0 on success, -1 if the submission is not stored or was removed
+ */
+int store_get(uint64_t id, char **data, size_t *len, store_entry *entry);
+
+/**
+ * @brief Read the verdict the server gave a submission
+ * @param id submission ID
+ * @param result verdict buffer (output), NUL-terminated, a longer verdict is cut
+ * @param size size of the verdict buffer
+ * @param len byte size of the verdict read (output)
+ * @return 0 on success, -1 if no verdict is stored or the submission was removed
+ */
+int store_get_verdict(uint64_t id, char *result, size_t size, size_t *len);
+
+/**
+ * @brief Mark a submission removed, its space is reclaimed by compaction
+ * @param id submission ID
+ * @return 0 on success, -1 if the submission is not stored
+ */
+int store_remove(uint64_t id);
+
+/**
+ * @brief Copy the live records of sealed, mostly dead segments into a new
+ *      segment and delete the old ones. Does nothing while another process compacts.
+ * @return number of segments deleted, or -1 on error
+ */
+int store_compact(void);
+
+/**
+ * @brief Run store_compact in a forked child
+ */
+void store_compact_background(void);
+
+/**
+ * @brief Number of IDs allocated so far
+ * @return highest submission ID
+ */
+uint64_t store_last_id(void);
+
+#endif // SUBMISSION_STORE_H
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "store/submission_store.h"
+#include "defineshit.h"
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-d store_dir] get <id> | info <id> | remove <id> | compact | last\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = STORE_DIR;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *cmd = argv[optind];
+    int needs_id = strcmp(cmd, "get") == 0 || strcmp(cmd, "info") == 0 || strcmp(cmd, "remove") == 0;
+    if (needs_id && optind + 1 >= argc)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    uint64_t id = needs_id ? strtoull(argv[optind + 1], NULL, 10) : 0;
+    if (store_open(dir) < 0)
+        return 1;
+
+    int ret = 0;
+    if (strcmp(cmd, "get") == 0 || strcmp(cmd, "info") == 0)
+    {
+        char *source;
+        size_t len;
+        store_entry entry;
+        if (store_get(id, &source, &len, &entry) < 0)
+        {
+            fprintf(stderr, "submission %llu not found\n", (unsigned long long)id);
+            ret = 1;
+        }
+        else
+        {
+            if (strcmp(cmd, "get") == 0)
+            {
+                fwrite(source, 1, len, stdout);
+            }
+            else
+            {
+                time_t at = entry.stored_at;
+                char when[64];
+                strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&at));
+                printf("id: %llu\nlanguage: %.8s\nsize: %zu bytes\nstored: %s\n", (unsigned long long)id,
+                       entry.lang, len, when);
+            }
+            free(source);
+        }
+    }
+    else if (strcmp(cmd, "remove") == 0)
+    {
+        if (store_remove(id) < 0)
+        {
+            fprintf(stderr, "submission %llu not found\n", (unsigned long long)id);
+            ret = 1;
+        }
+    }
+    else if (strcmp(cmd, "compact") == 0)
+    {
+        int n = store_compact();
+        if (n < 0)
+            ret = 1;
+        else
+            printf("%d segment(s) compacted\n", n);
+    }
+    else if (strcmp(cmd, "last") == 0)
+    {
+        printf("%llu\n", (unsigned long long)store_last_id());
+    }
+    else
+    {
+        usage(argv[0]);
+        ret = 1;
+    }
+    store_close();
+    return ret;
+}
@@ -0,0 +1,647 @@
+#include "batch.h"
+#include "tcp_client.h"
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/socket.h>
+
+#define MAX_VERDICT_KINDS 32 // distinct verdicts counted in a summary, later ones count as "Other"
+
+// progress of a connection
+typedef enum
+{
+    CONN_IDLE,
+    CONN_CONNECTING,
+    CONN_HEADER,
+    CONN_BODY,
+    CONN_REPLY
+} conn_state;
+
+/**
+ * @brief connection of the pool, carrying one submission
+ */
+typedef struct batch_conn
+{
+    int fd;                       // socket, -1 while idle
+    conn_state state;
+    size_t item;                  // submission being uploaded
+    int file_fd;                  // source file
+    char header[HEADER_SIZE];
+    size_t header_off;            // header bytes sent
+    off_t body_off;               // source bytes sent
+    char reply[BATCH_REPLY_SIZE]; // reply received so far
+    size_t reply_len;
+    int64_t started_us;           // connect time
+} batch_conn;
+
+/**
+ * @brief CLOCK_MONOTONIC time in microseconds
+ */
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief append a submission
+ * @param b batch
+ * @param path source file, copied
+ * @return 0 on success, -1 on error
+ */
+static int add_item(batch *b, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        fprintf(stderr, "%s: not a regular file\n", path);
+        return -1;
+    }
+    if (b->count == b->cap)
+    {
+        size_t cap = b->cap ? b->cap * 2 : 64;
+        batch_item *items = realloc(b->items, cap * sizeof(batch_item));
+        if (!items)
+        {
+            perror("malloc failed");
+            return -1;
+        }
+        b->items = items;
+        b->cap = cap;
+    }
+    batch_item *item = &b->items[b->count];
+    memset(item, 0, sizeof(*item));
+    item->path = strdup(path);
+    if (!item->path)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    item->size = st.st_size;
+    b->count++;
+    return 0;
+}
+
+/**
+ * @brief qsort comparator for file names
+ */
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief add the source files of a directory in name order
+ * @param b batch
+ * @param dir directory
+ * @return number of submissions added, -1 on error
+ */
+static int load_dir(batch *b, const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        perror("opendir failed");
+        return -1;
+    }
+    char **names = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *e;
+    while ((e = readdir(d)))
+    {
+        // other files (notes, expected outputs) may sit next to the sources
+        if (e->d_name[0] == '.' || !toolchain_by_path(e->d_name))
+            continue;
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            char **grown = realloc(names, cap * sizeof(char *));
+            if (!grown)
+                break;
+            names = grown;
+        }
+        if (!(names[n] = strdup(e->d_name)))
+            break;
+        n++;
+    }
+    closedir(d);
+    qsort(names, n, sizeof(char *), compare_names);
+    int added = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        if (added >= 0 && add_item(b, path) == 0)
+            added++;
+        else
+            added = -1;
+        free(names[i]);
+    }
+    free(names);
+    return added;
+}
+
+/**
+ * @brief add the sources listed in a manifest
+ * @param b batch
+ * @param manifest manifest file
+ * @return number of submissions added, -1 on error
+ */
+static int load_manifest(batch *b, const char *manifest)
+{
+    FILE *fp = fopen(manifest, "r");
+    if (!fp)
+    {
+        perror("fopen manifest failed");
+        return -1;
+    }
+    // relative paths are relative to the manifest, wherever the client runs
+    char base[PATH_MAX];
+    snprintf(base, sizeof(base), "%s", manifest);
+    char *slash = strrchr(base, '/');
+    if (slash)
+        slash[1] = '\0';
+    else
+        base[0] = '\0';
+    char line[PATH_MAX];
+    int added = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        size_t len = strcspn(line, "\r\n");
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t'))
+            len--;
+        line[len] = '\0';
+        if (len == 0 || line[0] == '#')
+            continue;
+        char path[PATH_MAX * 2];
+        snprintf(path, sizeof(path), "%s%s", line[0] == '/' ? "" : base, line);
+        if (add_item(b, path) < 0)
+        {
+            added = -1;
+            break;
+        }
+        added++;
+    }
+    fclose(fp);
+    return added;
+}
+
+int batch_load(batch *b, const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0)
+    {
+        perror("stat failed");
+        return -1;
+    }
+    return S_ISDIR(st.st_mode) ? load_dir(b, path) : load_manifest(b, path);
+}
+
+/**
+ * @brief reduce a reply to its first line, without time and memory
+ * @param reply reply of the server
+ * @param verdict summary (output), BATCH_VERDICT_SIZE bytes
+ */
+static void summarize(const char *reply, char *verdict)
+{
+    while (*reply == '\n')
+        reply++;
+    size_t len = strcspn(reply, "\n");
+    if (len > 0 && reply[len - 1] == ':')
+        len--;
+    if (len > BATCH_VERDICT_SIZE - 1)
+        len = BATCH_VERDICT_SIZE - 1;
+    memcpy(verdict, reply, len);
+    verdict[len] = '\0';
+}
+
+/**
+ * @brief close a connection and record the outcome of its submission
+ * @param b batch
+ * @param c connection
+ * @param error what failed, NULL if the server replied
+ */
+static void finish(batch *b, batch_conn *c, const char *error)
+{
+    batch_item *item = &b->items[c->item];
+    item->latency_ms = (now_us() - c->started_us) / 1000.0;
+    if (!error && c->reply_len == 0)
+        error = "connection closed without a reply";
+    if (error)
+    {
+        item->status = BATCH_FAILED;
+        snprintf(item->error, sizeof(item->error), "%s", error);
+    }
+    else
+    {
+        item->status = BATCH_DONE;
+        c->reply[c->reply_len] = '\0';
+        item->reply = strdup(c->reply);
+        summarize(c->reply, item->verdict);
+    }
+    close(c->fd);
+    close(c->file_fd);
+    c->fd = -1;
+    c->file_fd = -1;
+    c->state = CONN_IDLE;
+}
+
+/**
+ * @brief record a failed system call as the outcome of the submission
+ */
+static void fail(batch *b, batch_conn *c, const char *what)
+{
+    char error[96];
+    snprintf(error, sizeof(error), "%s: %s", what, strerror(errno));
+    finish(b, c, error);
+}
+
+/**
+ * @brief open the source and start a non-blocking connect for a submission
+ * @param b batch
+ * @param c idle connection
+ * @param index submission
+ * @param addr server address
+ * @param mode UPLOAD_WAIT, UPLOAD_DETACHED or UPLOAD_PROFILE
+ */
+static void start(batch *b, batch_conn *c, size_t index, const struct sockaddr_in *addr, int mode)
+{
+    batch_item *item = &b->items[index];
+    c->item = index;
+    c->started_us = now_us();
+    c->header_off = 0;
+    c->body_off = 0;
+    c->reply_len = 0;
+    c->fd = -1;
+    c->state = CONN_CONNECTING;
+    c->file_fd = open(item->path, O_RDONLY | O_CLOEXEC);
+    if (c->file_fd < 0)
+    {
+        fail(b, c, "open");
+        return;
+    }
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0)
+    {
+        fail(b, c, "socket");
+        return;
+    }
+    const toolchain *tc = toolchain_by_path(item->path);
+    make_upload_header(c->header, tc ? tc : toolchain_default(), mode, item->size);
+    if (connect(c->fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 && errno != EINPROGRESS)
+        fail(b, c, "connect");
+}
+
+/**
+ * @brief move a connection forward as far as its socket allows
+ * @param b batch
+ * @param c busy connection
+ * @param last_upload_us time the latest upload completed (in/out)
+ */
+static void progress(batch *b, batch_conn *c, int64_t *last_upload_us)
+{
+    batch_item *item = &b->items[c->item];
+    if (c->state == CONN_CONNECTING)
+    {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err)
+        {
+            errno = err ? err : errno;
+            fail(b, c, "connect");
+            return;
+        }
+        c->state = CONN_HEADER;
+    }
+    if (c->state == CONN_HEADER)
+    {
+        while (c->header_off < HEADER_SIZE)
+        {
+            ssize_t n = send(c->fd, c->header + c->header_off, HEADER_SIZE - c->header_off, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                    return;
+                fail(b, c, "send");
+                return;
+            }
+            c->header_off += n;
+        }
+        c->state = CONN_BODY;
+    }
+    if (c->state == CONN_BODY)
+    {
+        while ((uint64_t)c->body_off < item->size)
+        {
+            ssize_t n = sendfile(c->fd, c->file_fd, &c->body_off, item->size - c->body_off);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return;
+            if (n < 0 && (errno == EPIPE || errno == ECONNRESET))
+                break; // the server refused the rest (source too large), its reply says why
+            if (n <= 0)
+            {
+                fail(b, c, "sendfile");
+                return;
+            }
+        }
+        *last_upload_us = now_us();
+        item->upload_ms = (*last_upload_us - c->started_us) / 1000.0;
+        b->bytes += c->body_off;
+        c->state = CONN_REPLY;
+    }
+    // the server closes the connection after its reply
+    while (1)
+    {
+        size_t room = sizeof(c->reply) - 1 - c->reply_len;
+        char discard[1024];
+        ssize_t n = recv(c->fd, room ? c->reply + c->reply_len : discard, room ? room : sizeof(discard), 0);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return;
+            fail(b, c, "recv");
+            return;
+        }
+        if (n == 0)
+            break;
+        if (room)
+            c->reply_len += n;
+    }
+    finish(b, c, NULL);
+}
+
+int batch_run(batch *b, const char *server_ip, int port, int conns, int mode)
+{
+    if (conns < 1 || conns > BATCH_MAX_CONNS)
+    {
+        fprintf(stderr, "connections must be 1 to %d\n", BATCH_MAX_CONNS);
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, server_ip, &addr.sin_addr) <= 0)
+    {
+        perror("inet_pton failed");
+        return -1;
+    }
+    batch_conn *pool = calloc(conns, sizeof(batch_conn));
+    struct pollfd *fds = calloc(conns, sizeof(struct pollfd));
+    int *busy = calloc(conns, sizeof(int));
+    if (!pool || !fds || !busy)
+    {
+        perror("malloc failed");
+        free(pool);
+        free(fds);
+        free(busy);
+        return -1;
+    }
+    for (int i = 0; i < conns; i++)
+    {
+        pool[i].fd = -1;
+        pool[i].file_fd = -1;
+    }
+    // sendfile has no MSG_NOSIGNAL, a server closing early must not kill the client
+    void (*old_pipe)(int) = signal(SIGPIPE, SIG_IGN);
+
+    int64_t first_us = now_us();
+    int64_t last_upload_us = first_us;
+    size_t next = 0;
+    int active = 0;
+    while (next < b->count || active > 0)
+    {
+        for (int i = 0; i < conns && next < b->count; i++)
+        {
+            if (pool[i].state == CONN_IDLE)
+                start(b, &pool[i], next++, &addr, mode);
+        }
+        int n = 0;
+        int64_t deadline_us = 0;
+        for (int i = 0; i < conns; i++)
+        {
+            if (pool[i].state == CONN_IDLE)
+                continue;
+            fds[n].fd = pool[i].fd;
+            fds[n].events = pool[i].state == CONN_REPLY ? POLLIN : POLLOUT;
+            fds[n].revents = 0;
+            busy[n++] = i;
+            int64_t deadline = pool[i].started_us + (int64_t)BATCH_TIMEOUT_MS * 1000;
+            if (!deadline_us || deadline < deadline_us)
+                deadline_us = deadline;
+        }
+        active = n;
+        if (n == 0)
+            continue;
+        int64_t left_us = deadline_us - now_us();
+        int timeout = left_us > 0 ? (int)((left_us + 999) / 1000) : 0;
+        if (poll(fds, n, timeout) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll failed");
+            break;
+        }
+        int64_t now = now_us();
+        for (int k = 0; k < n; k++)
+        {
+            batch_conn *c = &pool[busy[k]];
+            if (fds[k].revents)
+                progress(b, c, &last_upload_us);
+            // a server that accepted and went silent must not stall the batch
+            if (c->state != CONN_IDLE && now - c->started_us >= (int64_t)BATCH_TIMEOUT_MS * 1000)
+            {
+                char error[96];
+                snprintf(error, sizeof(error), "no reply within %d s", BATCH_TIMEOUT_MS / 1000);
+                finish(b, c, error);
+            }
+        }
+    }
+    b->upload_ms = (last_upload_us - first_us) / 1000.0;
+    b->total_ms = (now_us() - first_us) / 1000.0;
+    signal(SIGPIPE, old_pipe);
+    free(pool);
+    free(fds);
+    free(busy);
+
+    for (size_t i = 0; i < b->count; i++)
+    {
+        if (b->items[i].status != BATCH_DONE)
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief write a string as a JSON string literal
+ */
+static void json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        unsigned char ch = *s;
+        if (ch == '"' || ch == '\\')
+            fprintf(out, "\\%c", ch);
+        else if (ch == '\n')
+            fputs("\\n", out);
+        else if (ch == '\t')
+            fputs("\\t", out);
+        else if (ch < 0x20)
+            fprintf(out, "\\u%04x", ch);
+        else
+            fputc(ch, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief write a string as a CSV field, quoted
+ */
+static void csv_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        if (*s == '"')
+            fputc('"', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief index of a verdict among those counted so far
+ * @return index, kinds if not counted yet
+ */
+static int find_verdict(const char *names[MAX_VERDICT_KINDS], int kinds, const char *verdict)
+{
+    int k = 0;
+    while (k < kinds && strcmp(names[k], verdict) != 0)
+        k++;
+    return k;
+}
+
+/**
+ * @brief count the submissions per verdict, failed ones under "Failed"
+ * @param b batch
+ * @param names verdicts (output), in order of first appearance
+ * @param counts submissions per verdict (output)
+ * @return number of distinct verdicts
+ */
+static int count_verdicts(const batch *b, const char *names[MAX_VERDICT_KINDS], size_t counts[MAX_VERDICT_KINDS])
+{
+    int kinds = 0;
+    for (size_t i = 0; i < b->count; i++)
+    {
+        const char *v = b->items[i].status == BATCH_DONE ? b->items[i].verdict : "Failed";
+        // detached uploads are told their ticket, one per submission
+        if (strncmp(v, "Ticket:", 7) == 0)
+            v = "Ticket";
+        int k = find_verdict(names, kinds, v);
+        if (k == kinds && kinds == MAX_VERDICT_KINDS - 1)
+        {
+            v = "Other";
+            k = find_verdict(names, kinds, v);
+        }
+        if (k == kinds)
+        {
+            names[kinds] = v;
+            counts[kinds++] = 0;
+        }
+        counts[k]++;
+    }
+    return kinds;
+}
+
+/**
+ * @brief megabytes per second of a byte count over a duration
+ */
+static double mb_per_s(uint64_t bytes, double ms)
+{
+    return ms > 0 ? bytes / (ms * 1000.0) : 0;
+}
+
+void batch_write_json(const batch *b, FILE *out)
+{
+    size_t failed = 0;
+    for (size_t i = 0; i < b->count; i++)
+        failed += (b->items[i].status != BATCH_DONE);
+    fprintf(out, "{\n  \"submissions\": %zu,\n  \"failed\": %zu,\n  \"bytes\": %llu,\n", b->count, failed,
+            (unsigned long long)b->bytes);
+    fprintf(out, "  \"upload_ms\": %.1f,\n  \"upload_mb_per_s\": %.3f,\n  \"total_ms\": %.1f,\n", b->upload_ms,
+            mb_per_s(b->bytes, b->upload_ms), b->total_ms);
+    fprintf(out, "  \"submissions_per_s\": %.2f,\n  \"verdicts\": {", b->total_ms > 0 ? b->count * 1000.0 / b->total_ms : 0);
+    const char *names[MAX_VERDICT_KINDS];
+    size_t counts[MAX_VERDICT_KINDS];
+    int kinds = count_verdicts(b, names, counts);
+    for (int k = 0; k < kinds; k++)
+    {
+        fputs(k ? ", " : "", out);
+        json_string(out, names[k]);
+        fprintf(out, ": %zu", counts[k]);
+    }
+    fputs("},\n  \"results\": [\n", out);
+    for (size_t i = 0; i < b->count; i++)
+    {
+        const batch_item *item = &b->items[i];
+        fputs("    {\"file\": ", out);
+        json_string(out, item->path);
+        fprintf(out, ", \"bytes\": %llu, \"status\": \"%s\", ", (unsigned long long)item->size,
+                item->status == BATCH_DONE ? "done" : "failed");
+        if (item->status == BATCH_DONE)
+        {
+            fputs("\"verdict\": ", out);
+            json_string(out, item->verdict);
+            fputs(", \"reply\": ", out);
+            json_string(out, item->reply ? item->reply : "");
+        }
+        else
+        {
+            fputs("\"error\": ", out);
+            json_string(out, item->error);
+        }
+        fprintf(out, ", \"upload_ms\": %.1f, \"latency_ms\": %.1f}%s\n", item->upload_ms, item->latency_ms,
+                i + 1 < b->count ? "," : "");
+    }
+    fputs("  ]\n}\n", out);
+}
+
+void batch_write_csv(const batch *b, FILE *out)
+{
+    fputs("file,bytes,status,verdict,upload_ms,latency_ms\n", out);
+    for (size_t i = 0; i < b->count; i++)
+    {
+        const batch_item *item = &b->items[i];
+        csv_string(out, item->path);
+        fprintf(out, ",%llu,%s,", (unsigned long long)item->size, item->status == BATCH_DONE ? "done" : "failed");
+        csv_string(out, item->status == BATCH_DONE ? item->verdict : item->error);
+        fprintf(out, ",%.1f,%.1f\n", item->upload_ms, item->latency_ms);
+    }
+}
+
+void batch_report(const batch *b, FILE *out)
+{
+    fprintf(out, "Uploaded %zu submission(s), %llu bytes in %.1f ms (%.3f MB/s); all replies in %.1f ms (%.2f/s)\n",
+            b->count, (unsigned long long)b->bytes, b->upload_ms, mb_per_s(b->bytes, b->upload_ms), b->total_ms,
+            b->total_ms > 0 ? b->count * 1000.0 / b->total_ms : 0);
+    const char *names[MAX_VERDICT_KINDS];
+    size_t counts[MAX_VERDICT_KINDS];
+    int kinds = count_verdicts(b, names, counts);
+    for (int k = 0; k < kinds; k++)
+        fprintf(out, "  %s: %zu\n", names[k], counts[k]);
+}
+
+void batch_free(batch *b)
+{
+    for (size_t i = 0; i < b->count; i++)
+    {
+        free(b->items[i].path);
+        free(b->items[i].reply);
+    }
+    free(b->items);
+    memset(b, 0, sizeof(*b));
+}
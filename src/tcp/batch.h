@@ -0,0 +1,107 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "../defineshit.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Batch upload. Submissions from a directory or a manifest are uploaded over a small
+ * pool of non-blocking connections, file bodies with sendfile. The server answers one
+ * submission per connection, so a connection that got its reply is replaced by a new
+ * one for the next submission. A submission not answered within BATCH_TIMEOUT_MS fails
+ * and its connection moves on to the next one.
+ */
+
+#define BATCH_DEFAULT_CONNS 4
+#define BATCH_MAX_CONNS 64
+#define BATCH_REPLY_SIZE 16384 // room for the longest reply: full compile or runtime error output
+#define BATCH_VERDICT_SIZE 32  // verdict summary: the first line of the reply
+#define BATCH_TIMEOUT_MS 300000 // a submission without a reply this long after its connect fails
+
+// outcome of one submission
+typedef enum
+{
+    BATCH_PENDING, // not uploaded yet
+    BATCH_DONE,    // the server replied, reply is set
+    BATCH_FAILED   // no reply, error is set
+} batch_status;
+
+/**
+ * @brief submission of a batch
+ */
+typedef struct batch_item
+{
+    char *path;                         // source file
+    uint64_t size;                      // byte size of the source
+    batch_status status;
+    char *reply;                        // reply of the server, NULL until answered
+    char verdict[BATCH_VERDICT_SIZE];   // first line of the reply, without a trailing ':'
+    char error[96];                     // what failed, empty unless failed
+    double upload_ms;                   // from the connect to the last source byte sent
+    double latency_ms;                  // from the connect to the end of the reply
+} batch_item;
+
+/**
+ * @brief submissions of a batch and the totals of its run
+ */
+typedef struct batch
+{
+    batch_item *items; // in directory or manifest order
+    size_t count;
+    size_t cap;
+    uint64_t bytes;    // source bytes sent
+    double upload_ms;  // from the first connect to the last source byte sent
+    double total_ms;   // from the first connect to the last reply
+} batch;
+
+/**
+ * @brief Add the submissions of a directory, the files with a known source extension
+ *      in name order, or of a manifest, one source path per line relative to the
+ *      manifest's directory ('#' starts a comment line)
+ * @param b batch, zeroed before the first call
+ * @param path directory or manifest
+ * @return number of submissions added, -1 on error
+ */
+int batch_load(batch *b, const char *path);
+
+/**
+ * @brief Upload every submission and collect the replies
+ * @param b loaded batch
+ * @param server_ip server IP address
+ * @param port server port number
+ * @param conns connections open at once, 1 to BATCH_MAX_CONNS
+ * @param mode UPLOAD_WAIT, UPLOAD_DETACHED or UPLOAD_PROFILE
+ * @return 0 if every submission got a reply, 1 if some failed, -1 on error
+ */
+int batch_run(batch *b, const char *server_ip, int port, int conns, int mode);
+
+/**
+ * @brief Write the totals and the per-submission results as JSON
+ * @param b batch after batch_run
+ * @param out output stream
+ */
+void batch_write_json(const batch *b, FILE *out);
+
+/**
+ * @brief Write the per-submission results as CSV with a header line
+ * @param b batch after batch_run
+ * @param out output stream
+ */
+void batch_write_csv(const batch *b, FILE *out);
+
+/**
+ * @brief Print the upload throughput and the verdict counts for humans
+ * @param b batch after batch_run
+ * @param out output stream
+ */
+void batch_report(const batch *b, FILE *out);
+
+/**
+ * @brief Free the submissions of a batch
+ * @param b batch
+ */
+void batch_free(batch *b);
+
+#endif // BATCH_H
@@ -0,0 +1,710 @@
+#include "handover.h"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#define HANDOVER_VERSION 6
+#define HANDOVER_CONN 1
+#define HANDOVER_END 2
+#define HANDOVER_TICKET 3
+#define HANDOVER_MAX_FDS 3
+
+// descriptors attached to a connection record
+#define FD_CONN 0x1  // client socket
+#define FD_PIPE 0x2  // judge stdout pipe or node socket
+#define FD_STDIN 0x4 // judge stdin pipe
+
+/**
+ * @brief first message of the new server, the old one only hands over to the same layout
+ */
+typedef struct handover_hello
+{
+    char magic[8];        // HANDOVER_MAGIC
+    uint32_t version;     // HANDOVER_VERSION
+    uint32_t record_size; // sizeof(handover_record)
+} handover_hello;
+
+/**
+ * @brief client connection or detached submission and its judge job, the sources follow
+ *      in HANDOVER_CHUNK messages
+ */
+typedef struct handover_record
+{
+    uint32_t kind;    // HANDOVER_CONN, HANDOVER_TICKET or HANDOVER_END
+    uint32_t fd_mask; // FD_CONN | FD_PIPE | FD_STDIN, in the order of the attached descriptors
+
+    struct sockaddr_in addr;
+    int32_t state;
+    char header[HEADER_SIZE];
+    uint64_t header_bytes;
+    uint64_t file_size;
+    uint64_t file_received;
+    uint64_t submission_id;
+    char lang[STORE_LANG_SIZE]; // toolchain name, empty before the header
+    int32_t node_job;
+    int32_t detached;
+    int32_t profile;
+    int32_t query;
+    int64_t wait_until;
+    uint64_t stream_off;
+    char judge_result[NODE_HEADER_SIZE + JUDGE_RESULT_SIZE];
+    uint64_t judge_result_len;
+    uint64_t judge_sent;
+    char source_filename[256]; // also the job's
+    sha256_ctx source_hash;
+    cache_key cache;
+    int32_t has_source; // conn->source follows, file_received bytes
+
+    int32_t has_job;
+    int32_t stage;
+    int32_t pid;
+    int32_t local_only;
+    int32_t node;
+    int32_t attempts;
+    uint32_t user;
+    double cost_ms;
+    int64_t queued_at;
+    int64_t started_at;
+    int64_t waited_ms;
+    int32_t job_profile;
+    char profile_test[RECORD_TEST_NAME_SIZE];
+    int32_t cpu;
+    int32_t slot;
+    int32_t job_has_source; // job->source follows, source_len bytes
+    uint64_t source_len;
+    uint64_t source_off;
+    uint64_t send_len;
+    uint64_t send_off;
+    char node_header[NODE_HEADER_SIZE];
+    uint64_t node_header_len;
+    char result[JUDGE_RESULT_SIZE];
+    uint64_t result_len;
+} handover_record;
+
+/**
+ * @brief path of the handover socket of a port
+ * @param addr socket address (output)
+ * @param port TCP port of the server
+ */
+static void handover_addr(struct sockaddr_un *addr, int port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    snprintf(addr->sun_path, sizeof(addr->sun_path), HANDOVER_PATH_FMT, port);
+}
+
+/**
+ * @brief send one message with descriptors attached
+ * @param sock handover connection
+ * @param buf message
+ * @param len byte size of the message
+ * @param fds descriptors to attach
+ * @param n_fds number of descriptors, may be 0
+ * @return 0 on success, -1 on error
+ */
+static int send_msg(int sock, const void *buf, size_t len, const int *fds, int n_fds)
+{
+    struct iovec iov = {.iov_base = (void *)buf, .iov_len = len};
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOVER_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (n_fds > 0)
+    {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+    }
+    ssize_t n;
+    do
+        n = sendmsg(sock, &msg, 0);
+    while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+        perror("handover send failed");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief receive one message and the descriptors attached to it
+ * @param sock handover connection
+ * @param buf message buffer
+ * @param len byte size of the message expected
+ * @param fds received descriptors (output), close-on-exec
+ * @param n_fds number of descriptors received (output)
+ * @return 0 on success, -1 on error or short message
+ */
+static int recv_msg(int sock, void *buf, size_t len, int *fds, int *n_fds)
+{
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int) * HANDOVER_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    ssize_t n;
+    do
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    while (n < 0 && errno == EINTR);
+    if (n < 0)
+    {
+        perror("handover recv failed");
+        return -1;
+    }
+    *n_fds = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+            *n_fds = count;
+        }
+    }
+    if ((size_t)n != len || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+    {
+        fprintf(stderr, "handover: unexpected message\n");
+        for (int i = 0; i < *n_fds; i++)
+            close(fds[i]);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief send a buffer in HANDOVER_CHUNK messages
+ * @param sock handover connection
+ * @param data buffer
+ * @param len byte size of the buffer
+ * @return 0 on success, -1 on error
+ */
+static int send_payload(int sock, const char *data, size_t len)
+{
+    for (size_t off = 0; off < len; off += HANDOVER_CHUNK)
+    {
+        size_t n = len - off < HANDOVER_CHUNK ? len - off : HANDOVER_CHUNK;
+        if (send_msg(sock, data + off, n, NULL, 0) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief receive a buffer sent by send_payload
+ * @param sock handover connection
+ * @param data buffer of at least len bytes
+ * @param len byte size of the buffer
+ * @return 0 on success, -1 on error
+ */
+static int recv_payload(int sock, char *data, size_t len)
+{
+    int fds[HANDOVER_MAX_FDS];
+    int n_fds;
+    for (size_t off = 0; off < len; off += HANDOVER_CHUNK)
+    {
+        size_t n = len - off < HANDOVER_CHUNK ? len - off : HANDOVER_CHUNK;
+        if (recv_msg(sock, data + off, n, fds, &n_fds) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int handover_listen(int port)
+{
+    struct sockaddr_un addr;
+    handover_addr(&addr, port);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("handover socket failed");
+        return -1;
+    }
+    // a server that died without cleaning up leaves its socket file behind
+    unlink(addr.sun_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || chmod(addr.sun_path, 0600) < 0 || listen(fd, 1) < 0)
+    {
+        perror("handover bind failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int handover_connect(int port)
+{
+    struct sockaddr_un addr;
+    handover_addr(&addr, port);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        perror("handover socket failed");
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("handover connect failed");
+        close(sock);
+        return -1;
+    }
+    handover_hello hello;
+    memset(&hello, 0, sizeof(hello));
+    memcpy(hello.magic, HANDOVER_MAGIC, 8);
+    hello.version = HANDOVER_VERSION;
+    hello.record_size = sizeof(handover_record);
+    char reply;
+    int fds[HANDOVER_MAX_FDS];
+    int n_fds;
+    if (send_msg(sock, &hello, sizeof(hello), NULL, 0) < 0 || recv_msg(sock, &reply, 1, fds, &n_fds) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    if (reply != 'Y')
+    {
+        fprintf(stderr, "handover refused: the running server has a different record layout\n");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int handover_accept(int handover_fd)
+{
+    int sock = accept4(handover_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (sock < 0)
+    {
+        if (errno != EWOULDBLOCK && errno != EAGAIN)
+            perror("handover accept failed");
+        return -1;
+    }
+    // a stuck peer must not stall the event loop
+    struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    handover_hello hello;
+    int fds[HANDOVER_MAX_FDS];
+    int n_fds;
+    if (recv_msg(sock, &hello, sizeof(hello), fds, &n_fds) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    int ok = memcmp(hello.magic, HANDOVER_MAGIC, 8) == 0 && hello.version == HANDOVER_VERSION &&
+             hello.record_size == sizeof(handover_record);
+    char reply = ok ? 'Y' : 'N';
+    if (send_msg(sock, &reply, 1, NULL, 0) < 0 || !ok)
+    {
+        if (!ok)
+            fprintf(stderr, "handover refused: incompatible server binary\n");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/**
+ * @brief send one descriptor with a tag
+ * @param sock handover connection
+ * @param tag what the descriptor is
+ * @param fd descriptor
+ * @return 0 on success, -1 on error
+ */
+static int send_tagged_fd(int sock, char tag, int fd)
+{
+    return send_msg(sock, &tag, 1, &fd, 1);
+}
+
+/**
+ * @brief receive one descriptor sent with send_tagged_fd
+ * @param sock handover connection
+ * @param tag expected tag
+ * @param what name of the descriptor for the error message
+ * @return descriptor, or -1 on error
+ */
+static int recv_tagged_fd(int sock, char tag, const char *what)
+{
+    char got;
+    int fds[HANDOVER_MAX_FDS];
+    int n_fds;
+    if (recv_msg(sock, &got, 1, fds, &n_fds) < 0)
+        return -1;
+    if (got != tag || n_fds != 1)
+    {
+        fprintf(stderr, "handover: %s missing\n", what);
+        for (int i = 0; i < n_fds; i++)
+            close(fds[i]);
+        return -1;
+    }
+    return fds[0];
+}
+
+int handover_send_listener(int sock, int listen_fd)
+{
+    return send_tagged_fd(sock, 'L', listen_fd);
+}
+
+int handover_recv_listener(int sock)
+{
+    return recv_tagged_fd(sock, 'L', "listening socket");
+}
+
+int handover_send_results(int sock, int shm_fd)
+{
+    return send_tagged_fd(sock, 'R', shm_fd);
+}
+
+int handover_recv_results(int sock)
+{
+    return recv_tagged_fd(sock, 'R', "result slots");
+}
+
+/**
+ * @brief copy a judge job into a record
+ * @param rec record
+ * @param job judge job, NULL for none
+ * @param fds descriptors to attach (in/out), the job's are appended
+ * @param n_fds number of descriptors (in/out)
+ */
+static void pack_job(handover_record *rec, const judge_job *job, int *fds, int *n_fds)
+{
+    if (!job)
+        return;
+    rec->has_job = 1;
+    rec->stage = job->stage;
+    rec->pid = job->pid;
+    rec->local_only = job->local_only;
+    rec->node = job->node;
+    rec->attempts = job->attempts;
+    rec->user = job->user;
+    rec->cost_ms = job->cost_ms;
+    rec->queued_at = job->queued_at;
+    rec->started_at = job->started_at;
+    rec->waited_ms = job->waited_ms;
+    rec->job_profile = job->profile;
+    memcpy(rec->profile_test, job->profile_test, RECORD_TEST_NAME_SIZE);
+    rec->cpu = job->cpu;
+    rec->slot = job->slot;
+    rec->job_has_source = (job->source != NULL);
+    rec->source_len = job->source_len;
+    rec->source_off = job->source_off;
+    rec->send_len = job->send_len;
+    rec->send_off = job->send_off;
+    memcpy(rec->node_header, job->node_header, NODE_HEADER_SIZE);
+    rec->node_header_len = job->node_header_len;
+    memcpy(rec->result, job->result, job->result_len);
+    rec->result_len = job->result_len;
+    if (job->pipe_fd >= 0)
+    {
+        fds[(*n_fds)++] = job->pipe_fd;
+        rec->fd_mask |= FD_PIPE;
+    }
+    if (job->stdin_fd >= 0)
+    {
+        fds[(*n_fds)++] = job->stdin_fd;
+        rec->fd_mask |= FD_STDIN;
+    }
+}
+
+int handover_send_conn(int sock, const client_conn *conn)
+{
+    handover_record *rec = calloc(1, sizeof(handover_record));
+    if (!rec)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    int fds[HANDOVER_MAX_FDS];
+    int n_fds = 0;
+    rec->kind = HANDOVER_CONN;
+    fds[n_fds++] = conn->fd;
+    rec->fd_mask = FD_CONN;
+
+    rec->addr = conn->addr;
+    rec->state = conn->state;
+    memcpy(rec->header, conn->header, HEADER_SIZE);
+    rec->header_bytes = conn->header_bytes;
+    rec->file_size = conn->file_size;
+    rec->file_received = conn->file_received;
+    rec->submission_id = conn->submission_id;
+    if (conn->tc)
+        strncpy(rec->lang, conn->tc->name, STORE_LANG_SIZE);
+    rec->node_job = conn->node_job;
+    rec->detached = conn->detached;
+    rec->profile = conn->profile;
+    rec->query = conn->query;
+    rec->wait_until = conn->wait_until;
+    rec->stream_off = conn->stream_off;
+    memcpy(rec->judge_result, conn->judge_result, conn->judge_result_len);
+    rec->judge_result_len = conn->judge_result_len;
+    rec->judge_sent = conn->judge_sent;
+    memcpy(rec->source_filename, conn->source_filename, sizeof(rec->source_filename));
+    rec->source_hash = conn->source_hash;
+    rec->cache = conn->cache;
+    rec->has_source = (conn->source != NULL);
+
+    pack_job(rec, conn->job, fds, &n_fds);
+
+    int ret = send_msg(sock, rec, sizeof(handover_record), fds, n_fds);
+    if (ret == 0 && rec->has_source)
+        ret = send_payload(sock, conn->source, conn->file_received);
+    if (ret == 0 && rec->job_has_source)
+        ret = send_payload(sock, conn->job->source, conn->job->source_len);
+    free(rec);
+    return ret;
+}
+
+int handover_send_ticket(int sock, const ticket *t)
+{
+    handover_record *rec = calloc(1, sizeof(handover_record));
+    if (!rec)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    int fds[HANDOVER_MAX_FDS];
+    int n_fds = 0;
+    rec->kind = HANDOVER_TICKET;
+    rec->submission_id = t->id;
+    rec->cache = t->cache;
+    memcpy(rec->source_filename, t->job->source_filename, sizeof(rec->source_filename));
+    pack_job(rec, t->job, fds, &n_fds);
+
+    int ret = send_msg(sock, rec, sizeof(handover_record), fds, n_fds);
+    if (ret == 0 && rec->job_has_source)
+        ret = send_payload(sock, t->job->source, t->job->source_len);
+    free(rec);
+    return ret;
+}
+int handover_send_end(int sock)
+{
+    handover_record *rec = calloc(1, sizeof(handover_record));
+    if (!rec)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    rec->kind = HANDOVER_END;
+    int ret = send_msg(sock, rec, sizeof(handover_record), NULL, 0);
+    free(rec);
+    return ret;
+}
+
+/**
+ * @brief receive the record that follows, checking its kind and attached descriptors
+ * @param sock handover connection
+ * @param kind expected kind besides HANDOVER_END
+ * @param rec record (output)
+ * @param pipe_fd judge stdout pipe or node socket (output), -1 for none
+ * @param stdin_fd judge stdin pipe (output), -1 for none
+ * @param conn_fd client socket (output), -1 for none
+ * @return 1 for a record of the kind, 0 at the end, -1 on error
+ */
+static int recv_record(int sock, uint32_t kind, handover_record *rec, int *pipe_fd, int *stdin_fd, int *conn_fd)
+{
+    int fds[HANDOVER_MAX_FDS];
+    int n_fds;
+    if (recv_msg(sock, rec, sizeof(handover_record), fds, &n_fds) < 0)
+        return -1;
+    if (rec->kind == HANDOVER_END)
+        return 0;
+    // connections carry their socket, detached submissions have none
+    int needs_conn = (kind == HANDOVER_CONN);
+    if (rec->kind != kind || n_fds != __builtin_popcount(rec->fd_mask) || !(rec->fd_mask & FD_CONN) != !needs_conn ||
+        (kind == HANDOVER_TICKET && !rec->has_job))
+    {
+        fprintf(stderr, "handover: bad %s record\n", needs_conn ? "connection" : "ticket");
+        for (int i = 0; i < n_fds; i++)
+            close(fds[i]);
+        return -1;
+    }
+    int fd_i = 0;
+    *conn_fd = (rec->fd_mask & FD_CONN) ? fds[fd_i++] : -1;
+    *pipe_fd = (rec->fd_mask & FD_PIPE) ? fds[fd_i++] : -1;
+    *stdin_fd = (rec->fd_mask & FD_STDIN) ? fds[fd_i++] : -1;
+    return 1;
+}
+
+/**
+ * @brief rebuild a judge job from a record and receive its source
+ * @param sock handover connection
+ * @param rec record
+ * @param job job created for the record
+ * @param pipe_fd judge stdout pipe or node socket, -1 for none
+ * @param stdin_fd judge stdin pipe, -1 for none
+ * @return 0 on success, -1 on error
+ */
+static int unpack_job(int sock, const handover_record *rec, judge_job *job, int pipe_fd, int stdin_fd)
+{
+    job->stage = rec->stage;
+    job->pid = rec->pid;
+    job->pipe_fd = pipe_fd;
+    job->stdin_fd = stdin_fd;
+    job->local_only = rec->local_only;
+    job->node = rec->node;
+    job->attempts = rec->attempts;
+    job->user = rec->user;
+    job->cost_ms = rec->cost_ms;
+    job->queued_at = rec->queued_at;
+    job->started_at = rec->started_at;
+    job->waited_ms = rec->waited_ms;
+    job->profile = rec->job_profile;
+    memcpy(job->profile_test, rec->profile_test, RECORD_TEST_NAME_SIZE);
+    job->cpu = rec->cpu;
+    job->slot = rec->slot;
+    job->source_len = rec->source_len;
+    job->source_off = rec->source_off;
+    job->send_len = rec->send_len;
+    job->send_off = rec->send_off;
+    memcpy(job->node_header, rec->node_header, NODE_HEADER_SIZE);
+    job->node_header_len = rec->node_header_len;
+    memcpy(job->result, rec->result, JUDGE_RESULT_SIZE);
+    job->result_len = rec->result_len;
+    if (rec->job_has_source)
+    {
+        job->source = malloc(job->source_len ? job->source_len : 1);
+        if (!job->source || recv_payload(sock, job->source, job->source_len) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int handover_recv_conn(int sock, job_done_fn on_done, client_conn **out)
+{
+    handover_record *rec = malloc(sizeof(handover_record));
+    if (!rec)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    int conn_fd, pipe_fd, stdin_fd;
+    int ret = recv_record(sock, HANDOVER_CONN, rec, &pipe_fd, &stdin_fd, &conn_fd);
+    if (ret <= 0)
+    {
+        free(rec);
+        return ret;
+    }
+
+    client_conn *conn = calloc(1, sizeof(client_conn));
+    judge_job *job = NULL;
+    if (conn && rec->has_job)
+        job = judge_job_create(rec->source_filename, on_done, conn);
+    if (!conn || (rec->has_job && !job))
+        goto fail;
+    conn->fd = conn_fd;
+    conn->addr = rec->addr;
+    conn->state = rec->state;
+    memcpy(conn->header, rec->header, HEADER_SIZE);
+    conn->header_bytes = rec->header_bytes;
+    conn->file_size = rec->file_size;
+    conn->file_received = rec->file_received;
+    conn->submission_id = rec->submission_id;
+    if (rec->lang[0])
+    {
+        char lang[STORE_LANG_SIZE + 1];
+        memcpy(lang, rec->lang, STORE_LANG_SIZE);
+        lang[STORE_LANG_SIZE] = '\0';
+        conn->tc = toolchain_by_name(lang);
+        if (!conn->tc)
+            conn->tc = toolchain_default();
+    }
+    conn->node_job = rec->node_job;
+    conn->detached = rec->detached;
+    conn->profile = rec->profile;
+    conn->query = rec->query;
+    conn->wait_until = rec->wait_until;
+    conn->stream_off = rec->stream_off;
+    memcpy(conn->judge_result, rec->judge_result, sizeof(conn->judge_result));
+    conn->judge_result_len = rec->judge_result_len;
+    conn->judge_sent = rec->judge_sent;
+    memcpy(conn->source_filename, rec->source_filename, sizeof(conn->source_filename));
+    conn->source_hash = rec->source_hash;
+    conn->cache = rec->cache;
+    if (rec->has_source)
+    {
+        conn->source = malloc(conn->file_size ? conn->file_size : 1);
+        if (!conn->source || recv_payload(sock, conn->source, conn->file_received) < 0)
+            goto fail;
+    }
+
+    if (job)
+    {
+        if (unpack_job(sock, rec, job, pipe_fd, stdin_fd) < 0)
+            goto fail;
+        conn->job = job;
+    }
+    free(rec);
+    *out = conn;
+    return 1;
+
+fail:
+    close(conn_fd);
+    if (pipe_fd >= 0)
+        close(pipe_fd);
+    if (stdin_fd >= 0)
+        close(stdin_fd);
+    if (conn)
+        free(conn->source);
+    free(conn);
+    if (job)
+        free(job->source);
+    free(job);
+    free(rec);
+    return -1;
+}
+
+int handover_recv_ticket(int sock, job_done_fn on_done, ticket **out)
+{
+    handover_record *rec = malloc(sizeof(handover_record));
+    if (!rec)
+    {
+        perror("malloc failed");
+        return -1;
+    }
+    int conn_fd, pipe_fd, stdin_fd;
+    int ret = recv_record(sock, HANDOVER_TICKET, rec, &pipe_fd, &stdin_fd, &conn_fd);
+    if (ret <= 0)
+    {
+        free(rec);
+        return ret;
+    }
+
+    ticket *t = calloc(1, sizeof(ticket));
+    judge_job *job = t ? judge_job_create(rec->source_filename, on_done, t) : NULL;
+    if (!job || unpack_job(sock, rec, job, pipe_fd, stdin_fd) < 0)
+    {
+        if (pipe_fd >= 0)
+            close(pipe_fd);
+        if (stdin_fd >= 0)
+            close(stdin_fd);
+        if (job)
+            free(job->source);
+        free(job);
+        free(t);
+        free(rec);
+        return -1;
+    }
+    t->id = rec->submission_id;
+    t->cache = rec->cache;
+    t->job = job;
+    free(rec);
+    *out = t;
+    return 1;
+}
@@ -0,0 +1,103 @@
+#ifndef HANDOVER_H
+#define HANDOVER_H
+
+#include "../defineshit.h"
+#include "tcp_server.h"
+
+#define HANDOVER_MAGIC "CJHOVER1"
+#define HANDOVER_PATH_FMT "temp/server-%d.sock" // per port, so several servers can run side by side
+#define HANDOVER_CHUNK 65536                    // payload bytes per message
+
+/**
+ * @brief Listen for a new server process taking over
+ * @param port TCP port of this server
+ * @return non-blocking Unix socket, or -1 on error
+ */
+int handover_listen(int port);
+
+/**
+ * @brief Connect to the running server and check that it can hand over to this binary
+ * @param port TCP port of the running server
+ * @return connected socket, or -1 on error
+ */
+int handover_connect(int port);
+
+/**
+ * @brief Accept a new server process and agree on the record format
+ * @param handover_fd socket returned by handover_listen
+ * @return connected blocking socket, or -1 if the peer is incompatible
+ */
+int handover_accept(int handover_fd);
+
+/**
+ * @brief Send the listening socket
+ * @param sock handover connection
+ * @param listen_fd listening socket
+ * @return 0 on success, -1 on error
+ */
+int handover_send_listener(int sock, int listen_fd);
+
+/**
+ * @brief Receive the listening socket
+ * @param sock handover connection
+ * @return listening socket, or -1 on error
+ */
+int handover_recv_listener(int sock);
+
+/**
+ * @brief Send the result slots the running judges write to
+ * @param sock handover connection
+ * @param shm_fd memfd of the result slots
+ * @return 0 on success, -1 on error
+ */
+int handover_send_results(int sock, int shm_fd);
+
+/**
+ * @brief Receive the result slots
+ * @param sock handover connection
+ * @return memfd, or -1 on error
+ */
+int handover_recv_results(int sock);
+
+/**
+ * @brief Send a client connection with its judge job, descriptors and buffers
+ * @param sock handover connection
+ * @param conn client connection
+ * @return 0 on success, -1 on error
+ */
+int handover_send_conn(int sock, const client_conn *conn);
+
+/**
+ * @brief Send a detached submission with its judge job, descriptors and source
+ * @param sock handover connection
+ * @param t detached submission
+ * @return 0 on success, -1 on error
+ */
+int handover_send_ticket(int sock, const ticket *t);
+
+/**
+ * @brief Mark the end of the connections, or of the detached submissions after them
+ * @param sock handover connection
+ * @return 0 on success, -1 on error
+ */
+int handover_send_end(int sock);
+
+/**
+ * @brief Receive the next client connection, rebuilding its judge job
+ * @param sock handover connection
+ * @param on_done completion callback of the rebuilt job
+ * @param conn heap-allocated connection (output), its job is not adopted yet
+ * @return 1 for a connection, 0 at the end, -1 on error
+ */
+int handover_recv_conn(int sock, job_done_fn on_done, client_conn **conn);
+
+/**
+ * @brief Receive the next detached submission, rebuilding its judge job
+ * @param sock handover connection
+ * @param on_done completion callback of the rebuilt job
+ * @param t heap-allocated detached submission (output), its job is not adopted yet
+ * @return 1 for a detached submission, 0 at the end, -1 on error
+ */
+int handover_recv_ticket(int sock, job_done_fn on_done, ticket **t);
+
+#endif // HANDOVER_H
@@ -45,53 +45,82 @@ int connect_to_server(const char *server_ip, int port)
     return sockfd;
 }
 
-int send_file_data(int sockfd, const char *filename)
+void make_upload_header(char header[HEADER_SIZE], const toolchain *tc, int mode, uint64_t file_size)
 {
-    FILE *fp = fopen(filename, "rb");
-    if (!fp)
+    memset(header, 0, HEADER_SIZE);
+    memcpy(header, mode == UPLOAD_DETACHED ? tc->detach_tag : mode == UPLOAD_PROFILE ? tc->profile_tag : tc->upload_tag, 8);
+    uint64_t net_file_size = htobe64(file_size);
+    memcpy(header + 8, &net_file_size, 8);
+}
+
+int send_file_data(int sockfd, const char *filename, int mode)
+{
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
     {
-        perror("fopen failed");
+        perror("open failed");
+        if (fd >= 0)
+            close(fd);
         return -1;
     }
-    fseek(fp, 0, SEEK_END);
-    uint64_t file_size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    uint64_t file_size = st.st_size;
     char header[HEADER_SIZE];
-    memset(header, 0, HEADER_SIZE);
-    memcpy(header, TEXTFILE, 8);
-    uint64_t net_file_size = htobe64(file_size);
-    memcpy(header + 8, &net_file_size, 8);
+    const toolchain *tc = toolchain_by_path(filename);
+    if (!tc)
+        tc = toolchain_default();
+    make_upload_header(header, tc, mode, file_size);
     if (send_all(sockfd, header, HEADER_SIZE) != HEADER_SIZE)
     {
         perror("failed to send header");
-        fclose(fp);
+        close(fd);
         return -1;
     }
-    char buffer[1024];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    // the kernel copies the file to the socket, no user-space buffer
+    off_t off = 0;
+    while ((uint64_t)off < file_size)
     {
-        if (send_all(sockfd, buffer, bytes_read) != bytes_read)
+        ssize_t n = sendfile(sockfd, fd, &off, file_size - off);
+        if (n <= 0)
         {
+            if (n < 0 && errno == EINTR)
+                continue;
             perror("failed to send file");
-            fclose(fp);
+            close(fd);
             return -1;
         }
     }
     printf("file '%s' sent (size: %lu bytes)\n", filename, file_size);
-    fclose(fp);
+    close(fd);
     return 0;
 }
 
-int receive_judge_result(int sockfd)
+int send_query(int sockfd, uint64_t ticket, uint64_t wait_ms)
+{
+    char request[HEADER_SIZE + 16];
+    uint64_t field = htobe64(16);
+    memcpy(request, RESULTRQ, 8);
+    memcpy(request + 8, &field, 8);
+    field = htobe64(ticket);
+    memcpy(request + HEADER_SIZE, &field, 8);
+    field = htobe64(wait_ms);
+    memcpy(request + HEADER_SIZE + 8, &field, 8);
+    if (send_all(sockfd, request, sizeof(request)) != sizeof(request))
+    {
+        perror("failed to send query");
+        return -1;
+    }
+    return 0;
+}
+
+int receive_reply(int sockfd, char *buf, size_t size)
 {
-    char result_buf[4096];
     size_t total_received = 0;
     ssize_t r;
-    while ((r = recv(sockfd, result_buf + total_received, sizeof(result_buf) - total_received - 1, 0)) > 0)
+    while ((r = recv(sockfd, buf + total_received, size - total_received - 1, 0)) > 0)
     {
         total_received += r;
-        if (total_received >= sizeof(result_buf) - 1)
+        if (total_received >= size - 1)
             break;
     }
     if (r < 0)
@@ -99,7 +128,29 @@ int receive_judge_result(int sockfd)
         perror("recv failed");
         return -1;
     }
-    result_buf[total_received] = '\0';
+    buf[total_received] = '\0';
+    return 0;
+}
+
+uint64_t follow_up_ticket(const char *reply)
+{
+    // only the last line, the verdict above it may quote anything
+    size_t len = strlen(reply);
+    if (len == 0 || reply[len - 1] != '\n')
+        return 0;
+    const char *line = reply + len - 1;
+    while (line > reply && line[-1] != '\n')
+        line--;
+    if (line == reply || strncmp(line, "Ticket: ", 8) != 0)
+        return 0;
+    return strtoull(line + 8, NULL, 10);
+}
+
+int receive_judge_result(int sockfd)
+{
+    char result_buf[REPLY_SIZE];
+    if (receive_reply(sockfd, result_buf, sizeof(result_buf)) < 0)
+        return -1;
     printf("Judge result received:\n%s\n", result_buf);
     return 0;
 }
@@ -109,9 +160,9 @@ void close_connection(int sockfd)
     close(sockfd);
 }
 
-int send_file(int sockfd, const char *filename)
+int send_file(int sockfd, const char *filename, int mode)
 {
-    if (send_file_data(sockfd, filename) < 0)
+    if (send_file_data(sockfd, filename, mode) < 0)
     {
         close_connection(sockfd);
         return -1;
@@ -140,7 +191,7 @@ int main(int argc, char *argv[])
     {
         return 1;
     }
-    int ret = send_file(sockfd, filename);
+    int ret = send_file(sockfd, filename, UPLOAD_WAIT);
     if (ret < 0)
     {
         return 1;
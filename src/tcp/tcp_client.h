@@ -2,16 +2,28 @@
 #define TCP_CLIENT_H
 
 #include "../defineshit.h"
+#include "../toolchain/toolchain.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <arpa/inet.h>
 #include <endian.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
 
 #define HEADER_SIZE 16
+#define REPLY_SIZE 16384 // room for the longest reply: full compile or runtime error output
 #define TEXTFILE "TEXTFILE"
+#define RESULTRQ "RESULTRQ" // result query: be64 ticket, be64 wait in ms
+
+// how an upload is answered, sets its header type
+#define UPLOAD_WAIT 0     // verdict on the same connection
+#define UPLOAD_DETACHED 1 // ticket, the verdict is queried later
+#define UPLOAD_PROFILE 2  // verdict and, once accepted, a profile of the slowest test
 
 /**
  * @brief Send all data in the buffer
@@ -30,13 +42,48 @@ ssize_t send_all(int sockfd, const void *buffer, size_t length);
  */
 int connect_to_server(const char *server_ip, int port);
 
+/**
+ * @brief Build the header of a source upload
+ * @param header header (output)
+ * @param tc toolchain of the source
+ * @param mode UPLOAD_WAIT, UPLOAD_DETACHED or UPLOAD_PROFILE
+ * @param file_size byte size of the source that follows
+ */
+void make_upload_header(char header[HEADER_SIZE], const toolchain *tc, int mode, uint64_t file_size);
+
 /**
  * @brief Send file data to the server
  * @param sockfd socket file descriptor
  * @param filename name of the file to send
+ * @param mode UPLOAD_WAIT, UPLOAD_DETACHED or UPLOAD_PROFILE
+ * @return 0 on success, -1 on error
+ */
+int send_file_data(int sockfd, const char *filename, int mode);
+
+/**
+ * @brief Ask the server for the verdict of a detached submission
+ * @param sockfd socket file descriptor
+ * @param ticket ticket replied to the detached submission
+ * @param wait_ms time the server may wait for a verdict still pending, 0 to answer right away
  * @return 0 on success, -1 on error
  */
-int send_file_data(int sockfd, const char *filename);
+int send_query(int sockfd, uint64_t ticket, uint64_t wait_ms);
+
+/**
+ * @brief Receive the reply of the server, until it closes the connection
+ * @param sockfd socket file descriptor
+ * @param buf reply buffer (output), NUL-terminated
+ * @param size size of the reply buffer
+ * @return 0 on success, -1 on error
+ */
+int receive_reply(int sockfd, char *buf, size_t size);
+
+/**
+ * @brief Find the ticket a verdict reply ends with, for the timing or profile that follows
+ * @param reply reply of the server
+ * @return ticket, 0 if the reply has none
+ */
+uint64_t follow_up_ticket(const char *reply);
 
 /**
  * @brief Receive judge result from the server
@@ -55,8 +102,9 @@ void close_connection(int sockfd);
  * @brief Send file to the server and receive judge result
  * @param sockfd socket file descriptor
  * @param filename name of the file to send
+ * @param mode UPLOAD_WAIT, UPLOAD_DETACHED or UPLOAD_PROFILE
  * @return 0 on success, -1 on error
  */
-int send_file(int sockfd, const char *filename);
+int send_file(int sockfd, const char *filename, int mode);
 
 #endif // TCP_CLIENT_H
\ No newline at end of file
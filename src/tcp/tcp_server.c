@@ -1,10 +1,54 @@
 #include "tcp_server.h"
+#include "handover.h"
+#include "../sched/result_slots.h"
+#include "../store/result_store.h"
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#ifdef HAVE_IO_URING
+#include "uring.h"
+#include <poll.h>
+#endif
+
+#define SOURCE_TOO_LARGE "Internal Error: (Source too large)\n"
+#define QUERY_PENDING "Pending\n"
+#define QUERY_UNKNOWN "Unknown ticket\n"
+#define TICKET_ERROR "Internal Error: (Could not issue a ticket)\n"
 
 // server running flag (volatile sig_atomic_t is safe to use in signal handler)
 volatile sig_atomic_t server_running = 1;
 
-// linked list of client connections
-static client_conn *conn_list = NULL;
+// linked list of client connections, one per network thread
+static __thread client_conn *conn_list = NULL;
+
+// server configuration
+static server_config server_cfg;
+
+/**
+ * @brief network thread, serving the connections of its own SO_REUSEPORT listener
+ */
+typedef struct net_thread
+{
+    spsc_ring results;  // connections whose reply the scheduler thread has set
+    pthread_t tid;      // thread id
+    int listen_fd;      // listening socket of the thread
+    int wake_fd;        // eventfd, written by the scheduler thread after posting results
+    int wake_pending;   // results posted in this scheduler round, scheduler thread only
+    int handed_off;     // uploads pushed in this round, network thread only
+} net_thread;
+
+#define CONN_OF(node) ((client_conn *)((char *)(node) - offsetof(client_conn, link)))
+
+static net_thread *net_threads = NULL;   // network threads, NULL without -t
+static __thread net_thread *self = NULL; // network thread running the code, NULL on the scheduler thread
+static mpsc_queue uploads;               // finished uploads, pushed by the network threads
+static int sched_wake_fd = -1;           // eventfd, written by the network threads after pushing
+static mpsc_node *backlog_head = NULL;   // results that did not fit in a full ring, scheduler thread only
+static mpsc_node *backlog_tail = NULL;
+static int published_capacity = 0;      // judge_sched_stats as of the last scheduler round
+static int published_load = 0;
+static ticket *tickets = NULL;          // detached submissions being judged, scheduler thread only
+static int query_timer_fd = -1;         // timerfd, expires at the earliest deadline of a waiting query
 
 /**
  * @brief set the file descriptor to non-blocking mode
@@ -51,179 +95,651 @@ static void remove_connection(client_conn *conn)
         }
         p = &(*p)->next;
     }
-    if (conn->fp)
-        fclose(conn->fp);
+    free(conn->source);
     if (conn->fd >= 0)
         close(conn->fd);
-    if (conn->judge_pipe_fd >= 0)
-        close(conn->judge_pipe_fd);
+    if (conn->job)
+        judge_sched_cancel(conn->job);
     free(conn);
 }
 
 /**
- * @brief spawn judge process
+ * @brief capacity and load of the judge scheduler
+ * @param capacity number of run workers (out)
+ * @param load number of jobs queued or running (out)
+ */
+static void load_stats(int *capacity, int *load)
+{
+    if (self)
+    {
+        // the scheduler's queues belong to its thread, it publishes the numbers every round
+        *capacity = __atomic_load_n(&published_capacity, __ATOMIC_RELAXED);
+        *load = __atomic_load_n(&published_load, __ATOMIC_RELAXED);
+        return;
+    }
+    judge_sched_stats(capacity, load);
+}
+
+/**
+ * @brief write the reply to the client into its buffer
  * @param conn client connection
+ * @param result verdict text
+ * @param len byte size of the verdict
  */
-static void spawn_judge(client_conn *conn)
+static void fill_result(client_conn *conn, const char *result, size_t len)
 {
-    int pipe_fd[2];
-    if (pipe(pipe_fd) < 0)
+    size_t off = 0;
+    if (conn->node_job)
     {
-        perror("pipe failed");
-        conn->state = STATE_DONE;
+        // front-end servers track our load from the reply header
+        int capacity, load;
+        load_stats(&capacity, &load);
+        node_pool_encode_stat(conn->judge_result, capacity, load);
+        off = NODE_HEADER_SIZE;
+    }
+    if (len > JUDGE_RESULT_SIZE - 1)
+        len = JUDGE_RESULT_SIZE - 1;
+    memcpy(conn->judge_result + off, result, len);
+    conn->judge_result[off + len] = '\0';
+    conn->judge_result_len = off + len;
+}
+
+/**
+ * @brief set the reply to the client
+ * @param conn client connection
+ * @param result verdict text
+ * @param len byte size of the verdict
+ */
+static void set_result(client_conn *conn, const char *result, size_t len)
+{
+    fill_result(conn, result, len);
+    conn->state = STATE_SENDING_RESULT;
+}
+
+/**
+ * @brief hand a reply to the network thread of the connection, scheduler thread only.
+ *      The thread is woken at the end of the round.
+ * @param conn client connection, its reply buffer set
+ */
+static void post_result(client_conn *conn)
+{
+    if (backlog_head || spsc_push(&conn->net->results, conn) < 0)
+    {
+        // the ring is full, retried every round in order
+        conn->link.next = NULL;
+        if (backlog_tail)
+            backlog_tail->next = &conn->link;
+        else
+            backlog_head = &conn->link;
+        backlog_tail = &conn->link;
         return;
     }
-    set_nonblocking(pipe_fd[0]);
-    pid_t pid = fork();
-    if (pid < 0)
+    conn->net->wake_pending = 1;
+}
+
+/**
+ * @brief reply to the client of a finished or failed request
+ * @param conn client connection
+ * @param result verdict text, NULL to close the connection without a reply
+ * @param len byte size of the verdict
+ */
+static void deliver_result(client_conn *conn, const char *result, size_t len)
+{
+    if (!conn->net)
     {
-        perror("fork failed");
-        close(pipe_fd[0]);
-        close(pipe_fd[1]);
-        conn->state = STATE_DONE;
+        if (result)
+            set_result(conn, result, len);
+        else
+            conn->state = STATE_DONE;
+        return;
+    }
+    // the network thread sends whatever the buffer holds once it pops the connection
+    conn->judge_result_len = 0;
+    if (result)
+        fill_result(conn, result, len);
+    post_result(conn);
+}
+
+/**
+ * @brief cache the verdict of a finished job if it is final
+ * @param key verdict cache key of the source
+ * @param job finished job
+ */
+static void cache_verdict(const cache_key *key, const judge_job *job)
+{
+    if (!verdict_cache_final(job->result))
         return;
+    // a node may have answered from its own cache
+    size_t len = job->result_len;
+    size_t flag_len = strlen(CACHED_FLAG);
+    if (len >= flag_len && memcmp(job->result + len - flag_len, CACHED_FLAG, flag_len) == 0)
+        len -= flag_len;
+    verdict_cache_store(key, job->result, len);
+}
+
+/**
+ * @brief keep the verdict of a submission next to its source, the baseline of a later rejudge.
+ *      It goes out with the next store flush.
+ * @param id submission ID
+ * @param result verdict text
+ * @param len byte size of the verdict
+ */
+static void store_verdict(uint64_t id, const char *result, size_t len)
+{
+    if (store_set_verdict(id, result, len) < 0)
+        fprintf(stderr, "could not store the verdict of submission %llu\n", (unsigned long long)id);
+}
+
+/**
+ * @brief take the verdict of a finished job
+ * @param job finished job
+ */
+static void judge_done(judge_job *job)
+{
+    client_conn *conn = job->owner;
+    // the verdict text of a profiled job carries the profile of this one run
+    if (!job->profile)
+        cache_verdict(&conn->cache, job);
+    store_verdict(conn->submission_id, job->result, job->result_len);
+    // the connection belongs to its network thread once the result is posted
+    conn->job = NULL;
+    deliver_result(conn, job->result, job->result_len);
+}
+
+/**
+ * @brief current time of the query deadlines
+ * @return CLOCK_MONOTONIC time in ms
+ */
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief arm the query timer for the earliest deadline of the waiting queries,
+ *      or disarm it when none waits
+ */
+static void arm_query_timer(void)
+{
+    int64_t earliest = 0;
+    for (ticket *t = tickets; t; t = t->next)
+    {
+        for (client_conn *w = t->waiters; w; w = w->wait_next)
+        {
+            if (!earliest || w->wait_until < earliest)
+                earliest = w->wait_until;
+        }
     }
-    else if (pid == 0)
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = earliest / 1000;
+    its.it_value.tv_nsec = (earliest % 1000) * 1000000;
+    if (timerfd_settime(query_timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        perror("timerfd_settime failed");
+}
+
+/**
+ * @brief answer the queries whose deadline passed that the verdict is still pending
+ */
+static void expire_queries(void)
+{
+    uint64_t count;
+    if (read(query_timer_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("read timerfd failed");
+    int64_t now = now_ms();
+    for (ticket *t = tickets; t; t = t->next)
     {
-        close(pipe_fd[0]);
-        if (dup2(pipe_fd[1], STDOUT_FILENO) < 0)
+        client_conn **p = &t->waiters;
+        while (*p)
         {
-            perror("dup2 failed");
-            exit(EXIT_FAILURE);
+            client_conn *w = *p;
+            if (w->wait_until > now)
+            {
+                p = &w->wait_next;
+                continue;
+            }
+            *p = w->wait_next;
+            w->wait_next = NULL;
+            deliver_result(w, QUERY_PENDING, strlen(QUERY_PENDING));
         }
-        close(pipe_fd[1]);
+    }
+    arm_query_timer();
+}
 
-        execl("build/src/judge", "judge", conn->source_filename, (char *)NULL);
-        perror("execl failed");
-        exit(EXIT_FAILURE);
+/**
+ * @brief find a detached submission that is still being judged
+ * @param id submission ID
+ * @return ticket, or NULL if the submission is not pending
+ */
+static ticket *find_ticket(uint64_t id)
+{
+    for (ticket *t = tickets; t; t = t->next)
+    {
+        if (t->id == id)
+            return t;
+    }
+    return NULL;
+}
+
+/**
+ * @brief keep the verdict of a finished detached job and answer the queries waiting for it
+ * @param job finished job
+ */
+static void ticket_done(judge_job *job)
+{
+    ticket *t = job->owner;
+    if (!job->profile)
+        cache_verdict(&t->cache, job);
+    store_verdict(t->id, job->result, job->result_len);
+    if (result_store_put(t->id, job->result, job->result_len) < 0)
+        fprintf(stderr, "could not store the verdict of ticket %llu\n", (unsigned long long)t->id);
+    int had_waiters = (t->waiters != NULL);
+    while (t->waiters)
+    {
+        client_conn *w = t->waiters;
+        t->waiters = w->wait_next;
+        w->wait_next = NULL;
+        deliver_result(w, job->result, job->result_len);
+    }
+    ticket **p = &tickets;
+    while (*p != t)
+        p = &(*p)->next;
+    *p = t->next;
+    free(t);
+    if (had_waiters)
+        arm_query_timer();
+}
+
+/**
+ * @brief move the job of a detached upload from its connection to a ticket
+ * @param conn client connection with its job created
+ * @return 0 on success, -1 if the job stays with the connection
+ */
+static int detach_job(client_conn *conn)
+{
+    ticket *t = calloc(1, sizeof(ticket));
+    if (!t)
+    {
+        perror("malloc failed");
+        return -1;
     }
+    t->id = conn->submission_id;
+    t->cache = conn->cache;
+    t->job = conn->job;
+    conn->job->on_done = ticket_done;
+    conn->job->owner = t;
+    conn->job = NULL;
+    t->next = tickets;
+    tickets = t;
+    return 0;
+}
+
+/**
+ * @brief answer with the verdict of an accepted job right away, the timing or profile
+ *      that follows goes to the result store under a ticket appended to the reply
+ * @param job job queued for its bench stage
+ */
+static void judge_verdict(judge_job *job)
+{
+    client_conn *conn = job->owner;
+    // no timing or profile in the text yet
+    cache_verdict(&conn->cache, job);
+    store_verdict(conn->submission_id, job->result, job->result_len);
+    uint64_t token = 0;
+    if (detach_job(conn) == 0)
+        token = result_store_ticket(conn->submission_id);
     else
     {
-        conn->judge_pipe_fd = pipe_fd[0];
-        close(pipe_fd[1]);
-        conn->state = STATE_WAIT_JUDGE;
+        // nobody would ask for the rest
+        job->on_done = NULL;
+        conn->job = NULL;
     }
+    char reply[JUDGE_RESULT_SIZE + 32];
+    size_t len = job->result_len;
+    memcpy(reply, job->result, len);
+    if (token)
+        len += snprintf(reply + len, sizeof(reply) - len, "Ticket: %llu\n", (unsigned long long)token);
+    deliver_result(conn, reply, len);
 }
 
 /**
- * @brief read header data from the client
- * @param conn client connection
+ * @brief answer a detached upload with its ticket
+ * @param conn client connection, its submission stored
  */
-static void handle_read_header(client_conn *conn)
+static void reply_ticket(client_conn *conn)
 {
-    ssize_t n = recv(conn->fd, conn->header + conn->header_bytes, HEADER_SIZE - conn->header_bytes, 0);
-    if (n < 0)
+    // the submission ID stays internal, IDs are sequential
+    uint64_t token = result_store_ticket(conn->submission_id);
+    if (!token)
     {
-        if (errno != EWOULDBLOCK && errno != EAGAIN)
-        {
-            perror("recv header failed");
-            conn->state = STATE_DONE;
-        }
+        deliver_result(conn, TICKET_ERROR, strlen(TICKET_ERROR));
         return;
     }
-    else if (n == 0)
+    char reply[64];
+    int len = snprintf(reply, sizeof(reply), "Ticket: %llu\n", (unsigned long long)token);
+    deliver_result(conn, reply, len);
+}
+
+/**
+ * @brief answer a result query with the stored verdict, or keep it waiting for the
+ *      verdict of a ticket still being judged until its deadline
+ * @param conn client connection with the query received
+ */
+static void handle_query(client_conn *conn)
+{
+    uint64_t net_id, net_wait;
+    memcpy(&net_id, conn->source, 8);
+    memcpy(&net_wait, conn->source + 8, 8);
+    uint64_t wait_ms = be64toh(net_wait);
+    uint64_t id;
+    if (result_store_resolve(be64toh(net_id), &id) < 0)
     {
-        conn->state = STATE_DONE;
+        deliver_result(conn, QUERY_UNKNOWN, strlen(QUERY_UNKNOWN));
         return;
     }
-    conn->header_bytes += n;
-    if (conn->header_bytes == HEADER_SIZE)
+    ticket *t = find_ticket(id);
+    if (t)
+    {
+        // a query handed over by the previous server keeps its deadline
+        if (!conn->wait_until && wait_ms > 0)
+            conn->wait_until = now_ms() + (int64_t)(wait_ms < QUERY_MAX_WAIT_MS ? wait_ms : QUERY_MAX_WAIT_MS);
+        if (!conn->wait_until)
+        {
+            deliver_result(conn, QUERY_PENDING, strlen(QUERY_PENDING));
+            return;
+        }
+        conn->wait_next = t->waiters;
+        t->waiters = conn;
+        arm_query_timer();
+        return;
+    }
+    char result[JUDGE_RESULT_SIZE];
+    size_t len;
+    if (result_store_get(id, result, sizeof(result), &len) == 0)
+        deliver_result(conn, result, len);
+    else
+        deliver_result(conn, QUERY_UNKNOWN, strlen(QUERY_UNKNOWN));
+}
+
+/**
+ * @brief check whether received source bytes still have to be written to the judge's stdin
+ * @param conn client connection
+ * @return 1 if bytes are pending, 0 otherwise
+ */
+static int stream_pending(const client_conn *conn)
+{
+    return conn->state == STATE_READING_FILE && conn->job && conn->job->stdin_fd >= 0 &&
+           conn->stream_off < conn->file_received;
+}
+
+/**
+ * @brief write the pending source bytes to the judge's stdin
+ * @param conn client connection
+ * @return 0 when nothing is pending anymore, 1 if the pipe is full
+ */
+static int flush_stream(client_conn *conn)
+{
+    while (conn->job->stdin_fd >= 0 && conn->stream_off < conn->file_received)
     {
-        uint64_t net_file_size;
-        memcpy(&net_file_size, conn->header + 8, 8);
-        conn->file_size = be64toh(net_file_size);
-        conn->file_received = 0;
+        ssize_t n = write(conn->job->stdin_fd, conn->source + conn->stream_off, conn->file_received - conn->stream_off);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+                return 1;
+            // the compiler is gone, the judge reports on its own
+            perror("write source to judge failed");
+            close(conn->job->stdin_fd);
+            conn->job->stdin_fd = -1;
+            break;
+        }
+        conn->stream_off += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief number the submission and create its judge job
+ * @param conn client connection
+ * @return 0 on success, -1 on error
+ */
+static int create_job(client_conn *conn)
+{
+    // IDs never repeat, unlike the client address and the time
+    conn->submission_id = store_reserve();
+    if (conn->submission_id == 0)
+        return -1;
+    snprintf(conn->source_filename, sizeof(conn->source_filename), "sub%llu%s",
+             (unsigned long long)conn->submission_id, conn->tc->extension);
+    conn->job = judge_job_create(conn->source_filename, judge_done, conn);
+    if (!conn->job)
+        return -1;
+    // a front-end server waits for the whole result, it has no ticket of ours to ask with
+    if (!conn->node_job)
+        conn->job->on_verdict = judge_verdict;
+    // forwarded jobs are judged here, never forwarded again
+    // judge nodes are sent plain jobs, a profile is only taken here
+    conn->job->local_only = conn->node_job || conn->profile;
+    conn->job->profile = conn->profile;
+    // each client address gets its fair share of the workers
+    conn->job->user = conn->addr.sin_addr.s_addr;
+    // falls back to compiling after the upload when no compile worker is free
+    if (server_cfg.stream_compile)
+        judge_sched_stream(conn->job);
+    return 0;
+}
 
-        char filename[256];
-        snprintf(filename, sizeof(filename), "files/receive/%s_%d_%ld.c",
-                 inet_ntoa(conn->addr.sin_addr), ntohs(conn->addr.sin_port), time(NULL));
+/**
+ * @brief store the complete source, then answer from the cache or hand it over to the judge
+ * @param conn client connection with its job created
+ */
+static void submit_upload(client_conn *conn)
+{
+    if (store_append(conn->submission_id, conn->tc->name, conn->source, conn->file_size) < 0)
+        fprintf(stderr, "could not store submission %llu\n", (unsigned long long)conn->submission_id);
+    conn->job->source = conn->source;
+    conn->job->source_len = conn->file_size;
+    conn->source = NULL;
 
-        strncpy(conn->source_filename, filename, sizeof(conn->source_filename));
-        conn->source_filename[sizeof(conn->source_filename) - 1] = '\0';
-        conn->fp = fopen(filename, "wb");
-        if (!conn->fp)
+    char cached[JUDGE_RESULT_SIZE];
+    size_t cached_len;
+    // a cached verdict has no profile
+    if (!conn->profile &&
+        verdict_cache_lookup(&conn->cache, cached, sizeof(cached) - strlen(CACHED_FLAG), &cached_len) == 0)
+    {
+        // a streaming compile may already be running, its result is dropped
+        judge_sched_cancel(conn->job);
+        conn->job = NULL;
+        memcpy(cached + cached_len, CACHED_FLAG, strlen(CACHED_FLAG) + 1);
+        store_verdict(conn->submission_id, cached, cached_len + strlen(CACHED_FLAG));
+        if (conn->detached)
         {
-            perror("fopen failed");
-            conn->state = STATE_DONE;
+            if (result_store_put(conn->submission_id, cached, cached_len + strlen(CACHED_FLAG)) < 0)
+                fprintf(stderr, "could not store the verdict of ticket %llu\n", (unsigned long long)conn->submission_id);
+            reply_ticket(conn);
             return;
         }
-        conn->state = STATE_READING_FILE;
+        deliver_result(conn, cached, cached_len + strlen(CACHED_FLAG));
+        return;
     }
+    // the client gets its ticket now, the verdict goes to the result store
+    judge_job *job = conn->job;
+    if (conn->detached && detach_job(conn) == 0)
+        reply_ticket(conn);
+    judge_sched_submit(job);
 }
 
 /**
- * @brief read file data from the client
+ * @brief finish the upload and hand the source over to the judge
  * @param conn client connection
  */
-static void handle_read_file(client_conn *conn)
+static void finish_upload(client_conn *conn)
 {
-    char buf[BUFFER_SIZE];
-    ssize_t n = recv(conn->fd, buf, BUFFER_SIZE, 0);
-    if (n < 0)
+    sha256_final(&conn->source_hash, conn->cache.source);
+    conn->state = STATE_WAIT_JUDGE;
+    if (self)
     {
-        if (errno != EWOULDBLOCK && errno != EAGAIN)
+        // the scheduler thread takes it from here, woken at the end of the round
+        mpsc_push(&uploads, &conn->link);
+        self->handed_off = 1;
+        return;
+    }
+    if (conn->query)
+        handle_query(conn);
+    else
+        submit_upload(conn);
+}
+
+/**
+ * @brief start the request once its header is complete
+ * @param conn client connection
+ */
+static void start_request(client_conn *conn)
+{
+    if (memcmp(conn->header, STATUSRQ, 8) == 0)
+    {
+        int capacity, load;
+        load_stats(&capacity, &load);
+        node_pool_encode_stat(conn->judge_result, capacity, load);
+        conn->judge_result_len = NODE_HEADER_SIZE;
+        conn->state = STATE_SENDING_RESULT;
+        return;
+    }
+    uint64_t net_file_size;
+    memcpy(&net_file_size, conn->header + 8, 8);
+    conn->file_size = be64toh(net_file_size);
+    conn->file_received = 0;
+    if (memcmp(conn->header, RESULTRQ, 8) == 0)
+    {
+        // received like a source, answered by the scheduler
+        conn->query = 1;
+        conn->source = (conn->file_size == QUERY_SIZE) ? malloc(QUERY_SIZE) : NULL;
+        if (!conn->source)
         {
-            perror("recv file failed");
             conn->state = STATE_DONE;
+            return;
         }
+        sha256_init(&conn->source_hash);
+        conn->state = STATE_READING_FILE;
         return;
     }
-    else if (n == 0)
+
+    const toolchain *tc = toolchain_by_job_tag(conn->header);
+    conn->node_job = (tc != NULL);
+    if (!tc && (tc = toolchain_by_detach_tag(conn->header)))
+        conn->detached = 1;
+    if (!tc && (tc = toolchain_by_profile_tag(conn->header)))
+        conn->profile = 1;
+    if (!tc)
+        tc = toolchain_by_upload_tag(conn->header);
+    if (!tc)
+        tc = toolchain_default();
+
+    conn->tc = tc;
+    if (conn->file_size > STORE_MAX_SOURCE)
     {
-        conn->state = STATE_DONE;
+        set_result(conn, SOURCE_TOO_LARGE, strlen(SOURCE_TOO_LARGE));
         return;
     }
-    size_t written = fwrite(buf, 1, n, conn->fp);
-    if (written != (size_t)n)
+    // the same text is a different submission in another language
+    sha256_init(&conn->source_hash);
+    sha256_update(&conn->source_hash, tc->name, strlen(tc->name) + 1);
+
+    conn->source = malloc(conn->file_size ? conn->file_size : 1);
+    // network threads leave numbering and judging to the scheduler thread
+    if (!conn->source || (!self && create_job(conn) < 0))
     {
-        perror("fwrite failed");
         conn->state = STATE_DONE;
         return;
     }
+    conn->state = STATE_READING_FILE;
+    if (conn->file_size == 0)
+        finish_upload(conn);
+}
+
+/**
+ * @brief take received source bytes, already copied to conn->source
+ * @param conn client connection
+ * @param n byte size received
+ */
+static void source_received(client_conn *conn, size_t n)
+{
+    sha256_update(&conn->source_hash, conn->source + conn->file_received, n);
     conn->file_received += n;
+    // a full pipe is written on once writable, the upload finishes after that
+    if (conn->job && flush_stream(conn))
+        return;
     if (conn->file_received >= conn->file_size)
     {
-        fclose(conn->fp);
-        conn->fp = NULL;
-        spawn_judge(conn);
+        finish_upload(conn);
     }
 }
 
 /**
- * @brief read judge result from the pipe
+ * @brief read header data from the client
  * @param conn client connection
  */
-static void handle_read_judge(client_conn *conn)
+static void handle_read_header(client_conn *conn)
 {
-    char buf[BUFFER_SIZE];
-    ssize_t n = read(conn->judge_pipe_fd, buf, sizeof(buf));
+    ssize_t n = recv(conn->fd, conn->header + conn->header_bytes, HEADER_SIZE - conn->header_bytes, 0);
     if (n < 0)
     {
         if (errno != EWOULDBLOCK && errno != EAGAIN)
         {
-            perror("read judge failed");
+            perror("recv header failed");
             conn->state = STATE_DONE;
         }
         return;
     }
     else if (n == 0)
     {
-        conn->judge_result[conn->judge_result_len] = '\0';
-        conn->state = STATE_SENDING_RESULT;
-        int status;
-        while (waitpid(-1, &status, WNOHANG) > 0)
-            ;
+        conn->state = STATE_DONE;
         return;
     }
-    if (conn->judge_result_len + n < JUDGE_RESULT_SIZE - 1)
+    conn->header_bytes += n;
+    if (conn->header_bytes == HEADER_SIZE)
     {
-        memcpy(conn->judge_result + conn->judge_result_len, buf, n);
-        conn->judge_result_len += n;
+        start_request(conn);
     }
-    else
+}
+
+/**
+ * @brief read file data from the client
+ * @param conn client connection
+ */
+static void handle_read_file(client_conn *conn)
+{
+    // straight into the source buffer, as much as the socket has
+    ssize_t n = recv(conn->fd, conn->source + conn->file_received, conn->file_size - conn->file_received, 0);
+    if (n < 0)
     {
-        conn->judge_result_len = JUDGE_RESULT_SIZE - 1;
-        conn->state = STATE_SENDING_RESULT;
+        if (errno != EWOULDBLOCK && errno != EAGAIN)
+        {
+            perror("recv file failed");
+            conn->state = STATE_DONE;
+        }
+        return;
+    }
+    else if (n == 0)
+    {
+        conn->state = STATE_DONE;
+        return;
+    }
+    source_received(conn, n);
+}
+
+/**
+ * @brief write pending source bytes to the judge once its stdin is writable
+ * @param conn client connection
+ */
+static void handle_write_stream(client_conn *conn)
+{
+    if (flush_stream(conn) == 0 && conn->file_received >= conn->file_size)
+    {
+        finish_upload(conn);
     }
 }
 
@@ -263,21 +779,14 @@ void sigchld_handler(int signo)
         ;
 }
 
-int start_tcp_server(int port)
+/**
+ * @brief create the listening socket
+ * @param port listening port
+ * @param reuse_port 1 to share the port with the listeners of the other network threads
+ * @return listening socket, exit() on error
+ */
+static int open_listener(int port, int reuse_port)
 {
-    signal(SIGCHLD, sigchld_handler);
-
-    struct sigaction sa_int;
-    sa_int.sa_handler = sigint_handler;
-    sigemptyset(&sa_int.sa_mask);
-
-    sa_int.sa_flags = 0;
-    if (sigaction(SIGINT, &sa_int, NULL) == -1)
-    {
-        perror("sigaction SIGINT failed");
-        exit(EXIT_FAILURE);
-    }
-
     int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (listen_fd < 0)
     {
@@ -285,7 +794,8 @@ int start_tcp_server(int port)
         exit(EXIT_FAILURE);
     }
     int opt = 1;
-    if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+    if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        (reuse_port && setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0))
     {
         perror("setsockopt failed");
         exit(EXIT_FAILURE);
@@ -306,31 +816,263 @@ int start_tcp_server(int port)
         exit(EXIT_FAILURE);
     }
     set_nonblocking(listen_fd);
-    printf("TCP server listening on port %d\n", port);
+    return listen_fd;
+}
 
-    fd_set read_fds, write_fds;
-    int max_fd;
-    while (server_running)
+/**
+ * @brief take the listening socket and the connections over from the running server
+ * @param port listening port
+ * @return listening socket, exit() on error
+ */
+static int take_over(int port)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int sock = handover_connect(port);
+    if (sock < 0)
+        exit(EXIT_FAILURE);
+    int listen_fd = handover_recv_listener(sock);
+    int results_fd = handover_recv_results(sock);
+    if (listen_fd < 0 || results_fd < 0)
+        exit(EXIT_FAILURE);
+    int count = 0;
+    client_conn *conn;
+    int ret;
+    while ((ret = handover_recv_conn(sock, judge_done, &conn)) > 0)
+    {
+        add_connection(conn);
+        count++;
+    }
+    int n_tickets = 0;
+    ticket *t;
+    if (ret == 0)
+    {
+        while ((ret = handover_recv_ticket(sock, ticket_done, &t)) > 0)
+        {
+            t->next = tickets;
+            tickets = t;
+            n_tickets++;
+        }
+    }
+    // nothing is touched before the end marker, the old server keeps serving on a failure
+    if (ret < 0)
+        exit(EXIT_FAILURE);
+    close(sock);
+    // running judges publish into the previous server's slots, a stage whose record is lost ends at EOF
+    result_slots_adopt(results_fd);
+    for (conn = conn_list; conn; conn = conn->next)
+    {
+        if (!conn->job)
+            continue;
+        if (!conn->node_job)
+            conn->job->on_verdict = judge_verdict;
+        judge_sched_adopt(conn->job);
+    }
+    for (t = tickets; t; t = t->next)
+        judge_sched_adopt(t->job);
+    // waiting queries join their ticket again, or get the verdict stored meanwhile
+    for (conn = conn_list; conn; conn = conn->next)
+    {
+        if (conn->query && conn->state == STATE_WAIT_JUDGE)
+            handle_query(conn);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Took over %d connection(s) and %d ticket(s) in %.1f ms\n", count, n_tickets,
+           (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    return listen_fd;
+}
+
+/**
+ * @brief hand the listening socket and the connections over to a new server process
+ * @param sock handover connection returned by handover_accept
+ * @param listen_fd listening socket
+ * @return 0 once handed over, -1 if this server keeps running
+ */
+static int hand_over(int sock, int listen_fd)
+{
+    // the new server reads the store index, pending records must be in it
+    store_flush();
+    int count = 0;
+    int n_tickets = 0;
+    int ret = handover_send_listener(sock, listen_fd);
+    if (ret == 0)
+        ret = handover_send_results(sock, result_slots_shm_fd());
+    for (client_conn *conn = conn_list; conn && ret == 0; conn = conn->next)
+    {
+        ret = handover_send_conn(sock, conn);
+        count++;
+    }
+    if (ret == 0)
+        ret = handover_send_end(sock);
+    for (ticket *t = tickets; t && ret == 0; t = t->next)
+    {
+        ret = handover_send_ticket(sock, t);
+        n_tickets++;
+    }
+    if (ret == 0)
+        ret = handover_send_end(sock);
+    close(sock);
+    if (ret < 0)
+    {
+        fprintf(stderr, "handover failed, still serving\n");
+        return -1;
+    }
+    // judges started here are left running, the new server reads their pipes
+    printf("Handed over %d connection(s) and %d ticket(s)\n", count, n_tickets);
+    return 0;
+}
+
+/**
+ * @brief add an accepted client connection
+ * @param client_fd client socket, non-blocking and close-on-exec
+ * @param cli_addr client address
+ */
+static void new_connection(int client_fd, const struct sockaddr_in *cli_addr)
+{
+    client_conn *conn = malloc(sizeof(client_conn));
+    if (!conn)
+    {
+        perror("malloc failed");
+        close(client_fd);
+        return;
+    }
+    memset(conn, 0, sizeof(client_conn));
+    conn->fd = client_fd;
+    conn->addr = *cli_addr;
+    conn->state = STATE_READING_HEADER;
+    conn->header_bytes = 0;
+    conn->file_size = 0;
+    conn->file_received = 0;
+    conn->source = NULL;
+    conn->job = NULL;
+    conn->judge_result_len = 0;
+    conn->judge_sent = 0;
+    conn->net = self;
+    add_connection(conn);
+    printf("New client connected: %s:%d\n", inet_ntoa(cli_addr->sin_addr), ntohs(cli_addr->sin_port));
+}
+
+/**
+ * @brief wake a thread waiting on an eventfd
+ * @param fd eventfd
+ */
+static void wake(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("write eventfd failed");
+}
+
+/**
+ * @brief add the query timer to a read set, scheduler thread only
+ * @param read_fds read set
+ * @param max_fd highest descriptor in the set (in/out)
+ */
+static void fill_query_timer(fd_set *read_fds, int *max_fd)
+{
+    FD_SET(query_timer_fd, read_fds);
+    if (query_timer_fd > *max_fd)
+        *max_fd = query_timer_fd;
+}
+
+/**
+ * @brief add what the loop waits on besides the connections: the scheduler's pipes
+ *      and the query timer, or the wakeup of a network thread
+ * @param read_fds read set
+ * @param write_fds write set
+ * @param max_fd highest descriptor in the sets (in/out)
+ */
+static void fill_backend_fds(fd_set *read_fds, fd_set *write_fds, int *max_fd)
+{
+    if (!self)
+    {
+        judge_sched_fill_fds(read_fds, write_fds, max_fd);
+        fill_query_timer(read_fds, max_fd);
+        return;
+    }
+    FD_SET(self->wake_fd, read_fds);
+    if (self->wake_fd > *max_fd)
+        *max_fd = self->wake_fd;
+}
+
+/**
+ * @brief advance the scheduler, or take the replies the scheduler thread posted
+ * @param read_fds read set returned by the wait
+ * @param write_fds write set returned by the wait
+ */
+static void handle_backend(fd_set *read_fds, fd_set *write_fds)
+{
+    if (!self)
+    {
+        judge_sched_handle(read_fds, write_fds);
+        if (FD_ISSET(query_timer_fd, read_fds))
+            expire_queries();
+        return;
+    }
+    if (!FD_ISSET(self->wake_fd, read_fds))
+        return;
+    uint64_t count;
+    if (read(self->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        perror("read eventfd failed");
+    client_conn *conn;
+    while ((conn = spsc_pop(&self->results)))
+        conn->state = conn->judge_result_len ? STATE_SENDING_RESULT : STATE_DONE;
+}
+
+/**
+ * @brief end an event loop round: write the store records of the finished uploads in one
+ *      go, or wake the scheduler thread once for the uploads handed off
+ */
+static void end_round(void)
+{
+    if (!self)
+    {
+        store_flush();
+        return;
+    }
+    if (self->handed_off)
+    {
+        wake(sched_wake_fd);
+        self->handed_off = 0;
+    }
+}
+
+/**
+ * @brief readiness-based event loop, one syscall per handler
+ * @param listen_fd listening socket
+ * @param handover_fd handover listening socket, set to -1 once handed over
+ */
+static void select_loop(int listen_fd, int *handover_fd)
+{
+    fd_set read_fds, write_fds;
+    int max_fd;
+    while (server_running)
     {
         FD_ZERO(&read_fds);
         FD_ZERO(&write_fds);
         FD_SET(listen_fd, &read_fds);
         max_fd = listen_fd;
+        if (*handover_fd >= 0)
+        {
+            FD_SET(*handover_fd, &read_fds);
+            if (*handover_fd > max_fd)
+                max_fd = *handover_fd;
+        }
 
         for (client_conn *conn = conn_list; conn; conn = conn->next)
         {
-            if (conn->state == STATE_READING_HEADER || conn->state == STATE_READING_FILE)
+            if (stream_pending(conn))
+            {
+                FD_SET(conn->job->stdin_fd, &write_fds);
+                if (conn->job->stdin_fd > max_fd)
+                    max_fd = conn->job->stdin_fd;
+            }
+            else if (conn->state == STATE_READING_HEADER || conn->state == STATE_READING_FILE)
             {
                 FD_SET(conn->fd, &read_fds);
                 if (conn->fd > max_fd)
                     max_fd = conn->fd;
             }
-            else if (conn->state == STATE_WAIT_JUDGE)
-            {
-                FD_SET(conn->judge_pipe_fd, &read_fds);
-                if (conn->judge_pipe_fd > max_fd)
-                    max_fd = conn->judge_pipe_fd;
-            }
             else if (conn->state == STATE_SENDING_RESULT)
             {
                 FD_SET(conn->fd, &write_fds);
@@ -339,6 +1081,8 @@ int start_tcp_server(int port)
             }
         }
 
+        fill_backend_fds(&read_fds, &write_fds, &max_fd);
+
         int activity = select(max_fd + 1, &read_fds, &write_fds, NULL, NULL);
         if (activity < 0)
         {
@@ -348,35 +1092,16 @@ int start_tcp_server(int port)
             break;
         }
 
+        handle_backend(&read_fds, &write_fds);
+
         if (FD_ISSET(listen_fd, &read_fds))
         {
             struct sockaddr_in cli_addr;
             socklen_t cli_len = sizeof(cli_addr);
-            int client_fd = accept(listen_fd, (struct sockaddr *)&cli_addr, &cli_len);
+            // judges and other children must not keep client sockets open
+            int client_fd = accept4(listen_fd, (struct sockaddr *)&cli_addr, &cli_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
             if (client_fd >= 0)
-            {
-                set_nonblocking(client_fd);
-                client_conn *conn = malloc(sizeof(client_conn));
-                if (!conn)
-                {
-                    perror("malloc failed");
-                    close(client_fd);
-                    continue;
-                }
-                memset(conn, 0, sizeof(client_conn));
-                conn->fd = client_fd;
-                conn->addr = cli_addr;
-                conn->state = STATE_READING_HEADER;
-                conn->header_bytes = 0;
-                conn->file_size = 0;
-                conn->file_received = 0;
-                conn->fp = NULL;
-                conn->judge_pipe_fd = -1;
-                conn->judge_result_len = 0;
-                conn->judge_sent = 0;
-                add_connection(conn);
-                printf("New client connected: %s:%d\n", inet_ntoa(cli_addr.sin_addr), ntohs(cli_addr.sin_port));
-            }
+                new_connection(client_fd, &cli_addr);
         }
 
         client_conn *conn = conn_list;
@@ -388,13 +1113,14 @@ int start_tcp_server(int port)
             {
                 handle_read_header(conn);
             }
-            else if (conn->state == STATE_READING_FILE && FD_ISSET(conn->fd, &read_fds))
+            else if (stream_pending(conn))
             {
-                handle_read_file(conn);
+                if (FD_ISSET(conn->job->stdin_fd, &write_fds))
+                    handle_write_stream(conn);
             }
-            else if (conn->state == STATE_WAIT_JUDGE && FD_ISSET(conn->judge_pipe_fd, &read_fds))
+            else if (conn->state == STATE_READING_FILE && FD_ISSET(conn->fd, &read_fds))
             {
-                handle_read_judge(conn);
+                handle_read_file(conn);
             }
             else if (conn->state == STATE_SENDING_RESULT && FD_ISSET(conn->fd, &write_fds))
             {
@@ -406,7 +1132,608 @@ int start_tcp_server(int port)
             }
             conn = next;
         }
+
+        end_round();
+
+        if (*handover_fd >= 0 && FD_ISSET(*handover_fd, &read_fds))
+        {
+            int sock = handover_accept(*handover_fd);
+            if (sock >= 0 && hand_over(sock, listen_fd) == 0)
+            {
+                // the new server owns the socket path by now
+                close(*handover_fd);
+                *handover_fd = -1;
+                break;
+            }
+        }
+    }
+}
+
+#ifdef HAVE_IO_URING
+// request kind in the low bits of user_data, above it a connection pointer or a polled descriptor
+#define OP_ACCEPT 1
+#define OP_RECV 2
+#define OP_SEND 3
+#define OP_POLL 4
+#define OP_CANCEL 5
+#define OP_MASK 7
+#define POLL_WRITE 8 // poll for POLLOUT instead of POLLIN
+
+// one ring per network thread
+static __thread uring ring;
+static __thread int accept_armed = 0;  // multishot accept in flight
+static __thread uint32_t poll_gen = 0; // generation of the armed polls, completions of older ones are stale
+static __thread uint64_t armed_polls[FD_SETSIZE * 2]; // user_data of the polls armed in this generation
+static __thread size_t n_armed = 0;
+
+/**
+ * @brief take bytes received by io_uring, which may span the header and the source
+ * @param conn client connection
+ * @param data received bytes
+ * @param n byte size received
+ */
+static void consume_input(client_conn *conn, const char *data, size_t n)
+{
+    while (n > 0)
+    {
+        size_t take;
+        if (conn->state == STATE_READING_HEADER)
+        {
+            take = HEADER_SIZE - conn->header_bytes < n ? HEADER_SIZE - conn->header_bytes : n;
+            memcpy(conn->header + conn->header_bytes, data, take);
+            conn->header_bytes += take;
+            if (conn->header_bytes == HEADER_SIZE)
+                start_request(conn);
+        }
+        else if (conn->state == STATE_READING_FILE)
+        {
+            take = conn->file_size - conn->file_received < n ? conn->file_size - conn->file_received : n;
+            memcpy(conn->source + conn->file_received, data, take);
+            source_received(conn, take);
+        }
+        else
+        {
+            // bytes past the request are ignored, as with select
+            break;
+        }
+        data += take;
+        n -= take;
+    }
+}
+
+/**
+ * @brief queue the requests the connections need: a receive while reading, a send
+ *      while replying, the cancellation of the receive once done. Done connections
+ *      are freed once none of their requests is in flight.
+ */
+static void uring_update_connections(void)
+{
+    client_conn *conn = conn_list;
+    client_conn *next;
+    while (conn)
+    {
+        next = conn->next;
+        uint64_t base = (uint64_t)(uintptr_t)conn;
+        if (conn->state == STATE_READING_HEADER || conn->state == STATE_READING_FILE)
+        {
+            if (!(conn->uring_ops & URING_RECV))
+            {
+                uring_prep_recv(&ring, conn->fd, base | OP_RECV);
+                conn->uring_ops |= URING_RECV;
+            }
+        }
+        else if (conn->state == STATE_SENDING_RESULT)
+        {
+            if (!(conn->uring_ops & URING_SEND))
+            {
+                uring_prep_send(&ring, conn->fd, conn->judge_result + conn->judge_sent,
+                                conn->judge_result_len - conn->judge_sent, base | OP_SEND);
+                conn->uring_ops |= URING_SEND;
+            }
+        }
+        else if (conn->state == STATE_DONE)
+        {
+            if ((conn->uring_ops & URING_RECV) && !(conn->uring_ops & URING_CANCEL))
+            {
+                uring_prep_cancel(&ring, base | OP_RECV, OP_CANCEL);
+                conn->uring_ops |= URING_CANCEL;
+            }
+            if (!(conn->uring_ops & (URING_RECV | URING_SEND)))
+                remove_connection(conn);
+        }
+        conn = next;
+    }
+}
+
+/**
+ * @brief replace the polls of the previous round with one-shot polls of the wanted
+ *      descriptors. Re-arming each round keeps a closed and reused descriptor from
+ *      being watched through its old file.
+ * @param read_fds descriptors to poll for reading
+ * @param write_fds descriptors to poll for writing
+ * @param max_fd highest descriptor in the sets
+ * @return number of polls cancelled, each one completes twice (the poll and the cancellation)
+ */
+static int uring_arm_polls(fd_set *read_fds, fd_set *write_fds, int max_fd)
+{
+    int cancelled = 0;
+    for (size_t i = 0; i < n_armed; i++)
+    {
+        if (armed_polls[i])
+        {
+            uring_prep_cancel(&ring, armed_polls[i], OP_CANCEL);
+            cancelled++;
+        }
+    }
+    n_armed = 0;
+    poll_gen++;
+    for (int fd = 0; fd <= max_fd; fd++)
+    {
+        uint64_t base = (uint64_t)poll_gen << 32 | (uint64_t)fd << 4 | OP_POLL;
+        if (FD_ISSET(fd, read_fds))
+        {
+            uring_prep_poll(&ring, fd, POLLIN, base);
+            armed_polls[n_armed++] = base;
+        }
+        if (FD_ISSET(fd, write_fds))
+        {
+            uring_prep_poll(&ring, fd, POLLOUT, base | POLL_WRITE);
+            armed_polls[n_armed++] = base | POLL_WRITE;
+        }
+    }
+    return cancelled;
+}
+
+/**
+ * @brief handle the completions in the ring
+ * @param read_fds descriptors found readable (out)
+ * @param write_fds descriptors found writable (out)
+ */
+static void uring_reap(fd_set *read_fds, fd_set *write_fds)
+{
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(&ring)))
+    {
+        uint64_t ud = cqe->user_data;
+        int res = cqe->res;
+        int more = cqe->flags & IORING_CQE_F_MORE;
+        client_conn *conn = (client_conn *)(uintptr_t)(ud & ~(uint64_t)OP_MASK);
+        switch (ud & OP_MASK)
+        {
+        case OP_ACCEPT:
+            if (!more)
+                accept_armed = 0;
+            if (res >= 0)
+            {
+                // multishot accept has no per-connection address buffer
+                struct sockaddr_in cli_addr;
+                socklen_t cli_len = sizeof(cli_addr);
+                memset(&cli_addr, 0, sizeof(cli_addr));
+                getpeername(res, (struct sockaddr *)&cli_addr, &cli_len);
+                new_connection(res, &cli_addr);
+            }
+            else if (res != -ECANCELED)
+            {
+                fprintf(stderr, "accept failed: %s\n", strerror(-res));
+            }
+            break;
+        case OP_RECV:
+            if (!more)
+                conn->uring_ops &= ~URING_RECV;
+            if (res > 0)
+            {
+                consume_input(conn, uring_buf(&ring, cqe), res);
+                uring_buf_recycle(&ring, cqe);
+            }
+            else if (res == -ENOBUFS || res == -ECANCELED)
+            {
+                // re-armed by the next update, or taken over by the new server
+            }
+            else if (conn->state == STATE_READING_HEADER || conn->state == STATE_READING_FILE)
+            {
+                if (res < 0)
+                    fprintf(stderr, "recv failed: %s\n", strerror(-res));
+                conn->state = STATE_DONE;
+            }
+            break;
+        case OP_SEND:
+            conn->uring_ops &= ~URING_SEND;
+            if (res >= 0)
+            {
+                conn->judge_sent += res;
+                if (conn->judge_sent >= conn->judge_result_len)
+                    conn->state = STATE_DONE;
+            }
+            else if (res != -ECANCELED)
+            {
+                fprintf(stderr, "send result failed: %s\n", strerror(-res));
+                conn->state = STATE_DONE;
+            }
+            break;
+        case OP_POLL:
+            if ((uint32_t)(ud >> 32) == poll_gen)
+            {
+                for (size_t i = 0; i < n_armed; i++)
+                {
+                    if (armed_polls[i] == ud)
+                        armed_polls[i] = 0;
+                }
+                int fd = (int)((ud >> 4) & 0xfffffff);
+                if (res > 0)
+                    FD_SET(fd, (ud & POLL_WRITE) ? write_fds : read_fds);
+            }
+            break;
+        default:
+            break;
+        }
+        uring_cqe_seen(&ring);
+    }
+}
+
+/**
+ * @brief cancel every request and handle what completes meanwhile, so that no accepted
+ *      connection or received byte is left behind in the ring at a handover
+ */
+static void uring_quiesce(void)
+{
+    fd_set read_fds, write_fds;
+    uring_prep_cancel(&ring, 0, OP_CANCEL);
+    for (size_t i = 0; i < n_armed; i++)
+        armed_polls[i] = 0;
+    for (;;)
+    {
+        int busy = accept_armed;
+        for (client_conn *conn = conn_list; conn; conn = conn->next)
+            busy |= conn->uring_ops & (URING_RECV | URING_SEND);
+        if (!busy)
+            break;
+        if (uring_submit(&ring, 1) < 0 && errno != EINTR)
+        {
+            perror("io_uring_enter failed");
+            break;
+        }
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        uring_reap(&read_fds, &write_fds);
+    }
+    for (client_conn *conn = conn_list; conn; conn = conn->next)
+        conn->uring_ops = 0;
+}
+
+/**
+ * @brief completion-based event loop: multishot accept and receive into kernel-picked
+ *      buffers, sends and the polls of the scheduler's pipes all go through one
+ *      io_uring_enter per round
+ * @param listen_fd listening socket
+ * @param handover_fd handover listening socket, set to -1 once handed over
+ * @return 0 when the loop ends, -1 if io_uring is not available
+ */
+static int uring_loop(int listen_fd, int *handover_fd)
+{
+    if (uring_init(&ring) < 0)
+    {
+        fprintf(stderr, "io_uring unavailable, using select\n");
+        return -1;
+    }
+    printf("I/O backend: io_uring\n");
+    fd_set read_fds, write_fds;
+    int max_fd;
+    while (server_running)
+    {
+        if (!accept_armed)
+        {
+            uring_prep_accept(&ring, listen_fd, OP_ACCEPT);
+            accept_armed = 1;
+        }
+        uring_update_connections();
+
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        max_fd = -1;
+        if (*handover_fd >= 0)
+        {
+            FD_SET(*handover_fd, &read_fds);
+            max_fd = *handover_fd;
+        }
+        for (client_conn *conn = conn_list; conn; conn = conn->next)
+        {
+            if (stream_pending(conn))
+            {
+                FD_SET(conn->job->stdin_fd, &write_fds);
+                if (conn->job->stdin_fd > max_fd)
+                    max_fd = conn->job->stdin_fd;
+            }
+        }
+        fill_backend_fds(&read_fds, &write_fds, &max_fd);
+        int cancelled = uring_arm_polls(&read_fds, &write_fds, max_fd);
+
+        // the completions of the cancelled polls alone must not end the wait
+        if (uring_submit(&ring, 1 + 2 * cancelled) < 0 && errno != EINTR)
+        {
+            perror("io_uring_enter failed");
+            break;
+        }
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        uring_reap(&read_fds, &write_fds);
+
+        handle_backend(&read_fds, &write_fds);
+        for (client_conn *conn = conn_list; conn; conn = conn->next)
+        {
+            if (stream_pending(conn) && FD_ISSET(conn->job->stdin_fd, &write_fds))
+                handle_write_stream(conn);
+        }
+
+        end_round();
+
+        if (*handover_fd >= 0 && FD_ISSET(*handover_fd, &read_fds))
+        {
+            int sock = handover_accept(*handover_fd);
+            if (sock >= 0)
+            {
+                uring_quiesce();
+                if (hand_over(sock, listen_fd) == 0)
+                {
+                    close(*handover_fd);
+                    *handover_fd = -1;
+                    break;
+                }
+            }
+        }
+    }
+    printf("io_uring_enter calls: %lu\n", ring.enters);
+    uring_exit(&ring);
+    return 0;
+}
+#endif // HAVE_IO_URING
+
+/**
+ * @brief body of a network thread: one event loop over its own listener and connections
+ * @param arg network thread
+ * @return NULL
+ */
+static void *net_thread_main(void *arg)
+{
+    self = arg;
+    // only the main loop of the process hands over
+    int no_handover = -1;
+    int done = 0;
+#ifdef HAVE_IO_URING
+    if (server_cfg.io_uring)
+        done = (uring_loop(self->listen_fd, &no_handover) == 0);
+#endif
+    if (!done)
+        select_loop(self->listen_fd, &no_handover);
+    return NULL;
+}
+
+/**
+ * @brief store a finished upload handed off by a network thread and judge it, or
+ *      answer the query it carries
+ * @param conn client connection, owned by the scheduler thread until its result is posted
+ */
+static void schedule_upload(client_conn *conn)
+{
+    if (conn->query)
+    {
+        handle_query(conn);
+        return;
+    }
+    if (create_job(conn) < 0)
+    {
+        deliver_result(conn, NULL, 0);
+        return;
+    }
+    submit_upload(conn);
+}
+
+/**
+ * @brief hand the results held back by full rings over, then wake the network threads
+ *      that got any in this round
+ */
+static void publish_results(void)
+{
+    while (backlog_head)
+    {
+        client_conn *conn = CONN_OF(backlog_head);
+        if (spsc_push(&conn->net->results, conn) < 0)
+            break;
+        conn->net->wake_pending = 1;
+        backlog_head = backlog_head->next;
+    }
+    if (!backlog_head)
+        backlog_tail = NULL;
+    for (int i = 0; i < server_cfg.net_threads; i++)
+    {
+        if (net_threads[i].wake_pending)
+        {
+            wake(net_threads[i].wake_fd);
+            net_threads[i].wake_pending = 0;
+        }
+    }
+}
+
+/**
+ * @brief scheduler thread loop: takes the uploads from the network threads, stores and
+ *      judges them, and posts the results back. It forks every judge and reaps them in
+ *      its SIGCHLD handler, the network threads block the signal.
+ */
+static void sched_loop(void)
+{
+    fd_set read_fds, write_fds;
+    int max_fd;
+    while (server_running)
+    {
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(sched_wake_fd, &read_fds);
+        max_fd = sched_wake_fd;
+        judge_sched_fill_fds(&read_fds, &write_fds, &max_fd);
+        fill_query_timer(&read_fds, &max_fd);
+
+        // a full ring is retried once its network thread had time to drain it
+        struct timeval retry = {0, 1000};
+        int activity = select(max_fd + 1, &read_fds, &write_fds, NULL, backlog_head ? &retry : NULL);
+        if (activity < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("select failed");
+            break;
+        }
+
+        judge_sched_handle(&read_fds, &write_fds);
+        if (FD_ISSET(query_timer_fd, &read_fds))
+            expire_queries();
+        if (FD_ISSET(sched_wake_fd, &read_fds))
+        {
+            // read before popping, a push that is half done wakes us again
+            uint64_t count;
+            if (read(sched_wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                perror("read eventfd failed");
+            mpsc_node *node;
+            while ((node = mpsc_pop(&uploads)))
+                schedule_upload(CONN_OF(node));
+        }
+
+        // records of the uploads taken in this round go out in one write
+        store_flush();
+        publish_results();
+        int capacity, load;
+        judge_sched_stats(&capacity, &load);
+        __atomic_store_n(&published_capacity, capacity, __ATOMIC_RELAXED);
+        __atomic_store_n(&published_load, load, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief run the network threads, each with its own listener on the port, and the
+ *      scheduler on the calling thread until SIGINT
+ * @param port listening port
+ */
+static void run_net_threads(int port)
+{
+    int n = server_cfg.net_threads;
+    net_threads = aligned_alloc(CACHE_LINE, n * sizeof(net_thread));
+    sched_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!net_threads || sched_wake_fd < 0)
+    {
+        perror("network threads failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(net_threads, 0, n * sizeof(net_thread));
+    mpsc_init(&uploads);
+
+    // SIGINT and SIGCHLD stay with the scheduler thread
+    sigset_t blocked, old;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    for (int i = 0; i < n; i++)
+    {
+        net_thread *net = &net_threads[i];
+        spsc_init(&net->results);
+        net->listen_fd = open_listener(port, 1);
+        net->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (net->wake_fd < 0 || pthread_create(&net->tid, NULL, net_thread_main, net) != 0)
+        {
+            perror("network thread failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    printf("TCP server listening on port %d with %d network thread(s)\n", port, n);
+
+    sched_loop();
+
+    for (int i = 0; i < n; i++)
+        wake(net_threads[i].wake_fd);
+    for (int i = 0; i < n; i++)
+    {
+        pthread_join(net_threads[i].tid, NULL);
+        close(net_threads[i].wake_fd);
+        close(net_threads[i].listen_fd);
+    }
+    close(sched_wake_fd);
+    free(net_threads);
+}
+
+int start_tcp_server(const server_config *config)
+{
+    server_cfg = *config;
+    int port = config->port;
+    judge_sched_init(&config->sched);
+    if (verdict_cache_init(config->sched.problem_dir) < 0)
+        fprintf(stderr, "verdict cache unavailable\n");
+    // the result store sweeps expired tickets in a child right away
+    signal(SIGCHLD, sigchld_handler);
+    if (store_open(STORE_DIR) < 0 || result_store_open(RESULT_DIR) < 0)
+        exit(EXIT_FAILURE);
+    query_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (query_timer_fd < 0)
+    {
+        perror("timerfd_create failed");
+        exit(EXIT_FAILURE);
+    }
+    // a judge that exits early must not kill the server through its stdin pipe
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sigaction sa_int;
+    sa_int.sa_handler = sigint_handler;
+    sigemptyset(&sa_int.sa_mask);
+
+    sa_int.sa_flags = 0;
+    if (sigaction(SIGINT, &sa_int, NULL) == -1)
+    {
+        perror("sigaction SIGINT failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (config->net_threads > 0)
+    {
+        if (config->upgrade)
+        {
+            fprintf(stderr, "live upgrade needs the single-threaded server, drop -t\n");
+            exit(EXIT_FAILURE);
+        }
+        if (config->stream_compile)
+            fprintf(stderr, "streaming compile needs the single-threaded server, -s ignored\n");
+        server_cfg.stream_compile = 0;
+        run_net_threads(port);
+        if (config->sched.report_waits)
+            judge_sched_report(stdout);
+        store_close();
+        return 0;
+    }
+
+    int listen_fd = config->upgrade ? take_over(port) : open_listener(port, 0);
+    int handover_fd = handover_listen(port);
+    if (handover_fd < 0)
+        fprintf(stderr, "live upgrade unavailable\n");
+    printf("TCP server listening on port %d\n", port);
+
+    int done = 0;
+#ifdef HAVE_IO_URING
+    if (config->io_uring)
+        done = (uring_loop(listen_fd, &handover_fd) == 0);
+#else
+    if (config->io_uring)
+        fprintf(stderr, "built without io_uring, using select\n");
+#endif
+    if (!done)
+        select_loop(listen_fd, &handover_fd);
+
+    if (handover_fd >= 0)
+    {
+        char path[108];
+        snprintf(path, sizeof(path), HANDOVER_PATH_FMT, port);
+        close(handover_fd);
+        unlink(path);
     }
+    if (config->sched.report_waits)
+        judge_sched_report(stdout);
+    store_close();
     close(listen_fd);
     return 0;
 }
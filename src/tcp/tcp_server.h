@@ -2,6 +2,11 @@
 #define TCP_SERVER_H
 
 #include "../defineshit.h"
+#include "../sched/judge_sched.h"
+#include "../cache/verdict_cache.h"
+#include "../toolchain/toolchain.h"
+#include "../store/submission_store.h"
+#include "../util/lfqueue.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <signal.h>
@@ -21,7 +26,16 @@
 #define BACKLOG 5
 #define HEADER_SIZE 16
 #define BUFFER_SIZE 1024
-#define JUDGE_RESULT_SIZE 1024
+
+// result query of a detached submission: header RESULTRQ, then be64 ticket (not the submission ID) and be64 wait in ms
+#define RESULTRQ "RESULTRQ"
+#define QUERY_SIZE 16
+#define QUERY_MAX_WAIT_MS 300000 // longer waits are cut to this
+
+// io_uring requests of a connection
+#define URING_RECV 0x1   // multishot receive armed
+#define URING_SEND 0x2   // send in flight
+#define URING_CANCEL 0x4 // cancellation of the receive requested
 
 // client connection state
 typedef enum
@@ -45,15 +59,54 @@ typedef struct client_conn
     size_t header_bytes;                  // byte size of the header received
     uint64_t file_size;                   // byte size of the file to send
     uint64_t file_received;               // byte size of the file received
-    FILE *fp;                             // file pointer for the received file
-    int judge_pipe_fd;                    // pipe file descriptor for the judge process / non-blocking
-    char judge_result[JUDGE_RESULT_SIZE]; // judge result buffer
+    char *source;                         // received source, handed to the job once complete
+    uint64_t submission_id;               // ID of the submission in the store
+    const toolchain *tc;                  // toolchain of the submission language
+    judge_job *job;                       // judge job, owned by the scheduler once submitted
+    size_t stream_off;                    // byte size of the source already written to the judge
+    int node_job;                         // 1 if the request was forwarded by a front-end server
+    int detached;                         // 1 to reply with a ticket once stored and judge without the connection
+    int profile;                          // 1 to profile the slowest test of an accepted submission
+    int query;                            // 1 for a result query, the query is received into source
+    int64_t wait_until;                   // CLOCK_MONOTONIC ms until which a query waits, 0 before it is answered
+    struct client_conn *wait_next;        // next query waiting on the same ticket
+    char judge_result[NODE_HEADER_SIZE + JUDGE_RESULT_SIZE]; // judge result buffer
     size_t judge_result_len;              // judge result byte size
     size_t judge_sent;                    // byte size of the judge result sent
-    char source_filename[256];            // source file name
+    char source_filename[256];            // submission name passed to the judge (sub<id>.<ext>)
+    sha256_ctx source_hash;               // hash of the source received so far
+    cache_key cache;                      // verdict cache key of the source
+    int uring_ops;                        // io_uring requests in flight (URING_RECV | URING_SEND | URING_CANCEL)
+    struct net_thread *net;               // network thread owning the connection, NULL without -t
+    mpsc_node link;                       // hand-off of the finished upload to the scheduler thread
     struct client_conn *next;             // next client connection
 } client_conn;
 
+/**
+ * @brief detached submission being judged, its client got a ticket that maps to the submission ID
+ */
+typedef struct ticket
+{
+    uint64_t id;                  // submission ID
+    cache_key cache;              // verdict cache key of the source
+    judge_job *job;               // judge job, owned by the scheduler
+    struct client_conn *waiters;  // queries waiting for the verdict
+    struct ticket *next;          // next detached submission
+} ticket;
+
+/**
+ * @brief server configuration
+ */
+typedef struct server_config
+{
+    int port;           // listening port
+    int stream_compile; // start the judge on header arrival and stream the upload into the compiler
+    int upgrade;        // take the port and the connections over from the server running on it
+    int io_uring;       // use the io_uring event loop when the kernel supports it
+    int net_threads;    // number of network threads in front of a scheduler thread, 0 for one thread doing both
+    sched_config sched; // judge stage worker counts
+} server_config;
+
 /**
  * @brief signal handler for SIGINT
  * @param signum signal number
@@ -68,8 +121,9 @@ void sigchld_handler(int signo);
 
 /**
  * @brief Start the TCP server
+ * @param config server configuration
  * @return 0 on success, exit() on fatal error.
  */
-int start_tcp_server(int port);
+int start_tcp_server(const server_config *config);
 
 #endif // TCP_SERVER_H
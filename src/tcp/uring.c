@@ -0,0 +1,279 @@
+#include "uring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+/**
+ * @brief check that the kernel has multishot receive (Linux 6.0)
+ * @return 1 if supported, 0 otherwise
+ */
+static int kernel_has_multishot_recv(void)
+{
+    struct utsname uts;
+    int major = 0;
+    if (uname(&uts) < 0 || sscanf(uts.release, "%d", &major) != 1)
+        return 0;
+    return major >= 6;
+}
+
+/**
+ * @brief check that the kernel knows the operations the server uses
+ * @param fd io_uring file descriptor
+ * @return 1 if supported, 0 otherwise
+ */
+static int kernel_has_ops(int fd)
+{
+    static const int ops[] = {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_POLL_ADD,
+                              IORING_OP_ASYNC_CANCEL};
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (!probe)
+        return 0;
+    int ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0;
+    for (size_t i = 0; ok && i < sizeof(ops) / sizeof(ops[0]); i++)
+        ok = ops[i] <= probe->last_op && (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+/**
+ * @brief map the rings of a new io_uring
+ * @param ring ring with fd set
+ * @param p parameters returned by io_uring_setup
+ * @return 0 on success, -1 on error
+ */
+static int map_rings(uring *ring, const struct io_uring_params *p)
+{
+    ring->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->cq_ring_size > ring->sq_ring_size)
+        ring->sq_ring_size = ring->cq_ring_size;
+    ring->cq_ring_size = ring->sq_ring_size;
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+        return -1;
+    ring->cq_ring = ring->sq_ring;
+    ring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+                      IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        return -1;
+    }
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *)(sq + p->sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+    ring->sq_entries = p->sq_entries;
+    ring->sq_array = (unsigned *)(sq + p->sq_off.array);
+    char *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *)(cq + p->cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    return 0;
+}
+
+/**
+ * @brief register the receive buffers with the kernel
+ * @param ring ring
+ * @return 0 on success, -1 on error
+ */
+static int setup_buffers(uring *ring)
+{
+    size_t ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED)
+    {
+        ring->buf_ring = NULL;
+        return -1;
+    }
+    ring->bufs = malloc((size_t)URING_BUF_COUNT * URING_BUF_SIZE);
+    if (!ring->bufs)
+        return -1;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = URING_BUF_COUNT;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return -1;
+    for (unsigned i = 0; i < URING_BUF_COUNT; i++)
+    {
+        struct io_uring_buf *buf = &ring->buf_ring->bufs[i];
+        buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)i * URING_BUF_SIZE);
+        buf->len = URING_BUF_SIZE;
+        buf->bid = i;
+    }
+    __atomic_store_n(&ring->buf_ring->tail, URING_BUF_COUNT, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int uring_init(uring *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    if (!kernel_has_multishot_recv())
+    {
+        fprintf(stderr, "io_uring: multishot receive needs Linux 6.0\n");
+        return -1;
+    }
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    ring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (ring->fd < 0)
+    {
+        perror("io_uring_setup failed");
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP) || !kernel_has_ops(ring->fd))
+    {
+        fprintf(stderr, "io_uring: kernel lacks required operations\n");
+        uring_exit(ring);
+        return -1;
+    }
+    if (map_rings(ring, &p) < 0)
+    {
+        perror("io_uring mmap failed");
+        ring->sq_ring = NULL;
+        ring->sqes = NULL;
+        uring_exit(ring);
+        return -1;
+    }
+    if (setup_buffers(ring) < 0)
+    {
+        perror("io_uring buffer ring failed");
+        uring_exit(ring);
+        return -1;
+    }
+    return 0;
+}
+
+void uring_exit(uring *ring)
+{
+    if (ring->fd >= 0)
+        close(ring->fd);
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->sq_ring)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->buf_ring)
+        munmap(ring->buf_ring, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+    free(ring->bufs);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+struct io_uring_sqe *uring_get_sqe(uring *ring, uint64_t user_data)
+{
+    unsigned tail = *ring->sq_tail;
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+    {
+        uring_submit(ring, 0);
+        tail = *ring->sq_tail;
+    }
+    unsigned index = tail & ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->pending++;
+    return sqe;
+}
+
+int uring_submit(uring *ring, unsigned wait_nr)
+{
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    ring->enters++;
+    int ret = syscall(__NR_io_uring_enter, ring->fd, ring->pending, wait_nr, flags, NULL, 0);
+    if (ret < 0)
+        return -1;
+    ring->pending -= (unsigned)ret < ring->pending ? (unsigned)ret : ring->pending;
+    return 0;
+}
+
+struct io_uring_cqe *uring_peek_cqe(uring *ring)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_cqe_seen(uring *ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+const char *uring_buf(uring *ring, const struct io_uring_cqe *cqe)
+{
+    unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    return ring->bufs + (size_t)bid * URING_BUF_SIZE;
+}
+
+void uring_buf_recycle(uring *ring, const struct io_uring_cqe *cqe)
+{
+    unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    unsigned short tail = ring->buf_ring->tail;
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[tail & (URING_BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    __atomic_store_n(&ring->buf_ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+void uring_prep_accept(uring *ring, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, user_data);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+}
+
+void uring_prep_recv(uring *ring, int fd, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, user_data);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+}
+
+void uring_prep_send(uring *ring, int fd, const void *buf, size_t len, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, user_data);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+}
+
+void uring_prep_poll(uring *ring, int fd, unsigned events, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, user_data);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+}
+
+void uring_prep_cancel(uring *ring, uint64_t target, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(ring, user_data);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    if (target == 0)
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+}
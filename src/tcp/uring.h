@@ -0,0 +1,141 @@
+#ifndef URING_H
+#define URING_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 256     // submission queue size
+#define URING_BUF_COUNT 64    // receive buffers provided to the kernel, a power of two
+#define URING_BUF_SIZE 16384  // byte size of a receive buffer
+#define URING_BUF_GROUP 0     // buffer group of the receive buffers
+
+/**
+ * @brief io_uring instance with its mapped rings and receive buffers
+ */
+typedef struct uring
+{
+    int fd;                          // io_uring file descriptor
+    void *sq_ring;                   // mapped submission ring
+    size_t sq_ring_size;             // byte size of the submission ring mapping
+    void *cq_ring;                   // mapped completion ring, same as sq_ring with a single mmap
+    size_t cq_ring_size;             // byte size of the completion ring mapping
+    struct io_uring_sqe *sqes;       // submission entries
+    size_t sqes_size;                // byte size of the submission entries mapping
+    unsigned *sq_head;               // consumed by the kernel
+    unsigned *sq_tail;               // produced by us
+    unsigned *sq_array;              // ring slot -> submission entry index
+    unsigned sq_mask;                // ring index mask
+    unsigned sq_entries;             // number of submission entries
+    unsigned *cq_head;               // consumed by us
+    unsigned *cq_tail;               // produced by the kernel
+    unsigned cq_mask;                // ring index mask
+    struct io_uring_cqe *cqes;       // completion entries
+    unsigned pending;                // entries queued since the last io_uring_enter
+    struct io_uring_buf_ring *buf_ring; // receive buffers handed to the kernel
+    char *bufs;                      // receive buffer memory
+    unsigned long enters;            // number of io_uring_enter calls
+} uring;
+
+/**
+ * @brief Set up a ring with multishot receive buffers
+ * @param ring ring to set up
+ * @return 0 on success, -1 if the kernel lacks a required feature
+ */
+int uring_init(uring *ring);
+
+/**
+ * @brief Release the ring, in-flight requests are cancelled by the kernel
+ * @param ring ring to release
+ */
+void uring_exit(uring *ring);
+
+/**
+ * @brief Get a cleared submission entry, submitting queued ones if the ring is full
+ * @param ring ring
+ * @param user_data value returned in the completion
+ * @return submission entry
+ */
+struct io_uring_sqe *uring_get_sqe(uring *ring, uint64_t user_data);
+
+/**
+ * @brief Submit the queued entries and wait for completions, one io_uring_enter
+ * @param ring ring
+ * @param wait_nr number of completions to wait for, 0 to only submit
+ * @return 0 on success, -1 on error (errno set)
+ */
+int uring_submit(uring *ring, unsigned wait_nr);
+
+/**
+ * @brief Next completion, if any
+ * @param ring ring
+ * @return completion, valid until uring_cqe_seen, or NULL
+ */
+struct io_uring_cqe *uring_peek_cqe(uring *ring);
+
+/**
+ * @brief Release the completion returned by uring_peek_cqe
+ * @param ring ring
+ */
+void uring_cqe_seen(uring *ring);
+
+/**
+ * @brief Receive buffer picked by the kernel for a completion
+ * @param ring ring
+ * @param cqe completion with IORING_CQE_F_BUFFER
+ * @return buffer
+ */
+const char *uring_buf(uring *ring, const struct io_uring_cqe *cqe);
+
+/**
+ * @brief Give a receive buffer back to the kernel
+ * @param ring ring
+ * @param cqe completion that carried the buffer
+ */
+void uring_buf_recycle(uring *ring, const struct io_uring_cqe *cqe);
+
+/**
+ * @brief Queue a multishot accept, sockets are created non-blocking and close-on-exec
+ * @param ring ring
+ * @param fd listening socket
+ * @param user_data value returned in the completions
+ */
+void uring_prep_accept(uring *ring, int fd, uint64_t user_data);
+
+/**
+ * @brief Queue a multishot receive into the provided buffers
+ * @param ring ring
+ * @param fd socket
+ * @param user_data value returned in the completions
+ */
+void uring_prep_recv(uring *ring, int fd, uint64_t user_data);
+
+/**
+ * @brief Queue a send
+ * @param ring ring
+ * @param fd socket
+ * @param buf data, kept alive until the completion
+ * @param len byte size of the data
+ * @param user_data value returned in the completion
+ */
+void uring_prep_send(uring *ring, int fd, const void *buf, size_t len, uint64_t user_data);
+
+/**
+ * @brief Queue a one-shot poll
+ * @param ring ring
+ * @param fd descriptor
+ * @param events POLLIN / POLLOUT
+ * @param user_data value returned in the completion
+ */
+void uring_prep_poll(uring *ring, int fd, unsigned events, uint64_t user_data);
+
+/**
+ * @brief Queue the cancellation of a request
+ * @param ring ring
+ * @param target user_data of the request to cancel, 0 for every request
+ * @param user_data value returned in the completion of the cancellation
+ */
+void uring_prep_cancel(uring *ring, uint64_t target, uint64_t user_data);
+
+#endif // URING_H
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "defineshit.h"
+
+// sample resident checker (see judge/checker.h for the protocol): outputs match when their
+// whitespace-separated tokens do, numbers within an absolute or relative error of EPSILON
+#define EPSILON 1e-6
+
+/**
+ * @brief read exactly size bytes from stdin
+ * @param buf buffer, grown as needed
+ * @param cap byte size of the buffer (in/out)
+ * @param size byte size to read
+ * @return 0 on success, -1 on EOF or error
+ */
+static int read_blob(char **buf, size_t *cap, size_t size)
+{
+    if (size + 1 > *cap)
+    {
+        char *grown = realloc(*buf, size + 1);
+        if (!grown)
+            return -1;
+        *buf = grown;
+        *cap = size + 1;
+    }
+    if (fread(*buf, 1, size, stdin) != size)
+        return -1;
+    (*buf)[size] = '\0';
+    return 0;
+}
+
+/**
+ * @brief find the next token
+ * @param p position, moved past the token (in/out)
+ * @param len byte size of the token (output)
+ * @return start of the token, or NULL at the end
+ */
+static const char *next_token(const char **p, size_t *len)
+{
+    const char *s = *p;
+    while (*s && isspace((unsigned char)*s))
+        s++;
+    if (!*s)
+        return NULL;
+    const char *e = s;
+    while (*e && !isspace((unsigned char)*e))
+        e++;
+    *p = e;
+    *len = e - s;
+    return s;
+}
+
+/**
+ * @brief parse a whole token as a number
+ * @param token token
+ * @param len byte size of the token
+ * @param value number (output)
+ * @return 1 if the token is a number, 0 otherwise
+ */
+static int parse_number(const char *token, size_t len, double *value)
+{
+    char tmp[64];
+    if (len >= sizeof(tmp))
+        return 0;
+    memcpy(tmp, token, len);
+    tmp[len] = '\0';
+    char *end;
+    *value = strtod(tmp, &end);
+    return end == tmp + len && isfinite(*value);
+}
+
+/**
+ * @brief compare the expected and the actual output token by token
+ * @param expected expected output
+ * @param actual solution output
+ * @return 1 if they match, 0 otherwise
+ */
+static int tokens_match(const char *expected, const char *actual)
+{
+    for (;;)
+    {
+        size_t elen, alen;
+        const char *e = next_token(&expected, &elen);
+        const char *a = next_token(&actual, &alen);
+        if (!e || !a)
+            return !e && !a;
+        if (elen == alen && memcmp(e, a, elen) == 0)
+            continue;
+        double ev, av;
+        if (!parse_number(e, elen, &ev) || !parse_number(a, alen, &av))
+            return 0;
+        double diff = fabs(ev - av);
+        if (diff > EPSILON && diff > EPSILON * fabs(ev))
+            return 0;
+    }
+}
+
+int main(void)
+{
+    char *input = NULL, *expected = NULL, *actual = NULL;
+    size_t input_cap = 0, expected_cap = 0, actual_cap = 0;
+    unsigned long long tag;
+    long long input_len, expected_len, actual_len;
+    // one request after another until the judge closes the pipe
+    while (scanf("%llu %lld %lld %lld", &tag, &input_len, &expected_len, &actual_len) == 4)
+    {
+        if (getchar() != '\n' || input_len < 0 || expected_len < 0 || actual_len < 0)
+            return 1;
+        if (read_blob(&input, &input_cap, input_len) < 0 || read_blob(&expected, &expected_cap, expected_len) < 0 ||
+            read_blob(&actual, &actual_cap, actual_len) < 0)
+            return 1;
+        printf("%llu %s\n", tag, tokens_match(expected, actual) ? "AC" : "WA");
+        fflush(stdout);
+    }
+    free(input);
+    free(expected);
+    free(actual);
+    return 0;
+}
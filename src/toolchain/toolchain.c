@@ -0,0 +1,107 @@
+#include "toolchain.h"
+#include <string.h>
+
+// C headers are cheap to parse, a precompiled stdio.h did not change the compile time
+static const toolchain toolchains[] = {
+    {
+        .name = "c",
+        .extension = ".c",
+        .upload_tag = "TEXTFILE",
+        .detach_tag = "TEXTTCKT",
+        .profile_tag = "TEXTPROF",
+        .job_tag = "JUDGEJOB",
+        .compiler = "gcc",
+        .language = "c",
+        .flags = {"-O2", "-std=gnu11", NULL},
+        .libs = {"-lm", NULL},
+        .solution_name = "solution.c",
+        .pch_header = NULL,
+    },
+    {
+        .name = "c++",
+        .extension = ".cpp",
+        .upload_tag = "CPP_FILE",
+        .detach_tag = "CPP_TCKT",
+        .profile_tag = "CPP_PROF",
+        .job_tag = "JUDGECPP",
+        .compiler = "g++",
+        .language = "c++",
+        .flags = {"-O2", "-std=gnu++17", NULL},
+        .libs = {NULL},
+        .solution_name = "solution.cpp",
+        .pch_header = "bits/stdc++.h",
+    },
+};
+
+#define N_TOOLCHAINS (sizeof(toolchains) / sizeof(toolchains[0]))
+
+const toolchain *toolchain_by_upload_tag(const char *tag)
+{
+    for (size_t i = 0; i < N_TOOLCHAINS; i++)
+    {
+        if (memcmp(tag, toolchains[i].upload_tag, 8) == 0)
+            return &toolchains[i];
+    }
+    return NULL;
+}
+
+const toolchain *toolchain_by_detach_tag(const char *tag)
+{
+    for (size_t i = 0; i < N_TOOLCHAINS; i++)
+    {
+        if (memcmp(tag, toolchains[i].detach_tag, 8) == 0)
+            return &toolchains[i];
+    }
+    return NULL;
+}
+
+const toolchain *toolchain_by_profile_tag(const char *tag)
+{
+    for (size_t i = 0; i < N_TOOLCHAINS; i++)
+    {
+        if (memcmp(tag, toolchains[i].profile_tag, 8) == 0)
+            return &toolchains[i];
+    }
+    return NULL;
+}
+
+const toolchain *toolchain_by_job_tag(const char *tag)
+{
+    for (size_t i = 0; i < N_TOOLCHAINS; i++)
+    {
+        if (memcmp(tag, toolchains[i].job_tag, 8) == 0)
+            return &toolchains[i];
+    }
+    return NULL;
+}
+
+const toolchain *toolchain_by_path(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    if (!ext || strchr(ext, '/'))
+        return NULL;
+    // accept the usual C++ spellings from the client side
+    if (strcmp(ext, ".cc") == 0 || strcmp(ext, ".cxx") == 0)
+        ext = ".cpp";
+    for (size_t i = 0; i < N_TOOLCHAINS; i++)
+    {
+        if (strcmp(ext, toolchains[i].extension) == 0)
+            return &toolchains[i];
+    }
+    return NULL;
+}
+
+const toolchain *toolchain_by_name(const char *name)
+{
+    for (size_t i = 0; i < N_TOOLCHAINS; i++)
+    {
+        if (strcmp(name, toolchains[i].name) == 0)
+            return &toolchains[i];
+    }
+    return NULL;
+}
+
+const toolchain *toolchain_default(void)
+{
+    return &toolchains[0];
+}
@@ -0,0 +1,76 @@
+#ifndef TOOLCHAIN_H
+#define TOOLCHAIN_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+
+#define TOOLCHAIN_MAX_FLAGS 8
+
+/**
+ * @brief compiler and fixed flags of a submission language
+ */
+typedef struct toolchain
+{
+    const char *name;          // language name, also the cache key prefix
+    const char *extension;     // extension of received source files
+    const char *upload_tag;    // 8-byte header type of a client upload
+    const char *detach_tag;    // 8-byte header type of a client upload answered with a ticket
+    const char *profile_tag;   // 8-byte header type of a client upload whose accepted run is profiled
+    const char *job_tag;       // 8-byte header type of a job forwarded to a judge node
+    const char *compiler;      // compiler executable, looked up in PATH
+    const char *language;      // -x argument, used when the source arrives on stdin
+    const char *flags[TOOLCHAIN_MAX_FLAGS]; // flags placed before the source, NULL-terminated
+    const char *libs[TOOLCHAIN_MAX_FLAGS];  // flags placed after the source, NULL-terminated
+    const char *solution_name; // name shown instead of the received file name in diagnostics
+    const char *pch_header;    // header to precompile (e.g. bits/stdc++.h), NULL for none
+} toolchain;
+
+/**
+ * @brief Find the toolchain of a client upload header type.
+ * @param tag 8-byte header type.
+ * @return toolchain, or NULL if the type is not a source upload.
+ */
+const toolchain *toolchain_by_upload_tag(const char *tag);
+
+/**
+ * @brief Find the toolchain of a detached upload header type.
+ * @param tag 8-byte header type.
+ * @return toolchain, or NULL if the type is not a detached upload.
+ */
+const toolchain *toolchain_by_detach_tag(const char *tag);
+
+/**
+ * @brief Find the toolchain of a profiled upload header type.
+ * @param tag 8-byte header type.
+ * @return toolchain, or NULL if the type is not a profiled upload.
+ */
+const toolchain *toolchain_by_profile_tag(const char *tag);
+
+/**
+ * @brief Find the toolchain of a forwarded job header type.
+ * @param tag 8-byte header type.
+ * @return toolchain, or NULL if the type is not a forwarded job.
+ */
+const toolchain *toolchain_by_job_tag(const char *tag);
+
+/**
+ * @brief Find the toolchain of a source file by its extension.
+ * @param path source file path.
+ * @return toolchain, or NULL if the extension is unknown.
+ */
+const toolchain *toolchain_by_path(const char *path);
+
+/**
+ * @brief Find a toolchain by its name.
+ * @param name language name (e.g. "c++").
+ * @return toolchain, or NULL if the name is unknown.
+ */
+const toolchain *toolchain_by_name(const char *name);
+
+/**
+ * @brief Default toolchain (C), used for sources without a known extension.
+ * @return toolchain.
+ */
+const toolchain *toolchain_default(void);
+
+#endif // TOOLCHAIN_H
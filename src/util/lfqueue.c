@@ -0,0 +1,72 @@
+#include "lfqueue.h"
+#include <string.h>
+
+void mpsc_init(mpsc_queue *q)
+{
+    q->stub.next = NULL;
+    q->head = &q->stub;
+    q->tail = &q->stub;
+}
+
+void mpsc_push(mpsc_queue *q, mpsc_node *node)
+{
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    // the swap orders the pushes, the link publishes the item to the consumer
+    mpsc_node *prev = __atomic_exchange_n(&q->head, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+mpsc_node *mpsc_pop(mpsc_queue *q)
+{
+    mpsc_node *tail = q->tail;
+    mpsc_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &q->stub)
+    {
+        if (!next)
+            return NULL;
+        q->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next)
+    {
+        q->tail = next;
+        return tail;
+    }
+    // tail is the last item unless a producer has swapped the head but not linked yet
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+        return NULL;
+    mpsc_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next)
+    {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+void spsc_init(spsc_ring *r)
+{
+    memset(r, 0, sizeof(*r));
+}
+
+int spsc_push(spsc_ring *r, void *item)
+{
+    size_t tail = r->tail;
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= SPSC_SIZE)
+        return -1;
+    r->slots[tail & (SPSC_SIZE - 1)] = item;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void *spsc_pop(spsc_ring *r)
+{
+    size_t head = r->head;
+    if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    void *item = r->slots[head & (SPSC_SIZE - 1)];
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+    return item;
+}
@@ -0,0 +1,80 @@
+#ifndef LFQUEUE_H
+#define LFQUEUE_H
+
+#include "../defineshit.h"
+#include <stddef.h>
+
+#define SPSC_SIZE 1024 // slots of a single-producer ring, a power of two
+#define CACHE_LINE 64  // keeps the producer and consumer indexes apart
+
+/**
+ * @brief link of an item in an MPSC queue, embedded in the item
+ */
+typedef struct mpsc_node
+{
+    struct mpsc_node *next; // next item, written once by the producer
+} mpsc_node;
+
+/**
+ * @brief unbounded intrusive queue, any thread pushes and one thread pops
+ */
+typedef struct mpsc_queue
+{
+    _Alignas(CACHE_LINE) mpsc_node *head; // last item pushed, swapped by the producers
+    _Alignas(CACHE_LINE) mpsc_node *tail; // next item to pop, consumer only
+    mpsc_node stub;                       // placeholder that keeps the queue from ever being empty
+} mpsc_queue;
+
+/**
+ * @brief bounded ring of pointers, one producer thread and one consumer thread
+ */
+typedef struct spsc_ring
+{
+    _Alignas(CACHE_LINE) size_t head; // next slot to pop, written by the consumer
+    _Alignas(CACHE_LINE) size_t tail; // next slot to push, written by the producer
+    void *slots[SPSC_SIZE];           // items
+} spsc_ring;
+
+/**
+ * @brief Initialize an empty queue
+ * @param q queue
+ */
+void mpsc_init(mpsc_queue *q);
+
+/**
+ * @brief Push an item, wait-free, from any thread
+ * @param q queue
+ * @param node link embedded in the item, must not be in a queue
+ */
+void mpsc_push(mpsc_queue *q, mpsc_node *node);
+
+/**
+ * @brief Pop the oldest item, consumer thread only
+ * @param q queue
+ * @return link of the item, or NULL if the queue is empty or the next push is
+ *      half done (its producer signals the consumer again once it is complete)
+ */
+mpsc_node *mpsc_pop(mpsc_queue *q);
+
+/**
+ * @brief Initialize an empty ring
+ * @param r ring
+ */
+void spsc_init(spsc_ring *r);
+
+/**
+ * @brief Push an item, producer thread only
+ * @param r ring
+ * @param item item, not NULL
+ * @return 0 on success, -1 if the ring is full
+ */
+int spsc_push(spsc_ring *r, void *item);
+
+/**
+ * @brief Pop the oldest item, consumer thread only
+ * @param r ring
+ * @return item, or NULL if the ring is empty
+ */
+void *spsc_pop(spsc_ring *r);
+
+#endif // LFQUEUE_H
@@ -0,0 +1,50 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include "../defineshit.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+
+/**
+ * @brief incremental SHA-256 state
+ */
+typedef struct sha256_ctx
+{
+    uint32_t state[8];       // intermediate hash value
+    uint64_t length;         // byte size hashed so far
+    unsigned char block[64]; // partial block
+    size_t block_len;        // byte size of the partial block
+} sha256_ctx;
+
+/**
+ * @brief Start a new hash
+ * @param ctx hash state
+ */
+void sha256_init(sha256_ctx *ctx);
+
+/**
+ * @brief Hash more data
+ * @param ctx hash state
+ * @param data data to hash
+ * @param len byte size of the data
+ */
+void sha256_update(sha256_ctx *ctx, const void *data, size_t len);
+
+/**
+ * @brief Finish the hash
+ * @param ctx hash state
+ * @param digest 32-byte digest (output)
+ */
+void sha256_final(sha256_ctx *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * @brief Format a digest as lowercase hex
+ * @param digest 32-byte digest
+ * @param hex 65-byte buffer (output)
+ */
+void sha256_hex(const unsigned char digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]);
+
+#endif // SHA256_H